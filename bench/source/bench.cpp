@@ -0,0 +1,700 @@
+#include "GltfIblSampler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace IBLLib;
+
+// Benchmarks the filtering on procedural inputs generated in memory, so the numbers contain no file I/O.
+// Every combination of the parameter lists is run, the results are written as CSV and/or JSON.
+
+namespace
+{
+	struct Named
+	{
+		const char* name;
+		unsigned int value;
+	};
+
+	const Named g_distributions[] = {
+		{ "Lambertian", static_cast<unsigned int>(Distribution::Lambertian) },
+		{ "GGX", static_cast<unsigned int>(Distribution::GGX) },
+		{ "Charlie", static_cast<unsigned int>(Distribution::Charlie) },
+		{ "LambertianSH", static_cast<unsigned int>(Distribution::LambertianSH) },
+	};
+
+	const Named g_formats[] = {
+		{ "R8G8B8A8_UNORM", static_cast<unsigned int>(OutputFormat::R8G8B8A8_UNORM) },
+		{ "R16G16B16A16_SFLOAT", static_cast<unsigned int>(OutputFormat::R16G16B16A16_SFLOAT) },
+		{ "R32G32B32A32_SFLOAT", static_cast<unsigned int>(OutputFormat::R32G32B32A32_SFLOAT) },
+		{ "B9G9R9E5_UFLOAT", static_cast<unsigned int>(OutputFormat::B9G9R9E5_UFLOAT) },
+	};
+
+	const Named g_intermediateFormats[] = {
+		{ "R32G32B32A32_SFLOAT", static_cast<unsigned int>(IntermediateFormat::R32G32B32A32_SFLOAT) },
+		{ "R16G16B16A16_SFLOAT", static_cast<unsigned int>(IntermediateFormat::R16G16B16A16_SFLOAT) },
+		{ "B10G11R11_UFLOAT", static_cast<unsigned int>(IntermediateFormat::B10G11R11_UFLOAT) },
+	};
+
+	const Named g_backends[] = {
+		{ "Vulkan", static_cast<unsigned int>(Backend::Vulkan) },
+		{ "VulkanCompute", static_cast<unsigned int>(Backend::VulkanCompute) },
+		{ "CPU", static_cast<unsigned int>(Backend::CPU) },
+	};
+
+	enum class Scene
+	{
+		Sky, // smooth gradient, the easy case for importance sampling
+		Sun // the sky with a small disc that is several orders of magnitude brighter
+	};
+
+	struct Config
+	{
+		Scene scene;
+		bool cubeInput;
+		unsigned int resolution;
+		unsigned int sampleCount;
+		unsigned int distribution; // index into g_distributions
+		unsigned int format; // index into g_formats
+		unsigned int mipCount;
+		unsigned int intermediateFormat; // index into g_intermediateFormats
+	};
+
+	struct StageTime
+	{
+		std::string name;
+		double gpuMs;
+		double hostMs;
+	};
+
+	struct Measurement
+	{
+		double wallMs = 0.0;
+		double filterGpuMs = 0.0;
+		std::vector<StageTime> stages;
+		double texelSamples = 0.0;
+
+		// of the RGB channels against the R32G32B32A32_SFLOAT intermediate, both filtered to R32G32B32A32_SFLOAT
+		double meanRelativeError = 0.0;
+		double maxRelativeError = 0.0;
+	};
+
+	template <size_t N>
+	bool findNamed(const Named (&_table)[N], const std::string& _name, unsigned int& _outIndex)
+	{
+		for (size_t i = 0; i < N; ++i)
+		{
+			if (_name == _table[i].name)
+			{
+				_outIndex = static_cast<unsigned int>(i);
+				return true;
+			}
+		}
+
+		printf("Unknown value %s\n", _name.c_str());
+		return false;
+	}
+
+	std::vector<std::string> splitList(const char* _list)
+	{
+		std::vector<std::string> items;
+		std::string item;
+
+		for (const char* c = _list; ; ++c)
+		{
+			if (*c == ',' || *c == '\0')
+			{
+				if (!item.empty())
+				{
+					items.push_back(item);
+				}
+				item.clear();
+
+				if (*c == '\0')
+				{
+					break;
+				}
+			}
+			else
+			{
+				item += *c;
+			}
+		}
+
+		return items;
+	}
+
+	void radiance(Scene _scene, float _x, float _y, float _z, float* _outRGB)
+	{
+		const float length = sqrtf(_x * _x + _y * _y + _z * _z);
+		_x /= length; _y /= length; _z /= length;
+
+		if (_y > 0.0f)
+		{
+			// horizon to zenith
+			const float t = sqrtf(_y);
+			_outRGB[0] = 1.0f + (0.25f - 1.0f) * t;
+			_outRGB[1] = 0.9f + (0.45f - 0.9f) * t;
+			_outRGB[2] = 0.8f + (1.0f - 0.8f) * t;
+		}
+		else
+		{
+			_outRGB[0] = 0.2f;
+			_outRGB[1] = 0.18f;
+			_outRGB[2] = 0.15f;
+		}
+
+		if (_scene == Scene::Sun)
+		{
+			// 2 degree disc, large enough to cover texels of the small test resolutions
+			const float sun[3] = { 0.48f, 0.6f, 0.64f };
+			const float cosAngle = _x * sun[0] + _y * sun[1] + _z * sun[2];
+			if (cosAngle > 0.99939f)
+			{
+				_outRGB[0] = 50000.0f;
+				_outRGB[1] = 47000.0f;
+				_outRGB[2] = 42000.0f;
+			}
+		}
+	}
+
+	// RGBA32F equirectangular panorama of 4n x 2n texels, it is filtered to a cube map of n x n
+	void createPanorama(Scene _scene, unsigned int _resolution, unsigned int& _outWidth, unsigned int& _outHeight, std::vector<float>& _outData)
+	{
+		const float pi = 3.14159265358979f;
+
+		_outWidth = 4u * _resolution;
+		_outHeight = 2u * _resolution;
+		_outData.resize(static_cast<size_t>(_outWidth) * _outHeight * 4u);
+
+		for (unsigned int y = 0; y < _outHeight; ++y)
+		{
+			const float theta = (y + 0.5f) / _outHeight * pi;
+
+			for (unsigned int x = 0; x < _outWidth; ++x)
+			{
+				const float phi = (x + 0.5f) / _outWidth * 2.0f * pi;
+				float* texel = &_outData[(static_cast<size_t>(y) * _outWidth + x) * 4u];
+
+				radiance(_scene, sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi), texel);
+				texel[3] = 1.0f;
+			}
+		}
+	}
+
+	// RGBA32F cube map with six n x n faces in +X, -X, +Y, -Y, +Z, -Z order
+	void createCube(Scene _scene, unsigned int _resolution, std::vector<float>& _outData)
+	{
+		_outData.resize(static_cast<size_t>(_resolution) * _resolution * 6u * 4u);
+
+		for (unsigned int face = 0; face < 6u; ++face)
+		{
+			for (unsigned int y = 0; y < _resolution; ++y)
+			{
+				for (unsigned int x = 0; x < _resolution; ++x)
+				{
+					const float u = (x + 0.5f) / _resolution * 2.0f - 1.0f;
+					const float v = (y + 0.5f) / _resolution * 2.0f - 1.0f;
+
+					float direction[3];
+					switch (face)
+					{
+					case 0: direction[0] = 1.0f; direction[1] = -v; direction[2] = -u; break;
+					case 1: direction[0] = -1.0f; direction[1] = -v; direction[2] = u; break;
+					case 2: direction[0] = u; direction[1] = 1.0f; direction[2] = v; break;
+					case 3: direction[0] = u; direction[1] = -1.0f; direction[2] = -v; break;
+					case 4: direction[0] = u; direction[1] = -v; direction[2] = 1.0f; break;
+					default: direction[0] = -u; direction[1] = -v; direction[2] = -1.0f; break;
+					}
+
+					float* texel = &_outData[((static_cast<size_t>(face) * _resolution + y) * _resolution + x) * 4u];
+					radiance(_scene, direction[0], direction[1], direction[2], texel);
+					texel[3] = 1.0f;
+				}
+			}
+		}
+	}
+
+	// the levels are only counted, the bench measures the library and not the copies of the caller
+	void discardLevel(void* _userData, unsigned int, unsigned int, const void*, size_t _byteSize)
+	{
+		*static_cast<size_t*>(_userData) += _byteSize;
+	}
+
+	void appendLevel(void* _userData, unsigned int, unsigned int, const void* _data, size_t _byteSize)
+	{
+		std::vector<float>& values = *static_cast<std::vector<float>*>(_userData);
+		const float* levelValues = static_cast<const float*>(_data);
+		values.insert(values.end(), levelValues, levelValues + _byteSize / sizeof(float));
+	}
+
+	InputImage getInputImage(const Config& _config, const std::vector<float>& _input, unsigned int _width, unsigned int _height)
+	{
+		InputImage input{};
+		input.data = _input.data();
+		input.format = InputFormat::R32G32B32A32_SFLOAT;
+		input.width = _width;
+		input.height = _height;
+		input.faceCount = _config.cubeInput ? 6u : 1u;
+
+		return input;
+	}
+
+	// all mip levels of the config filtered to R32G32B32A32_SFLOAT from the given intermediate format
+	Result sampleToFloats(Context* _context, const Config& _config, unsigned int _intermediateFormat, const std::vector<float>& _input, unsigned int _width, unsigned int _height,
+		std::vector<float>& _outValues)
+	{
+		Result res = setIntermediateFormat(_context, static_cast<IntermediateFormat>(g_intermediateFormats[_intermediateFormat].value));
+		if (res != Result::Success)
+		{
+			return res;
+		}
+
+		_outValues.clear();
+
+		OutputBuffers output{};
+		output.levelCallback = appendLevel;
+		output.userData = &_outValues;
+
+		return sample(_context, getInputImage(_config, _input, _width, _height), output, static_cast<Distribution>(g_distributions[_config.distribution].value),
+			_config.resolution, _config.mipCount, _config.sampleCount, OutputFormat::R32G32B32A32_SFLOAT, 0.0f);
+	}
+
+	// Compares the output of the intermediate format of the config with the R32G32B32A32_SFLOAT intermediate,
+	// errors are relative to the reference value and values below 1/1024 count as 1/1024.
+	Result measureError(Context* _context, const Config& _config, const std::vector<float>& _input, unsigned int _width, unsigned int _height, Measurement& _outMeasurement)
+	{
+		_outMeasurement.meanRelativeError = 0.0;
+		_outMeasurement.maxRelativeError = 0.0;
+
+		if (_config.intermediateFormat == 0u)
+		{
+			return Result::Success;
+		}
+
+		std::vector<float> reference, values;
+
+		Result res = sampleToFloats(_context, _config, 0u, _input, _width, _height, reference);
+		if (res != Result::Success || (res = sampleToFloats(_context, _config, _config.intermediateFormat, _input, _width, _height, values)) != Result::Success)
+		{
+			return res;
+		}
+
+		double errorSum = 0.0;
+		size_t count = 0u;
+
+		for (size_t i = 0; i < reference.size() && i < values.size(); ++i)
+		{
+			// alpha is not filtered
+			if ((i & 3u) == 3u)
+			{
+				continue;
+			}
+
+			const double error = fabs(static_cast<double>(values[i]) - reference[i]) / std::max(fabs(static_cast<double>(reference[i])), 1.0 / 1024.0);
+			_outMeasurement.maxRelativeError = std::max(_outMeasurement.maxRelativeError, error);
+			errorSum += error;
+			++count;
+		}
+
+		_outMeasurement.meanRelativeError = count > 0u ? errorSum / count : 0.0;
+
+		return Result::Success;
+	}
+
+	Result runConfig(Context* _context, bool _profiling, const Config& _config, const std::vector<float>& _input, unsigned int _width, unsigned int _height, Measurement& _outMeasurement)
+	{
+		size_t outputBytes = 0u;
+
+		Result res = setIntermediateFormat(_context, static_cast<IntermediateFormat>(g_intermediateFormats[_config.intermediateFormat].value));
+		if (res != Result::Success)
+		{
+			return res;
+		}
+
+		OutputBuffers output{};
+		output.levelCallback = discardLevel;
+		output.userData = &outputBytes;
+
+		const Distribution distribution = static_cast<Distribution>(g_distributions[_config.distribution].value);
+
+		const auto start = std::chrono::steady_clock::now();
+
+		res = sample(_context, getInputImage(_config, _input, _width, _height), output, distribution, _config.resolution, _config.mipCount, _config.sampleCount,
+			static_cast<OutputFormat>(g_formats[_config.format].value), 0.0f);
+		if (res != Result::Success)
+		{
+			return res;
+		}
+
+		_outMeasurement.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		_outMeasurement.filterGpuMs = 0.0;
+		_outMeasurement.stages.clear();
+
+		unsigned int mipCount = _config.mipCount;
+		if (mipCount == 0u)
+		{
+			for (unsigned int m = _config.resolution; m > 0u; m >>= 1u, ++mipCount) {}
+		}
+
+		_outMeasurement.texelSamples = 0.0;
+		if (distribution != Distribution::LambertianSH)
+		{
+			for (unsigned int level = 0; level < mipCount; ++level)
+			{
+				const double sideLength = static_cast<double>(std::max(_config.resolution >> level, 1u));
+				_outMeasurement.texelSamples += 6.0 * sideLength * sideLength * _config.sampleCount;
+			}
+		}
+
+		if (_profiling)
+		{
+			const ProfileStage* stages = nullptr;
+			unsigned int stageCount = 0u;
+			if ((res = getProfile(_context, stages, stageCount)) != Result::Success)
+			{
+				return res;
+			}
+
+			for (unsigned int i = 0; i < stageCount; ++i)
+			{
+				// the mip levels are summed up into one filter stage
+				const bool isFilterLevel = strncmp(stages[i].name, "filter level", 12) == 0;
+				const std::string name = isFilterLevel ? "filter" : stages[i].name;
+
+				if (isFilterLevel)
+				{
+					_outMeasurement.filterGpuMs += stages[i].gpuMs;
+				}
+
+				auto it = std::find_if(_outMeasurement.stages.begin(), _outMeasurement.stages.end(), [&name](const StageTime& _stage) { return _stage.name == name; });
+				if (it == _outMeasurement.stages.end())
+				{
+					_outMeasurement.stages.push_back({ name, stages[i].gpuMs, stages[i].hostMs });
+				}
+				else
+				{
+					it->gpuMs += stages[i].gpuMs;
+					it->hostMs += stages[i].hostMs;
+				}
+			}
+		}
+
+		return Result::Success;
+	}
+} // !anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	const char* backendString = "Vulkan";
+	const char* scenesString = "sky,sun";
+	const char* layoutsString = "panorama";
+	const char* resolutionsString = "64,128";
+	const char* sampleCountsString = "64,256";
+	const char* distributionsString = "Lambertian,GGX,Charlie";
+	const char* formatsString = "R16G16B16A16_SFLOAT,B9G9R9E5_UFLOAT";
+	const char* mipCountsString = "0";
+	const char* intermediateFormatsString = "R32G32B32A32_SFLOAT";
+	unsigned int repeatCount = 3u;
+	const char* pathCsv = nullptr;
+	const char* pathJson = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* nextArg = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
+		{
+			printf("ibl_bench usage:\n");
+			printf("Lists are comma separated, every combination is benchmarked.\n");
+			printf("-backend: Vulkan, VulkanCompute or CPU (default = Vulkan) \n");
+			printf("-scenes: sky (smooth gradient), sun (gradient with a bright sun disc) (default = sky,sun) \n");
+			printf("-layouts: panorama (4n x 2n equirectangular input), cube (n x n cube map input) (default = panorama) \n");
+			printf("-resolutions: output cube map resolutions (default = 64,128) \n");
+			printf("-sampleCounts: (default = 64,256) \n");
+			printf("-distributions: Lambertian, GGX, Charlie, LambertianSH (default = Lambertian,GGX,Charlie) \n");
+			printf("-targetFormats: R8G8B8A8_UNORM, R16G16B16A16_SFLOAT, R32G32B32A32_SFLOAT, B9G9R9E5_UFLOAT (default = R16G16B16A16_SFLOAT,B9G9R9E5_UFLOAT) \n");
+			printf("-mipLevelCounts: 0 derives the mip count from the resolution (default = 0) \n");
+			printf("-intermediateFormats: R32G32B32A32_SFLOAT, R16G16B16A16_SFLOAT, B10G11R11_UFLOAT, the reduced ones also report their error against R32G32B32A32_SFLOAT (default = R32G32B32A32_SFLOAT) \n");
+			printf("-repeat: runs per combination after a warm-up run, the fastest one is reported (default = 3) \n");
+			printf("-csv: path of the CSV results (default = ibl_bench.csv unless -json is set) \n");
+			printf("-json: path of the JSON results including the time of every stage \n");
+			return 0;
+		}
+		else if (nextArg == nullptr)
+		{
+			printf("Missing value of %s\n", argv[i]);
+			return -1;
+		}
+		else if (strcmp(argv[i], "-backend") == 0)
+		{
+			backendString = nextArg;
+		}
+		else if (strcmp(argv[i], "-scenes") == 0)
+		{
+			scenesString = nextArg;
+		}
+		else if (strcmp(argv[i], "-layouts") == 0)
+		{
+			layoutsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-resolutions") == 0)
+		{
+			resolutionsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-sampleCounts") == 0)
+		{
+			sampleCountsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-distributions") == 0)
+		{
+			distributionsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-targetFormats") == 0)
+		{
+			formatsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-mipLevelCounts") == 0)
+		{
+			mipCountsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-intermediateFormats") == 0)
+		{
+			intermediateFormatsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-repeat") == 0)
+		{
+			repeatCount = std::max(1u, static_cast<unsigned int>(strtoul(nextArg, NULL, 0)));
+		}
+		else if (strcmp(argv[i], "-csv") == 0)
+		{
+			pathCsv = nextArg;
+		}
+		else if (strcmp(argv[i], "-json") == 0)
+		{
+			pathJson = nextArg;
+		}
+		++i;
+	}
+
+	if (pathCsv == nullptr && pathJson == nullptr)
+	{
+		pathCsv = "ibl_bench.csv";
+	}
+
+	unsigned int backendIndex = 0u;
+	if (!findNamed(g_backends, backendString, backendIndex))
+	{
+		return -1;
+	}
+	const Backend backend = static_cast<Backend>(g_backends[backendIndex].value);
+
+	std::vector<Scene> scenes;
+	for (const std::string& scene : splitList(scenesString))
+	{
+		if (scene != "sky" && scene != "sun")
+		{
+			printf("Unknown scene %s\n", scene.c_str());
+			return -1;
+		}
+		scenes.push_back(scene == "sun" ? Scene::Sun : Scene::Sky);
+	}
+
+	std::vector<bool> layouts;
+	for (const std::string& layout : splitList(layoutsString))
+	{
+		if (layout != "panorama" && layout != "cube")
+		{
+			printf("Unknown layout %s\n", layout.c_str());
+			return -1;
+		}
+		layouts.push_back(layout == "cube");
+	}
+
+	std::vector<unsigned int> resolutions, sampleCounts, distributions, formats, mipCounts, intermediateFormats;
+	for (const std::string& value : splitList(resolutionsString)) { resolutions.push_back(strtoul(value.c_str(), NULL, 0)); }
+	for (const std::string& value : splitList(sampleCountsString)) { sampleCounts.push_back(strtoul(value.c_str(), NULL, 0)); }
+	for (const std::string& value : splitList(mipCountsString)) { mipCounts.push_back(strtoul(value.c_str(), NULL, 0)); }
+	for (const std::string& value : splitList(distributionsString))
+	{
+		unsigned int index = 0u;
+		if (!findNamed(g_distributions, value, index))
+		{
+			return -1;
+		}
+		distributions.push_back(index);
+	}
+	for (const std::string& value : splitList(formatsString))
+	{
+		unsigned int index = 0u;
+		if (!findNamed(g_formats, value, index))
+		{
+			return -1;
+		}
+		formats.push_back(index);
+	}
+	for (const std::string& value : splitList(intermediateFormatsString))
+	{
+		unsigned int index = 0u;
+		if (!findNamed(g_intermediateFormats, value, index))
+		{
+			return -1;
+		}
+		intermediateFormats.push_back(index);
+	}
+
+	Context* context = nullptr;
+	if (createContext(context, false, backend) != Result::Success)
+	{
+		printf("Failed to create the context\n");
+		return -1;
+	}
+
+	const bool profiling = backend != Backend::CPU && setProfiling(context, true) == Result::Success;
+
+	std::vector<Config> configs;
+	for (Scene scene : scenes)
+		for (bool cubeInput : layouts)
+			for (unsigned int resolution : resolutions)
+				for (unsigned int sampleCount : sampleCounts)
+					for (unsigned int distribution : distributions)
+						for (unsigned int format : formats)
+							for (unsigned int mipCount : mipCounts)
+								for (unsigned int intermediateFormat : intermediateFormats)
+									configs.push_back({ scene, cubeInput, resolution, sampleCount, distribution, format, mipCount, intermediateFormat });
+
+	std::vector<Measurement> measurements(configs.size());
+
+	Result res = Result::Success;
+
+	std::vector<float> input;
+	unsigned int inputWidth = 0u, inputHeight = 0u;
+
+	for (size_t i = 0; i < configs.size() && res == Result::Success; ++i)
+	{
+		const Config& config = configs[i];
+
+		// the input only changes with the scene, layout and resolution
+		if (i == 0u || config.scene != configs[i - 1u].scene || config.cubeInput != configs[i - 1u].cubeInput || config.resolution != configs[i - 1u].resolution)
+		{
+			if (config.cubeInput)
+			{
+				createCube(config.scene, config.resolution, input);
+				inputWidth = inputHeight = config.resolution;
+			}
+			else
+			{
+				createPanorama(config.scene, config.resolution, inputWidth, inputHeight, input);
+			}
+		}
+
+		// the warm-up run creates the pipelines of the combination
+		Measurement measurement;
+		for (unsigned int run = 0; run <= repeatCount && res == Result::Success; ++run)
+		{
+			res = runConfig(context, profiling, config, input, inputWidth, inputHeight, measurement);
+
+			if (run == 1u || (run > 1u && measurement.wallMs < measurements[i].wallMs))
+			{
+				measurements[i] = measurement;
+			}
+		}
+
+		// outside of the timed runs
+		if (res == Result::Success)
+		{
+			res = measureError(context, config, input, inputWidth, inputHeight, measurements[i]);
+		}
+
+		if (res != Result::Success)
+		{
+			printf("Benchmark %zu failed [%d]\n", i, static_cast<int>(res));
+			break;
+		}
+
+		const Measurement& best = measurements[i];
+		const double filterMs = best.filterGpuMs > 0.0 ? best.filterGpuMs : best.wallMs;
+		fprintf(stderr, "[%zu/%zu] %s %s %u %u %s %s %u %s: %.2f ms, %.1f Mtexel-samples/s, relative error mean %.2e max %.2e\n", i + 1u, configs.size(),
+			config.scene == Scene::Sun ? "sun" : "sky", config.cubeInput ? "cube" : "panorama", config.resolution, config.sampleCount,
+			g_distributions[config.distribution].name, g_formats[config.format].name, config.mipCount, g_intermediateFormats[config.intermediateFormat].name,
+			best.wallMs, best.texelSamples / (filterMs * 1000.0), best.meanRelativeError, best.maxRelativeError);
+	}
+
+	destroyContext(context);
+
+	if (res != Result::Success)
+	{
+		return -1;
+	}
+
+	if (pathCsv != nullptr)
+	{
+		FILE* file = fopen(pathCsv, "w");
+		if (file == nullptr)
+		{
+			printf("Could not open %s\n", pathCsv);
+			return -1;
+		}
+
+		fprintf(file, "backend,scene,layout,resolution,sampleCount,distribution,targetFormat,mipLevelCount,intermediateFormat,wallMs,filterGpuMs,texelSamples,texelSamplesPerSecond,meanRelativeError,maxRelativeError\n");
+		for (size_t i = 0; i < configs.size(); ++i)
+		{
+			const Config& config = configs[i];
+			const Measurement& measurement = measurements[i];
+			const double filterMs = measurement.filterGpuMs > 0.0 ? measurement.filterGpuMs : measurement.wallMs;
+
+			fprintf(file, "%s,%s,%s,%u,%u,%s,%s,%u,%s,%.4f,%.4f,%.0f,%.0f,%.4e,%.4e\n", backendString,
+				config.scene == Scene::Sun ? "sun" : "sky", config.cubeInput ? "cube" : "panorama", config.resolution, config.sampleCount,
+				g_distributions[config.distribution].name, g_formats[config.format].name, config.mipCount, g_intermediateFormats[config.intermediateFormat].name,
+				measurement.wallMs, measurement.filterGpuMs, measurement.texelSamples, measurement.texelSamples / (filterMs * 0.001),
+				measurement.meanRelativeError, measurement.maxRelativeError);
+		}
+
+		fclose(file);
+		printf("Results written to %s\n", pathCsv);
+	}
+
+	if (pathJson != nullptr)
+	{
+		FILE* file = fopen(pathJson, "w");
+		if (file == nullptr)
+		{
+			printf("Could not open %s\n", pathJson);
+			return -1;
+		}
+
+		fprintf(file, "{\n\t\"backend\": \"%s\",\n\t\"results\": [\n", backendString);
+		for (size_t i = 0; i < configs.size(); ++i)
+		{
+			const Config& config = configs[i];
+			const Measurement& measurement = measurements[i];
+			const double filterMs = measurement.filterGpuMs > 0.0 ? measurement.filterGpuMs : measurement.wallMs;
+
+			fprintf(file, "\t\t{ \"scene\": \"%s\", \"layout\": \"%s\", \"resolution\": %u, \"sampleCount\": %u, \"distribution\": \"%s\", \"targetFormat\": \"%s\", \"mipLevelCount\": %u, \"intermediateFormat\": \"%s\",\n",
+				config.scene == Scene::Sun ? "sun" : "sky", config.cubeInput ? "cube" : "panorama", config.resolution, config.sampleCount,
+				g_distributions[config.distribution].name, g_formats[config.format].name, config.mipCount, g_intermediateFormats[config.intermediateFormat].name);
+			fprintf(file, "\t\t\t\"wallMs\": %.4f, \"filterGpuMs\": %.4f, \"texelSamples\": %.0f, \"texelSamplesPerSecond\": %.0f, \"meanRelativeError\": %.4e, \"maxRelativeError\": %.4e,\n",
+				measurement.wallMs, measurement.filterGpuMs, measurement.texelSamples, measurement.texelSamples / (filterMs * 0.001),
+				measurement.meanRelativeError, measurement.maxRelativeError);
+
+			fprintf(file, "\t\t\t\"stages\": [");
+			for (size_t s = 0; s < measurement.stages.size(); ++s)
+			{
+				const StageTime& stage = measurement.stages[s];
+				fprintf(file, "%s{ \"name\": \"%s\", \"gpuMs\": %.4f, \"hostMs\": %.4f }", s > 0u ? ", " : "", stage.name.c_str(), stage.gpuMs, stage.hostMs);
+			}
+			fprintf(file, "] }%s\n", i + 1u < configs.size() ? "," : "");
+		}
+		fprintf(file, "\t]\n}\n");
+
+		fclose(file);
+		printf("Results written to %s\n", pathJson);
+	}
+
+	return 0;
+}
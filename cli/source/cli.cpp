@@ -2,10 +2,54 @@
 #include <cstring>
 #include <stdio.h>
 #include <stdlib.h> 
+#include <vector>
 #include <volk.h>
 
 using namespace IBLLib;
 
+// Writes the stages of the last job as JSON, the stage names contain no characters that need escaping
+bool writeProfile(Context* _context, const char* _path)
+{
+	const ProfileStage* stages = nullptr;
+	unsigned int stageCount = 0u;
+	if (getProfile(_context, stages, stageCount) != Result::Success)
+	{
+		return false;
+	}
+
+	FILE* file = fopen(_path, "w");
+	if (file == nullptr)
+	{
+		printf("Could not open %s\n", _path);
+		return false;
+	}
+
+	double gpuMs = 0.0, hostMs = 0.0;
+	unsigned long long fragmentInvocations = 0u, computeInvocations = 0u;
+
+	fprintf(file, "{\n\t\"stages\": [\n");
+	for (unsigned int i = 0; i < stageCount; ++i)
+	{
+		const ProfileStage& stage = stages[i];
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"output\": %d, \"gpuMs\": %.4f, \"hostMs\": %.4f, \"fragmentInvocations\": %llu, \"computeInvocations\": %llu }%s\n",
+			stage.name, stage.output, stage.gpuMs, stage.hostMs, stage.fragmentInvocations, stage.computeInvocations, i + 1u < stageCount ? "," : "");
+
+		gpuMs += stage.gpuMs;
+		hostMs += stage.hostMs;
+		fragmentInvocations += stage.fragmentInvocations;
+		computeInvocations += stage.computeInvocations;
+	}
+	fprintf(file, "\t],\n");
+	fprintf(file, "\t\"total\": { \"gpuMs\": %.4f, \"hostMs\": %.4f, \"fragmentInvocations\": %llu, \"computeInvocations\": %llu }\n}\n",
+		gpuMs, hostMs, fragmentInvocations, computeInvocations);
+
+	fclose(file);
+
+	printf("Profile written to %s (GPU %.2f ms, host %.2f ms)\n", _path, gpuMs, hostMs);
+
+	return true;
+}
+
 int main(int argc, char* argv[])
 {
 	const char* pathIn = nullptr;
@@ -18,9 +62,19 @@ int main(int argc, char* argv[])
 	Distribution distribution = Distribution::GGX;
 	float lodBias = 0.0f;
 	bool enableDebugOutput = false;
+	Backend backend = Backend::Vulkan;
+	SubmitOptions submitOptions{};
+	IntermediateFormat intermediateFormat = IntermediateFormat::R32G32B32A32_SFLOAT;
+	const char* pathProfile = nullptr;
+	const char* pathTrace = nullptr;
 
 	const char* targetFormatString = "R16G16B16A16_SFLOAT";
 	const char* distributionString = "None";
+	const char* backendString = "Vulkan";
+	const char* intermediateFormatString = "R32G32B32A32_SFLOAT";
+
+	std::vector<OutputDesc> outputs;
+	std::vector<const char*> distributionStrings, targetFormatStrings;
 
 	if (argc == 1 ||
 		strcmp(argv[1], "-h") == 0 ||
@@ -31,12 +85,20 @@ int main(int argc, char* argv[])
 		printf("-inputPath: path to panorama image (default) or cube map (if inputIsCubeMap flag ist set) \n");
 		printf("-outCubeMap: output path for filtered cube map\n");
 		printf("-outLUT output path for BRDF LUT\n");
-		printf("-distribution NDF to sample (None, Lambertian, GGX, Charlie)\n");
+		printf("-distribution NDF to sample (None, Lambertian, LambertianSH, GGX, Charlie)\n");
 		printf("-sampleCount: number of samples used for filtering (default = 1024)\n");
 		printf("-mipLevelCount: number of mip levels of specular cube map. If omitted, an optimal mipmap level is chosen, based on the input panorama's resolution.\n");
 		printf("-cubeMapResolution: resolution of output cube map.  If omitted, an optimal resolution is chosen, based on the input panorama's resolution.\n");
-		printf("-targetFormat: specify output texture format (R8G8B8A8_UNORM, R16G16B16A16_SFLOAT, R32G32B32A32_SFLOAT)  \n");
+		printf("-targetFormat: specify output texture format (R8G8B8A8_UNORM, R16G16B16A16_SFLOAT, R32G32B32A32_SFLOAT, B9G9R9E5_UFLOAT)  \n");
 		printf("-lodBias: level of detail bias applied to filtering (default = 0) \n");
+		printf("-backend: filter implementation (Vulkan, VulkanCompute, CPU). VulkanCompute filters with a compute shader, CPU runs on all hardware threads and needs no Vulkan device (default = Vulkan) \n");
+		printf("-intermediateFormat: precision of the cube map and mip levels the outputs are filtered from (R32G32B32A32_SFLOAT, R16G16B16A16_SFLOAT, B10G11R11_UFLOAT), Vulkan backends only (default = R32G32B32A32_SFLOAT) \n");
+		printf("-tileSize: side length of the screen tiles a mip level is filtered in (default = 0, whole mip levels) \n");
+		printf("-sampleSlices: number of passes the samples of a texel are split into and accumulated over (default = 1) \n");
+		printf("-submitBudget: time budget per GPU submission in milliseconds, passes are batched to match it (default = 0, one submission per output) \n");
+		printf("-profile: write the GPU and host time of every stage to this JSON file (Vulkan backends only) \n");
+		printf("-trace: write the host work (decoding, copies, waiting for the GPU, conversion, file writing) to this Chrome trace-event JSON file \n");
+		printf("-next: start another output of the same input. Following output options apply to it, unset ones are taken from the previous output \n");
 
 
 		return 0;
@@ -85,6 +147,10 @@ int main(int argc, char* argv[])
 			{
 				targetFormat = OutputFormat::R32G32B32A32_SFLOAT;
 			}
+			else if (strcmp(targetFormatString, "B9G9R9E5_UFLOAT") == 0)
+			{
+				targetFormat = OutputFormat::B9G9R9E5_UFLOAT;
+			}
 		}
 		else if (strcmp(argv[i], "-distribution") == 0)
 		{
@@ -98,6 +164,10 @@ int main(int argc, char* argv[])
 			{
 				distribution = Distribution::Lambertian;
 			}
+			else if (strcmp(distributionString, "LambertianSH") == 0)
+			{
+				distribution = Distribution::LambertianSH;
+			}
 			else if (strcmp(distributionString, "GGX") == 0)
 			{
 				distribution = Distribution::GGX;
@@ -111,12 +181,79 @@ int main(int argc, char* argv[])
 		{
 			lodBias = atof(nextArg);
 		}
+		else if (strcmp(argv[i], "-backend") == 0)
+		{
+			backendString = nextArg;
+
+			if (strcmp(backendString, "Vulkan") == 0)
+			{
+				backend = Backend::Vulkan;
+			}
+			else if (strcmp(backendString, "CPU") == 0)
+			{
+				backend = Backend::CPU;
+			}
+			else if (strcmp(backendString, "VulkanCompute") == 0)
+			{
+				backend = Backend::VulkanCompute;
+			}
+		}
+		else if (strcmp(argv[i], "-intermediateFormat") == 0)
+		{
+			intermediateFormatString = nextArg;
+
+			if (strcmp(intermediateFormatString, "R32G32B32A32_SFLOAT") == 0)
+			{
+				intermediateFormat = IntermediateFormat::R32G32B32A32_SFLOAT;
+			}
+			else if (strcmp(intermediateFormatString, "R16G16B16A16_SFLOAT") == 0)
+			{
+				intermediateFormat = IntermediateFormat::R16G16B16A16_SFLOAT;
+			}
+			else if (strcmp(intermediateFormatString, "B10G11R11_UFLOAT") == 0)
+			{
+				intermediateFormat = IntermediateFormat::B10G11R11_UFLOAT;
+			}
+		}
+		else if (strcmp(argv[i], "-tileSize") == 0)
+		{
+			submitOptions.tileSize = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-sampleSlices") == 0)
+		{
+			submitOptions.sampleSlices = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-submitBudget") == 0)
+		{
+			submitOptions.timeBudgetMs = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-profile") == 0)
+		{
+			pathProfile = nextArg;
+		}
+		else if (strcmp(argv[i], "-trace") == 0)
+		{
+			pathTrace = nextArg;
+		}
 		else if (strcmp(argv[i], "-debug") == 0)
 		{
 			enableDebugOutput = true;
 		}
+		else if (strcmp(argv[i], "-next") == 0)
+		{
+			outputs.push_back({ distribution, cubeMapResolution, mipLevelCount, sampleCount, targetFormat, lodBias, pathOutCubeMap, pathOutLUT });
+			distributionStrings.push_back(distributionString);
+			targetFormatStrings.push_back(targetFormatString);
+
+			pathOutCubeMap = nullptr;
+			pathOutLUT = nullptr;
+		}
 	}
 
+	outputs.push_back({ distribution, cubeMapResolution, mipLevelCount, sampleCount, targetFormat, lodBias, pathOutCubeMap, pathOutLUT });
+	distributionStrings.push_back(distributionString);
+	targetFormatStrings.push_back(targetFormatString);
+
 	if (argc == 2)
 	{
 		pathIn = argv[1];
@@ -128,32 +265,98 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	if (pathOutCubeMap == nullptr)
+	// the defaults only apply to the first output
+	if (outputs[0].outputPathCubeMap == nullptr)
 	{
-		pathOutCubeMap = "outputCubeMap.ktx2";
+		outputs[0].outputPathCubeMap = "outputCubeMap.ktx2";
 	}
 
-	if (pathOutLUT == nullptr && distribution != Distribution::None)
+	if (outputs[0].outputPathLUT == nullptr && outputs[0].distribution != Distribution::None && outputs[0].distribution != Distribution::LambertianSH)
 	{
-		pathOutLUT = "outputLUT.png";
+		outputs[0].outputPathLUT = "outputLUT.png";
 	}
 
 	printf("inputPath set to %s \n", pathIn);
-	printf("outCubeMap set to %s \n", pathOutCubeMap);
 
-	if (pathOutLUT != nullptr)
+	for (size_t i = 0; i < outputs.size(); ++i)
 	{
-		printf("outLUT set to %s \n", pathOutLUT);	
+		const OutputDesc& output = outputs[i];
+
+		if (outputs.size() > 1)
+		{
+			printf("output %zu:\n", i);
+		}
+
+		if (output.outputPathCubeMap == nullptr)
+		{
+			printf("outCubeMap not set. Set output path with -outCubeMap after -next.\n");
+			return -1;
+		}
+
+		printf("outCubeMap set to %s \n", output.outputPathCubeMap);
+
+		if (output.outputPathLUT != nullptr)
+		{
+			printf("outLUT set to %s \n", output.outputPathLUT);
+		}
+
+		printf("sampleCount set to %d \n", output.sampleCount);
+		printf("mipLevelCount set to %d \n", output.mipmapCount);
+		printf("targetFormat set to %s\n", targetFormatStrings[i]);
+		printf("distribution set to %s\n", distributionStrings[i]);
+		printf("lodBias set to %f \n", output.lodBias);
 	}
 
-	printf("sampleCount set to %d \n", sampleCount);
-	printf("mipLevelCount set to %d \n", mipLevelCount);
-	printf("targetFormat set to %s\n", targetFormatString);
-	printf("distribution set to %s\n", distributionString);
-	printf("lodBias set to %f \n", lodBias);
+	printf("backend set to %s\n", backendString);
+	printf("intermediateFormat set to %s\n", intermediateFormatString);
+	printf("tileSize set to %u \n", submitOptions.tileSize);
+	printf("sampleSlices set to %u \n", submitOptions.sampleSlices);
+	printf("submitBudget set to %u ms\n", submitOptions.timeBudgetMs);
+	if (pathProfile != nullptr)
+	{
+		printf("profile set to %s\n", pathProfile);
+	}
+	if (pathTrace != nullptr)
+	{
+		printf("trace set to %s\n", pathTrace);
+	}
 	printf("debug flag is set to %s\n", enableDebugOutput ? "True" : "False");
 
-	Result res = sample(pathIn, pathOutCubeMap, pathOutLUT, distribution, cubeMapResolution, mipLevelCount, sampleCount, targetFormat, lodBias, enableDebugOutput);
+	if (pathTrace != nullptr)
+	{
+		startTrace(pathTrace);
+	}
+
+	Context* context = nullptr;
+	Result res = createContext(context, enableDebugOutput, backend);
+
+	if (res == Result::Success)
+	{
+		setSubmitOptions(context, submitOptions);
+		res = setIntermediateFormat(context, intermediateFormat);
+
+		if (res == Result::Success && pathProfile != nullptr)
+		{
+			res = setProfiling(context, true);
+		}
+
+		if (res == Result::Success)
+		{
+			res = sample(context, pathIn, outputs.data(), static_cast<unsigned int>(outputs.size()));
+		}
+
+		if (res == Result::Success && pathProfile != nullptr && writeProfile(context, pathProfile) == false)
+		{
+			res = Result::FileNotFound;
+		}
+
+		destroyContext(context);
+	}
+
+	if (pathTrace != nullptr && stopTrace() != Result::Success && res == Result::Success)
+	{
+		res = Result::FileNotFound;
+	}
 
 	if (res != Result::Success)
 	{
@@ -3,9 +3,15 @@ compile() {
     glslang -V -D"$1"=main -x -o "$3" "$2"
 }
 
+compile_compute() {
+    glslang -V -S comp -DCOMPUTE_SHADER -D"$1"=main -x -o "$3" "$2"
+}
+
 src_dir=lib/source/shaders
 dest_dir=lib/source/shaders/gen
 
 compile main $src_dir/primitive.vert $dest_dir/primitive.vert.inc || exit $?
 compile filterCubeMap $src_dir/filter.frag $dest_dir/filter_cube_map.frag.inc || exit $?
 compile panoramaToCubeMap $src_dir/filter.frag $dest_dir/panorama_to_cube_map.frag.inc || exit $?
+compile_compute filterCubeMapCompute $src_dir/filter.frag $dest_dir/filter_cube_map.comp.inc || exit $?
+compile main $src_dir/encode_b9g9r9e5.comp $dest_dir/encode_b9g9r9e5.comp.inc || exit $?
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include "ResultType.h"
 
 namespace IBLLib
@@ -16,9 +17,134 @@ namespace IBLLib
 		None = 0,
 		Lambertian = 1,
 		GGX = 2,
-		Charlie = 3
+		Charlie = 3,
+		LambertianSH = 4 // Lambertian irradiance evaluated from 9 spherical harmonics coefficients of the input instead of sampling it
 	};
 
+	enum class Backend
+	{
+		Vulkan = 0,
+		CPU = 1, // multithreaded host implementation, no Vulkan device needed
+		VulkanCompute = 2 // filters with a compute shader instead of the fullscreen render pass
+	};
+
+	enum class InputFormat
+	{
+		R16G16B16A16_SFLOAT = 97,
+		R32G32B32A32_SFLOAT = 109
+	};
+
+	// Precision of the cube map and mip pyramid the outputs are filtered from. The reduced formats halve or quarter the device memory
+	// and the texture traffic of the filter loop. Panoramas and input cube maps are uploaded as R16G16B16A16_SFLOAT for both,
+	// so an input cube map stays R16G16B16A16_SFLOAT with B10G11R11_UFLOAT.
+	enum class IntermediateFormat
+	{
+		R16G16B16A16_SFLOAT = 97,
+		R32G32B32A32_SFLOAT = 109,
+		B10G11R11_UFLOAT = 122 // no sign, 6 and 5 bit mantissas
+	};
+
+	// Decoded input image held by the caller. Pixels are RGBA, rows tightly packed.
+	// A single face is an equirectangular panorama, six square faces (+X, -X, +Y, -Y, +Z, -Z) of width x height are a cube map.
+	struct InputImage
+	{
+		const void* data;
+		InputFormat format;
+		unsigned int width;
+		unsigned int height;
+		unsigned int faceCount;
+	};
+
+	// Receives one mip level of the filtered cube map in the target format, the six faces tightly packed in +X, -X, +Y, -Y, +Z, -Z order.
+	// The data is only valid for the duration of the call.
+	typedef void (*LevelCallback)(void* _userData, unsigned int _level, unsigned int _sideLength, const void* _data, size_t _byteSize);
+
+	// Destination of the filtered data when sampling from memory. Members left null are not written.
+	struct OutputBuffers
+	{
+		// Called once per mip level, takes precedence over cubeMapData.
+		LevelCallback levelCallback;
+		void* userData;
+
+		// All mip levels laid out like the callback data, level 0 first.
+		void* cubeMapData;
+		size_t cubeMapByteSize;
+
+		// BRDF LUT, R8G8B8A8 with the cube map resolution as width and height. Not written for Distribution::None and Distribution::LambertianSH.
+		void* LUTData;
+		size_t LUTByteSize;
+	};
+
+	// One result of a job. The input, its cube map and mip levels are shared by all outputs of a job.
+	struct OutputDesc
+	{
+		Distribution distribution;
+		unsigned int cubemapResolution; // 0 derives the resolution from the input
+		unsigned int mipmapCount; // 0 derives the mip count from the resolution
+		unsigned int sampleCount;
+		OutputFormat targetFormat;
+		float lodBias;
+		const char* outputPathCubeMap; // optional
+		const char* outputPathLUT; // optional
+	};
+
+	// Owns the Vulkan device, shaders and pipelines (or the worker threads of the CPU backend).
+	// Reusing one context for several jobs avoids paying the device and pipeline setup for each of them.
+	class Context;
+
+	// Splits the filter work of the Vulkan backends into passes that are submitted in batches, so that no single submission
+	// runs into the GPU timeout of the operating system (TDR) and other applications on the GPU keep getting time slices.
+	// Tiles and sample slices are only supported by Backend::Vulkan, Backend::VulkanCompute submits one pass per mip level.
+	struct SubmitOptions
+	{
+		unsigned int tileSize; // side length of the screen tiles a mip level is filtered in, 0 filters a mip level at once
+		unsigned int sampleSlices; // number of passes the samples of a texel are split into and accumulated over, 0 or 1 takes all samples at once
+		unsigned int timeBudgetMs; // passes are batched into submissions of about this duration, 0 submits all passes of an output at once
+	};
+
+	// Duration of one stage of the last job. GPU stages are measured with timestamps, which include the host gaps
+	// between the submissions of a stage split by the time budget; host stages (decode, conversion, writing) with the wall clock.
+	struct ProfileStage
+	{
+		char name[64];
+		int output; // index of the output the stage belongs to, -1 for the input shared by all outputs
+		double gpuMs;
+		double hostMs;
+		unsigned long long fragmentInvocations; // 0 if the device does not support pipeline statistics queries
+		unsigned long long computeInvocations;
+	};
+
+	Result createContext(Context*& _outContext, bool _debugOutput, Backend _backend = Backend::Vulkan);
+	void destroyContext(Context* _context);
+
+	// Applies to the following jobs of the context. If the device is lost during a job of Backend::Vulkan, the context recreates
+	// the device and restarts the job with half the tile size (and a time budget if there was none) until the tiles get too small.
+	// The reduced options are kept for the following jobs.
+	Result setSubmitOptions(Context* _context, const SubmitOptions& _options);
+
+	// Applies to the following jobs of the context, the default is R32G32B32A32_SFLOAT. A device that can't render to, blit or linearly
+	// filter B10G11R11_UFLOAT gets R16G16B16A16_SFLOAT instead. Backend::CPU always filters in 32 bit floats.
+	Result setIntermediateFormat(Context* _context, IntermediateFormat _format);
+
+	// Records the host work of all contexts (decoding, buffer copies, waiting for the GPU, format conversion, file writing)
+	// with byte counts until stopTrace(), which writes it to _outputPath as Chrome trace-event JSON for chrome://tracing or Perfetto.
+	Result startTrace(const char* _outputPath);
+	Result stopTrace();
+
+	// Profiles the stages of the following jobs of the Vulkan backends. Profiling adds queries to the command buffers and
+	// waits for their results at the end of a job, leave it disabled when not needed.
+	Result setProfiling(Context* _context, bool _enable);
+
+	// The stages of the last successful job in order, valid until the next job of the context
+	Result getProfile(Context* _context, const ProfileStage*& _outStages, unsigned int& _outStageCount);
+
+	Result sample(Context* _context, const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int  _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias);
+
+	Result sample(Context* _context, const char* _inputPath, const OutputDesc* _outputs, unsigned int _outputCount);
+
+	Result sample(Context* _context, const InputImage& _input, const OutputBuffers& _output, Distribution _distribution, unsigned int  _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias);
+
+	// Creates a temporary context for a single job.
 	Result sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int  _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput);
 } // !IBLLib
 
@@ -38,4 +164,49 @@ IBLLib::Result IBLSample(
 	float _lodBias,
 	bool _debugOutput);
 
+IBLLib::Result IBLCreateContext(IBLLib::Context** _outContext, bool _debugOutput, IBLLib::Backend _backend);
+
+void IBLDestroyContext(IBLLib::Context* _context);
+
+IBLLib::Result IBLSetSubmitOptions(IBLLib::Context* _context, const IBLLib::SubmitOptions* _options);
+
+IBLLib::Result IBLSetIntermediateFormat(IBLLib::Context* _context, IBLLib::IntermediateFormat _format);
+
+IBLLib::Result IBLStartTrace(const char* _outputPath);
+
+IBLLib::Result IBLStopTrace();
+
+IBLLib::Result IBLSetProfiling(IBLLib::Context* _context, bool _enable);
+
+IBLLib::Result IBLGetProfile(IBLLib::Context* _context, const IBLLib::ProfileStage** _outStages, unsigned int* _outStageCount);
+
+IBLLib::Result IBLSampleWithContext(
+	IBLLib::Context* _context,
+	const char* _inputPath,
+	const char* _outputPathCubeMap,
+	const char* _outputPathLUT,
+	IBLLib::Distribution _distribution,
+	unsigned int  _cubemapResolution,
+	unsigned int _mipmapCount,
+	unsigned int _sampleCount,
+	IBLLib::OutputFormat _targetFormat,
+	float _lodBias);
+
+IBLLib::Result IBLSampleMultiple(
+	IBLLib::Context* _context,
+	const char* _inputPath,
+	const IBLLib::OutputDesc* _outputs,
+	unsigned int _outputCount);
+
+IBLLib::Result IBLSampleMemory(
+	IBLLib::Context* _context,
+	const IBLLib::InputImage* _input,
+	const IBLLib::OutputBuffers* _output,
+	IBLLib::Distribution _distribution,
+	unsigned int  _cubemapResolution,
+	unsigned int _mipmapCount,
+	unsigned int _sampleCount,
+	IBLLib::OutputFormat _targetFormat,
+	float _lodBias);
+
 }	// extern "C"
\ No newline at end of file
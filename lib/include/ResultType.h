@@ -12,6 +12,7 @@ namespace IBLLib
 		FileNotFound,
 		InvalidArgument,
 		KtxError,
-		StbError
+		StbError,
+		DeviceLost // a submission failed with VK_ERROR_DEVICE_LOST, usually because it exceeded the GPU timeout of the operating system
 	};
 } // !IBLLib
\ No newline at end of file
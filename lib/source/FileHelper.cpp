@@ -1,6 +1,16 @@
 #include "FileHelper.h"
 #include <stdio.h>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 bool IBLLib::readFile(const char* _path, std::vector<char>& _outBuffer)
 {
 	FILE* file = fopen(_path, "rb");
@@ -41,3 +51,133 @@ bool IBLLib::writeFile(const char* _path, const char* _data, size_t _bytes)
 
 	return sizeWritten > 0u;
 }
+
+IBLLib::MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool IBLLib::MappedFile::open(const char* _path)
+{
+	close();
+
+	m_file = CreateFileA(_path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size{};
+	if (GetFileSizeEx(m_file, &size) == FALSE || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	m_size = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void IBLLib::MappedFile::close()
+{
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+	}
+
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+	}
+
+	if (m_file != nullptr)
+	{
+		CloseHandle(m_file);
+	}
+
+	m_data = nullptr;
+	m_size = 0u;
+	m_mapping = nullptr;
+	m_file = nullptr;
+}
+
+size_t IBLLib::MappedFile::getMappedSize() const
+{
+	SYSTEM_INFO info{};
+	GetSystemInfo(&info);
+
+	const size_t pageSize = info.dwPageSize;
+	return (m_size + pageSize - 1u) / pageSize * pageSize;
+}
+
+#else
+
+bool IBLLib::MappedFile::open(const char* _path)
+{
+	close();
+
+	const int file = ::open(_path, O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat{};
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	// the mapping stays valid after the descriptor is closed
+	void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	// the input is read front to back once
+	madvise(data, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = static_cast<size_t>(fileStat.st_size);
+	return true;
+}
+
+void IBLLib::MappedFile::close()
+{
+	if (m_data != nullptr)
+	{
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+	}
+
+	m_data = nullptr;
+	m_size = 0u;
+}
+
+size_t IBLLib::MappedFile::getMappedSize() const
+{
+	const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	return (m_size + pageSize - 1u) / pageSize * pageSize;
+}
+
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 #include <vector>
+#include <cstddef>
+#include <cstdint>
 
 namespace IBLLib
 {
@@ -12,4 +14,33 @@ namespace IBLLib
 	{
 		return writeFile(_path, reinterpret_cast<const char*>(_outBuffer.data()), _outBuffer.size() * sizeof(T));
 	}
+
+	// Read only mapping of a whole file, unmapped by the destructor
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const char* _path);
+		void close();
+
+		// the mapping starts on a page boundary
+		const uint8_t* getData() const { return m_data; }
+		size_t getSize() const { return m_size; }
+
+		// bytes addressable from getData(), the size rounded up to whole pages
+		size_t getMappedSize() const;
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0u;
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
 } // !IBLLIb
\ No newline at end of file
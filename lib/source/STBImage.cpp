@@ -1,4 +1,5 @@
 #include "STBImage.h"
+#include "trace.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -22,6 +23,7 @@ IBLLib::Result IBLLib::STBImage::saveHdr(const char* _path, int _width, int _hei
 
 IBLLib::Result IBLLib::STBImage::savePng(const char* _path, int _width, int _height, int _channels, const void* data)
 {	
+	TraceScope trace("STBImage::savePng", static_cast<uint64_t>(_width) * _height * _channels);
 	return stbi_write_png(_path, _width, _height, _channels, data, _width * _channels) == 0 ? StbError : Success;
 }
 
@@ -40,6 +42,8 @@ IBLLib::Result IBLLib::STBImage::loadHdr(const char* _path)
 		printf("Input will be converted to HDR \n");
 	}
 
+	TraceScope trace("STBImage::loadHdr");
+
 	// stbi_loadf
 	m_hdrData = stbi_loadf(_path, &m_width, &m_height, &m_channels, STBI_rgb_alpha);
 
@@ -54,6 +58,7 @@ IBLLib::Result IBLLib::STBImage::loadHdr(const char* _path)
 		printf("Successfully loaded %s ", _path);
 		printf("%d x %d x %d \n", m_width, m_height, m_channels);
 		m_isHdr = true;
+		trace.setBytes(getByteSize());
 		return Success;
 	}
 }
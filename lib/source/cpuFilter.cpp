@@ -0,0 +1,964 @@
+#include "cpuFilter.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IBLLIB_CPU_SSE2
+#endif
+
+using namespace IBLLib;
+
+namespace {
+
+const float PI = 3.1415926535897932384626433832795f;
+
+// rows of a face processed by one job of the thread pool
+const uint32_t TileRows = 4u;
+
+struct vec3
+{
+	float x, y, z;
+};
+
+inline vec3 operator+(const vec3& _a, const vec3& _b) { return { _a.x + _b.x, _a.y + _b.y, _a.z + _b.z }; }
+inline vec3 operator-(const vec3& _a, const vec3& _b) { return { _a.x - _b.x, _a.y - _b.y, _a.z - _b.z }; }
+inline vec3 operator*(const vec3& _a, float _s) { return { _a.x * _s, _a.y * _s, _a.z * _s }; }
+inline float dot(const vec3& _a, const vec3& _b) { return _a.x * _b.x + _a.y * _b.y + _a.z * _b.z; }
+inline vec3 cross(const vec3& _a, const vec3& _b) { return { _a.y * _b.z - _a.z * _b.y, _a.z * _b.x - _a.x * _b.z, _a.x * _b.y - _a.y * _b.x }; }
+inline vec3 normalize(const vec3& _v) { return _v * (1.f / std::sqrt(dot(_v, _v))); }
+inline float saturate(float _v) { return std::min(std::max(_v, 0.f), 1.f); }
+
+// A group of texels filtered together, LaneMask holds the result of a comparison per lane
+#if defined(__AVX__)
+struct Lanes
+{
+	static const uint32_t Count = 8u;
+	__m256 v;
+
+	static Lanes load(const float* _p) { return { _mm256_loadu_ps(_p) }; }
+	static Lanes set(float _f) { return { _mm256_set1_ps(_f) }; }
+	void store(float* _p) const { _mm256_storeu_ps(_p, v); }
+};
+inline Lanes operator+(Lanes _a, Lanes _b) { return { _mm256_add_ps(_a.v, _b.v) }; }
+inline Lanes operator-(Lanes _a, Lanes _b) { return { _mm256_sub_ps(_a.v, _b.v) }; }
+inline Lanes operator*(Lanes _a, Lanes _b) { return { _mm256_mul_ps(_a.v, _b.v) }; }
+inline Lanes operator/(Lanes _a, Lanes _b) { return { _mm256_div_ps(_a.v, _b.v) }; }
+inline Lanes sqrt(Lanes _a) { return { _mm256_sqrt_ps(_a.v) }; }
+inline Lanes operator-(Lanes _a) { return { _mm256_xor_ps(_a.v, _mm256_set1_ps(-0.f)) }; }
+inline Lanes abs(Lanes _a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.f), _a.v) }; }
+inline Lanes floor(Lanes _a) { return { _mm256_floor_ps(_a.v) }; }
+
+struct LaneMask
+{
+	__m256 v;
+};
+inline LaneMask operator>=(Lanes _a, Lanes _b) { return { _mm256_cmp_ps(_a.v, _b.v, _CMP_GE_OQ) }; }
+inline LaneMask operator&(LaneMask _a, LaneMask _b) { return { _mm256_and_ps(_a.v, _b.v) }; }
+inline Lanes select(LaneMask _mask, Lanes _a, Lanes _b) { return { _mm256_blendv_ps(_b.v, _a.v, _mask.v) }; }
+#elif defined(IBLLIB_CPU_SSE2)
+struct Lanes
+{
+	static const uint32_t Count = 4u;
+	__m128 v;
+
+	static Lanes load(const float* _p) { return { _mm_loadu_ps(_p) }; }
+	static Lanes set(float _f) { return { _mm_set1_ps(_f) }; }
+	void store(float* _p) const { _mm_storeu_ps(_p, v); }
+};
+inline Lanes operator+(Lanes _a, Lanes _b) { return { _mm_add_ps(_a.v, _b.v) }; }
+inline Lanes operator-(Lanes _a, Lanes _b) { return { _mm_sub_ps(_a.v, _b.v) }; }
+inline Lanes operator*(Lanes _a, Lanes _b) { return { _mm_mul_ps(_a.v, _b.v) }; }
+inline Lanes operator/(Lanes _a, Lanes _b) { return { _mm_div_ps(_a.v, _b.v) }; }
+inline Lanes sqrt(Lanes _a) { return { _mm_sqrt_ps(_a.v) }; }
+inline Lanes operator-(Lanes _a) { return { _mm_xor_ps(_a.v, _mm_set1_ps(-0.f)) }; }
+inline Lanes abs(Lanes _a) { return { _mm_andnot_ps(_mm_set1_ps(-0.f), _a.v) }; }
+// SSE2 has no floor, the truncation is one too large for negative fractions
+inline Lanes floor(Lanes _a)
+{
+	const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(_a.v));
+	return { _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, _a.v), _mm_set1_ps(1.f))) };
+}
+
+struct LaneMask
+{
+	__m128 v;
+};
+inline LaneMask operator>=(Lanes _a, Lanes _b) { return { _mm_cmpge_ps(_a.v, _b.v) }; }
+inline LaneMask operator&(LaneMask _a, LaneMask _b) { return { _mm_and_ps(_a.v, _b.v) }; }
+inline Lanes select(LaneMask _mask, Lanes _a, Lanes _b) { return { _mm_or_ps(_mm_and_ps(_mask.v, _a.v), _mm_andnot_ps(_mask.v, _b.v)) }; }
+#else
+struct Lanes
+{
+	static const uint32_t Count = 1u;
+	float v;
+
+	static Lanes load(const float* _p) { return { *_p }; }
+	static Lanes set(float _f) { return { _f }; }
+	void store(float* _p) const { *_p = v; }
+};
+inline Lanes operator+(Lanes _a, Lanes _b) { return { _a.v + _b.v }; }
+inline Lanes operator-(Lanes _a, Lanes _b) { return { _a.v - _b.v }; }
+inline Lanes operator*(Lanes _a, Lanes _b) { return { _a.v * _b.v }; }
+inline Lanes operator/(Lanes _a, Lanes _b) { return { _a.v / _b.v }; }
+inline Lanes sqrt(Lanes _a) { return { std::sqrt(_a.v) }; }
+inline Lanes operator-(Lanes _a) { return { -_a.v }; }
+inline Lanes abs(Lanes _a) { return { std::fabs(_a.v) }; }
+inline Lanes floor(Lanes _a) { return { std::floor(_a.v) }; }
+
+struct LaneMask
+{
+	bool v;
+};
+inline LaneMask operator>=(Lanes _a, Lanes _b) { return { _a.v >= _b.v }; }
+inline LaneMask operator&(LaneMask _a, LaneMask _b) { return { _a.v && _b.v }; }
+inline Lanes select(LaneMask _mask, Lanes _a, Lanes _b) { return _mask.v ? _a : _b; }
+#endif
+
+vec3 uvToXYZ(uint32_t _face, float _u, float _v)
+{
+	switch (_face)
+	{
+	case 0: return { 1.f, _v, -_u };
+	case 1: return { -1.f, _v, _u };
+	case 2: return { _u, -1.f, _v };
+	case 3: return { _u, 1.f, -_v };
+	case 4: return { _u, _v, 1.f };
+	default: return { -_u, _v, -1.f };
+	}
+}
+
+// VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT
+inline int32_t mirrorRepeat(int32_t _i, int32_t _size)
+{
+	int32_t t = _i % (2 * _size);
+	if (t < 0)
+	{
+		t += 2 * _size;
+	}
+	return t < _size ? t : 2 * _size - 1 - t;
+}
+
+void samplePanorama(const float* _panorama, uint32_t _width, uint32_t _height, float _u, float _v, float* _outColor)
+{
+	const float x = _u * _width - 0.5f;
+	const float y = _v * _height - 0.5f;
+	const float fx = std::floor(x);
+	const float fy = std::floor(y);
+	const float a = x - fx;
+	const float b = y - fy;
+
+	const int32_t w = static_cast<int32_t>(_width);
+	const int32_t h = static_cast<int32_t>(_height);
+	const int32_t x0 = mirrorRepeat(static_cast<int32_t>(fx), w);
+	const int32_t x1 = mirrorRepeat(static_cast<int32_t>(fx) + 1, w);
+	const int32_t y0 = mirrorRepeat(static_cast<int32_t>(fy), h);
+	const int32_t y1 = mirrorRepeat(static_cast<int32_t>(fy) + 1, h);
+
+	const float* p00 = _panorama + (static_cast<size_t>(y0) * _width + x0) * 4u;
+	const float* p10 = _panorama + (static_cast<size_t>(y0) * _width + x1) * 4u;
+	const float* p01 = _panorama + (static_cast<size_t>(y1) * _width + x0) * 4u;
+	const float* p11 = _panorama + (static_cast<size_t>(y1) * _width + x1) * 4u;
+
+	for (uint32_t c = 0; c < 3u; ++c)
+	{
+		const float top = p00[c] + (p10[c] - p00[c]) * a;
+		const float bottom = p01[c] + (p11[c] - p01[c]) * a;
+		_outColor[c] = top + (bottom - top) * b;
+	}
+}
+
+// face selection of the Vulkan spec, _outS and _outT in [0, 1]
+void selectCubeFace(const vec3& _dir, uint32_t& _outFace, float& _outS, float& _outT)
+{
+	const float ax = std::fabs(_dir.x);
+	const float ay = std::fabs(_dir.y);
+	const float az = std::fabs(_dir.z);
+
+	float sc, tc, ma;
+	if (ax >= ay && ax >= az)
+	{
+		_outFace = _dir.x >= 0.f ? 0u : 1u;
+		sc = _dir.x >= 0.f ? -_dir.z : _dir.z;
+		tc = -_dir.y;
+		ma = ax;
+	}
+	else if (ay >= az)
+	{
+		_outFace = _dir.y >= 0.f ? 2u : 3u;
+		sc = _dir.x;
+		tc = _dir.y >= 0.f ? _dir.z : -_dir.z;
+		ma = ay;
+	}
+	else
+	{
+		_outFace = _dir.z >= 0.f ? 4u : 5u;
+		sc = _dir.z >= 0.f ? _dir.x : -_dir.x;
+		tc = -_dir.y;
+		ma = az;
+	}
+
+	_outS = 0.5f * (sc / ma + 1.f);
+	_outT = 0.5f * (tc / ma + 1.f);
+}
+
+// inverse of selectCubeFace for _sc, _tc in [-1, 1]
+vec3 cubeFaceToDirection(uint32_t _face, float _sc, float _tc)
+{
+	switch (_face)
+	{
+	case 0: return { 1.f, -_tc, -_sc };
+	case 1: return { -1.f, -_tc, _sc };
+	case 2: return { _sc, 1.f, _tc };
+	case 3: return { _sc, -1.f, -_tc };
+	case 4: return { _sc, -_tc, 1.f };
+	default: return { -_sc, -_tc, -1.f };
+	}
+}
+
+// texels past the edge of a face are taken from the adjacent face like seamless cube map filtering does
+const float* fetchCubeTexel(const float* _level, uint32_t _side, uint32_t _face, int32_t _x, int32_t _y)
+{
+	const int32_t side = static_cast<int32_t>(_side);
+
+	if (_x < 0 || _x >= side || _y < 0 || _y >= side)
+	{
+		const float sc = 2.f * (static_cast<float>(_x) + 0.5f) / _side - 1.f;
+		const float tc = 2.f * (static_cast<float>(_y) + 0.5f) / _side - 1.f;
+
+		float s, t;
+		selectCubeFace(cubeFaceToDirection(_face, sc, tc), _face, s, t);
+
+		_x = std::min(std::max(static_cast<int32_t>(s * _side), 0), side - 1);
+		_y = std::min(std::max(static_cast<int32_t>(t * _side), 0), side - 1);
+	}
+
+	return _level + ((static_cast<size_t>(_face) * _side + _y) * _side + _x) * 4u;
+}
+
+// face selection of selectCubeFace for the directions of all lanes
+void selectCubeFace(Lanes _x, Lanes _y, Lanes _z, Lanes& _outFace, Lanes& _outS, Lanes& _outT)
+{
+	const Lanes zero = Lanes::set(0.f);
+	const Lanes ax = abs(_x);
+	const Lanes ay = abs(_y);
+	const Lanes az = abs(_z);
+
+	// x wins ties over y and z, y over z
+	const LaneMask xMajor = (ax >= ay) & (ax >= az);
+	const LaneMask yMajor = ay >= az;
+
+	const LaneMask xPositive = _x >= zero;
+	const LaneMask yPositive = _y >= zero;
+	const LaneMask zPositive = _z >= zero;
+
+	const Lanes zFace = select(zPositive, Lanes::set(4.f), Lanes::set(5.f));
+	const Lanes yFace = select(yPositive, Lanes::set(2.f), Lanes::set(3.f));
+	const Lanes xFace = select(xPositive, Lanes::set(0.f), Lanes::set(1.f));
+
+	const Lanes sc = select(xMajor, select(xPositive, -_z, _z), select(yMajor, _x, select(zPositive, _x, -_x)));
+	const Lanes tc = select(xMajor, -_y, select(yMajor, select(yPositive, _z, -_z), -_y));
+	const Lanes ma = select(xMajor, ax, select(yMajor, ay, az));
+
+	_outFace = select(xMajor, xFace, select(yMajor, yFace, zFace));
+	_outS = Lanes::set(0.5f) * (sc / ma + Lanes::set(1.f));
+	_outT = Lanes::set(0.5f) * (tc / ma + Lanes::set(1.f));
+}
+
+// bilinear lookups in one level of a cube map, the four taps of each lane are gathered one lane after another
+void sampleCubeLevel(const float* _level, uint32_t _side, const uint32_t (&_faces)[Lanes::Count], Lanes _s, Lanes _t, Lanes _weight, Lanes (&_inOutColor)[3])
+{
+	const Lanes side = Lanes::set(static_cast<float>(_side));
+	const Lanes x = _s * side - Lanes::set(0.5f);
+	const Lanes y = _t * side - Lanes::set(0.5f);
+	const Lanes fx = floor(x);
+	const Lanes fy = floor(y);
+	const Lanes a = x - fx;
+	const Lanes b = y - fy;
+
+	float x0[Lanes::Count];
+	float y0[Lanes::Count];
+	fx.store(x0);
+	fy.store(y0);
+
+	// texels[tap][channel][lane], the taps in the order p00, p10, p01, p11
+	float texels[4][3][Lanes::Count];
+
+	for (uint32_t lane = 0; lane < Lanes::Count; ++lane)
+	{
+		const int32_t ix = static_cast<int32_t>(x0[lane]);
+		const int32_t iy = static_cast<int32_t>(y0[lane]);
+
+		const float* taps[4] = {
+			fetchCubeTexel(_level, _side, _faces[lane], ix, iy),
+			fetchCubeTexel(_level, _side, _faces[lane], ix + 1, iy),
+			fetchCubeTexel(_level, _side, _faces[lane], ix, iy + 1),
+			fetchCubeTexel(_level, _side, _faces[lane], ix + 1, iy + 1)
+		};
+
+		for (uint32_t tap = 0; tap < 4u; ++tap)
+		{
+			texels[tap][0][lane] = taps[tap][0];
+			texels[tap][1][lane] = taps[tap][1];
+			texels[tap][2][lane] = taps[tap][2];
+		}
+	}
+
+	for (uint32_t c = 0; c < 3u; ++c)
+	{
+		const Lanes p00 = Lanes::load(texels[0][c]);
+		const Lanes p10 = Lanes::load(texels[1][c]);
+		const Lanes p01 = Lanes::load(texels[2][c]);
+		const Lanes p11 = Lanes::load(texels[3][c]);
+
+		const Lanes top = p00 + (p10 - p00) * a;
+		const Lanes bottom = p01 + (p11 - p01) * a;
+		_inOutColor[c] = _inOutColor[c] + (top + (bottom - top) * b) * _weight;
+	}
+}
+
+// textureLod on a samplerCube with trilinear filtering for the directions of all lanes, the lod is the same for every lane
+void sampleCube(const CpuCubeMap& _cubeMap, uint32_t _mipLevels, Lanes _x, Lanes _y, Lanes _z, float _lod, Lanes (&_outColor)[3])
+{
+	Lanes face, s, t;
+	selectCubeFace(_x, _y, _z, face, s, t);
+
+	float faceLanes[Lanes::Count];
+	face.store(faceLanes);
+
+	uint32_t faces[Lanes::Count];
+	for (uint32_t lane = 0; lane < Lanes::Count; ++lane)
+	{
+		faces[lane] = static_cast<uint32_t>(faceLanes[lane]);
+	}
+
+	// fmax/fmin also map NaN to the valid range
+	const float maxLevel = static_cast<float>(_mipLevels - 1u);
+	const float lod = std::fmin(std::fmax(_lod, 0.f), maxLevel);
+	const uint32_t level = static_cast<uint32_t>(lod);
+	const float fraction = lod - static_cast<float>(level);
+
+	_outColor[0] = _outColor[1] = _outColor[2] = Lanes::set(0.f);
+
+	const uint32_t side = std::max(_cubeMap.sideLength >> level, 1u);
+	sampleCubeLevel(_cubeMap.levels[level].data(), side, faces, s, t, Lanes::set(1.f - fraction), _outColor);
+
+	if (fraction > 0.f && level + 1u < _mipLevels)
+	{
+		sampleCubeLevel(_cubeMap.levels[level + 1u].data(), std::max(side >> 1, 1u), faces, s, t, Lanes::set(fraction), _outColor);
+	}
+}
+
+// Hammersley Points on the Hemisphere
+// CC BY 3.0 (Holger Dammertz)
+// http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
+float radicalInverse_VdC(uint32_t _bits)
+{
+	_bits = (_bits << 16u) | (_bits >> 16u);
+	_bits = ((_bits & 0x55555555u) << 1u) | ((_bits & 0xAAAAAAAAu) >> 1u);
+	_bits = ((_bits & 0x33333333u) << 2u) | ((_bits & 0xCCCCCCCCu) >> 2u);
+	_bits = ((_bits & 0x0F0F0F0Fu) << 4u) | ((_bits & 0xF0F0F0F0u) >> 4u);
+	_bits = ((_bits & 0x00FF00FFu) << 8u) | ((_bits & 0xFF00FF00u) >> 8u);
+	return static_cast<float>(_bits) * 2.3283064365386963e-10f; // / 0x100000000
+}
+
+float D_GGX(float _NdotH, float _roughness)
+{
+	const float a = _NdotH * _roughness;
+	const float k = _roughness / (1.f - _NdotH * _NdotH + a * a);
+	return k * k * (1.f / PI);
+}
+
+float D_Charlie(float _sheenRoughness, float _NdotH)
+{
+	_sheenRoughness = std::max(_sheenRoughness, 0.000001f); //clamp (0,1]
+	const float invR = 1.f / _sheenRoughness;
+	const float cos2h = _NdotH * _NdotH;
+	const float sin2h = 1.f - cos2h;
+	return (2.f + invR) * std::pow(sin2h, invR * 0.5f) / (2.f * PI);
+}
+
+float V_SmithGGXCorrelated(float _NoV, float _NoL, float _roughness)
+{
+	const float a2 = std::pow(_roughness, 4.f);
+	const float GGXV = _NoL * std::sqrt(_NoV * _NoV * (1.f - a2) + a2);
+	const float GGXL = _NoV * std::sqrt(_NoL * _NoL * (1.f - a2) + a2);
+	return 0.5f / (GGXV + GGXL);
+}
+
+float V_Ashikhmin(float _NdotL, float _NdotV)
+{
+	return saturate(1.f / (4.f * (_NdotL + _NdotV - _NdotL * _NdotV)));
+}
+
+// Importance sample in tangent space, the same for every texel of a mip level
+struct ImportanceSample
+{
+	vec3 direction;
+	float pdf;
+};
+
+ImportanceSample getImportanceSample(uint32_t _sampleIndex, uint32_t _sampleCount, Distribution _distribution, float _roughness)
+{
+	const float xi0 = static_cast<float>(_sampleIndex) / static_cast<float>(_sampleCount);
+	const float xi1 = radicalInverse_VdC(_sampleIndex);
+
+	float cosTheta = 1.f;
+	float sinTheta = 0.f;
+	float pdf = 0.f;
+	const float phi = 2.f * PI * xi0;
+
+	if (_distribution == Distribution::Lambertian)
+	{
+		// Cosine weighted hemisphere sampling
+		cosTheta = std::sqrt(1.f - xi1);
+		sinTheta = std::sqrt(xi1);
+		pdf = cosTheta / PI;
+	}
+	else if (_distribution == Distribution::GGX)
+	{
+		const float alpha = _roughness * _roughness;
+		cosTheta = saturate(std::sqrt((1.f - xi1) / (1.f + (alpha * alpha - 1.f) * xi1)));
+		sinTheta = std::sqrt(1.f - cosTheta * cosTheta);
+		pdf = D_GGX(cosTheta, alpha) / 4.f;
+	}
+	else if (_distribution == Distribution::Charlie)
+	{
+		const float alpha = _roughness * _roughness;
+		sinTheta = std::pow(xi1, alpha / (2.f * alpha + 1.f));
+		cosTheta = std::sqrt(1.f - sinTheta * sinTheta);
+		pdf = D_Charlie(alpha, cosTheta) / 4.f;
+	}
+
+	ImportanceSample importanceSample;
+	importanceSample.direction = normalize({ sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta });
+	importanceSample.pdf = pdf;
+	return importanceSample;
+}
+
+// Mipmap Filtered Samples (GPU Gems 3, 20.4), Krivanek & Colbert adapted to cube maps
+float computeLod(float _pdf, uint32_t _width, uint32_t _sampleCount)
+{
+	return 0.5f * std::log2(6.f * static_cast<float>(_width) * static_cast<float>(_width) / (static_cast<float>(_sampleCount) * _pdf));
+}
+
+// tangent, bitangent and normal, the normal must be normalized
+void generateTBN(const vec3& _normal, vec3& _outTangent, vec3& _outBitangent)
+{
+	vec3 bitangent = { 0.f, 1.f, 0.f };
+
+	const float NdotUp = _normal.y;
+	const float epsilon = 0.0000001f;
+	if (1.f - std::fabs(NdotUp) <= epsilon)
+	{
+		// Sampling +Y or -Y, so we need a more robust bitangent.
+		bitangent = NdotUp > 0.f ? vec3{ 0.f, 0.f, 1.f } : vec3{ 0.f, 0.f, -1.f };
+	}
+
+	_outTangent = normalize(cross(bitangent, _normal));
+	_outBitangent = cross(_normal, _outTangent);
+}
+
+// filters Lanes::Count texels of one row, _normals holds x, y and z of each lane in separate arrays
+void filterTexels(const CpuCubeMap& _input, uint32_t _inputMipLevels, Distribution _distribution, uint32_t _sampleCount,
+	const std::vector<SampleTableEntry>& _samples, const float (&_normals)[3][Lanes::Count], uint32_t _validLanes, float* _outColors)
+{
+	float tangents[3][Lanes::Count];
+	float bitangents[3][Lanes::Count];
+
+	for (uint32_t lane = 0; lane < Lanes::Count; ++lane)
+	{
+		vec3 T, B;
+		generateTBN({ _normals[0][lane], _normals[1][lane], _normals[2][lane] }, T, B);
+		tangents[0][lane] = T.x; tangents[1][lane] = T.y; tangents[2][lane] = T.z;
+		bitangents[0][lane] = B.x; bitangents[1][lane] = B.y; bitangents[2][lane] = B.z;
+	}
+
+	const Lanes Tx = Lanes::load(tangents[0]), Ty = Lanes::load(tangents[1]), Tz = Lanes::load(tangents[2]);
+	const Lanes Bx = Lanes::load(bitangents[0]), By = Lanes::load(bitangents[1]), Bz = Lanes::load(bitangents[2]);
+	const Lanes Nx = Lanes::load(_normals[0]), Ny = Lanes::load(_normals[1]), Nz = Lanes::load(_normals[2]);
+
+	Lanes color[3] = { Lanes::set(0.f), Lanes::set(0.f), Lanes::set(0.f) };
+	Lanes weight = Lanes::set(0.f);
+
+	const bool lambertian = _distribution == Distribution::Lambertian;
+
+	for (const SampleTableEntry& tableSample : _samples)
+	{
+		// rotate the tangent space sample to the normal directions
+		const Lanes lx = Lanes::set(tableSample.direction[0]);
+		const Lanes ly = Lanes::set(tableSample.direction[1]);
+		const Lanes lz = Lanes::set(tableSample.direction[2]);
+
+		Lanes sampleColor[3];
+		sampleCube(_input, _inputMipLevels, Tx * lx + Bx * ly + Nx * lz, Ty * lx + By * ly + Ny * lz, Tz * lx + Bz * ly + Nz * lz, tableSample.lod, sampleColor);
+
+		if (lambertian)
+		{
+			color[0] = color[0] + sampleColor[0];
+			color[1] = color[1] + sampleColor[1];
+			color[2] = color[2] + sampleColor[2];
+		}
+		else
+		{
+			// NdotL does not depend on the texel
+			const Lanes NdotL = Lanes::set(tableSample.direction[2]);
+
+			color[0] = color[0] + sampleColor[0] * NdotL;
+			color[1] = color[1] + sampleColor[1] * NdotL;
+			color[2] = color[2] + sampleColor[2] * NdotL;
+			weight = weight + NdotL;
+		}
+	}
+
+	float colors[3][Lanes::Count];
+	float weights[Lanes::Count];
+	color[0].store(colors[0]);
+	color[1].store(colors[1]);
+	color[2].store(colors[2]);
+	weight.store(weights);
+
+	for (uint32_t lane = 0; lane < _validLanes; ++lane)
+	{
+		const float normalization = weights[lane] != 0.f ? weights[lane] : static_cast<float>(_sampleCount);
+		_outColors[lane * 4u + 0u] = colors[0][lane] / normalization;
+		_outColors[lane * 4u + 1u] = colors[1][lane] / normalization;
+		_outColors[lane * 4u + 2u] = colors[2][lane] / normalization;
+		_outColors[lane * 4u + 3u] = 1.f;
+	}
+}
+
+// Compute LUT for GGX and Charlie distribution.
+// See https://blog.selfshadow.com/publications/s2013-shading-course/karis/s2013_pbs_epic_notes_v2.pdf
+vec3 LUT(Distribution _distribution, float _NdotV, float _roughness, uint32_t _sampleCount)
+{
+	// Compute spherical view vector: (sin(phi), 0, cos(phi))
+	const vec3 V = { std::sqrt(1.f - _NdotV * _NdotV), 0.f, _NdotV };
+
+	float A = 0.f;
+	float B = 0.f;
+	float C = 0.f;
+
+	for (uint32_t i = 0; i < _sampleCount; ++i)
+	{
+		// the macro surface normal points up, so tangent space is world space
+		const vec3 H = getImportanceSample(i, _sampleCount, _distribution, _roughness).direction;
+		const vec3 L = normalize(H * (2.f * dot(V, H)) - V);
+
+		const float NdotL = saturate(L.z);
+		const float NdotH = saturate(H.z);
+		const float VdotH = saturate(dot(V, H));
+		if (NdotL > 0.f)
+		{
+			if (_distribution == Distribution::GGX)
+			{
+				const float V_pdf = V_SmithGGXCorrelated(_NdotV, NdotL, _roughness) * VdotH * NdotL / NdotH;
+				const float Fc = std::pow(1.f - VdotH, 5.f);
+				A += (1.f - Fc) * V_pdf;
+				B += Fc * V_pdf;
+			}
+
+			if (_distribution == Distribution::Charlie)
+			{
+				const float sheenDistribution = D_Charlie(_roughness, NdotH);
+				const float sheenVisibility = V_Ashikhmin(NdotL, _NdotV);
+				C += sheenVisibility * sheenDistribution * NdotL * VdotH;
+			}
+		}
+	}
+
+	const float scale = 1.f / static_cast<float>(_sampleCount);
+	return { 4.f * A * scale, 4.f * B * scale, 4.f * 2.f * PI * C * scale };
+}
+
+inline uint8_t toUnorm8(float _v)
+{
+	return static_cast<uint8_t>(saturate(_v) * 255.f + 0.5f);
+}
+
+// same direction as the texel centers in filterCubeMapOnCPU
+vec3 texelDirection(uint32_t _face, uint32_t _x, uint32_t _y, uint32_t _side)
+{
+	const float sc = 2.f * (static_cast<float>(_x) + 0.5f) / static_cast<float>(_side) - 1.f;
+	const float tc = 2.f * (static_cast<float>(_y) + 0.5f) / static_cast<float>(_side) - 1.f;
+	return normalize(cubeFaceToDirection(_face, sc, tc));
+}
+
+// solid angle of the face area between the face center and (_x, _y), both in [-1, 1]
+float areaElement(float _x, float _y)
+{
+	return std::atan2(_x * _y, std::sqrt(_x * _x + _y * _y + 1.f));
+}
+
+float texelSolidAngle(uint32_t _x, uint32_t _y, uint32_t _side)
+{
+	const float invSide = 1.f / static_cast<float>(_side);
+	const float x0 = 2.f * static_cast<float>(_x) * invSide - 1.f;
+	const float y0 = 2.f * static_cast<float>(_y) * invSide - 1.f;
+	const float x1 = x0 + 2.f * invSide;
+	const float y1 = y0 + 2.f * invSide;
+	return areaElement(x0, y0) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x1, y1);
+}
+
+// real SH basis of bands 0-2
+void evaluateSH9Basis(const vec3& _dir, float (&_outBasis)[9])
+{
+	_outBasis[0] = 0.282095f;
+	_outBasis[1] = 0.488603f * _dir.y;
+	_outBasis[2] = 0.488603f * _dir.z;
+	_outBasis[3] = 0.488603f * _dir.x;
+	_outBasis[4] = 1.092548f * _dir.x * _dir.y;
+	_outBasis[5] = 1.092548f * _dir.y * _dir.z;
+	_outBasis[6] = 0.315392f * (3.f * _dir.z * _dir.z - 1.f);
+	_outBasis[7] = 1.092548f * _dir.x * _dir.z;
+	_outBasis[8] = 0.546274f * (_dir.x * _dir.x - _dir.y * _dir.y);
+}
+
+// An Efficient Representation for Irradiance Environment Maps, Ramamoorthi & Hanrahan:
+// the clamped cosine scales band l by A_l = PI, 2 PI / 3, PI / 4, divided by PI like the Lambertian filter
+const float SHCosineLobe[9] = { 1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+} // !namespace
+
+void IBLLib::panoramaToCubeMapOnCPU(ThreadPool& _pool, const float* _panorama, uint32_t _width, uint32_t _height, uint32_t _sideLength, CpuCubeMap& _outCubeMap)
+{
+	_outCubeMap.sideLength = _sideLength;
+	_outCubeMap.levels.resize(1u);
+	_outCubeMap.levels[0].resize(static_cast<size_t>(_sideLength) * _sideLength * 6u * 4u);
+
+	const uint32_t tilesPerFace = (_sideLength + TileRows - 1u) / TileRows;
+
+	_pool.parallelFor(6u * tilesPerFace, [&](uint32_t _job)
+	{
+		const uint32_t face = _job / tilesPerFace;
+		const uint32_t firstRow = (_job % tilesPerFace) * TileRows;
+		const uint32_t lastRow = std::min(firstRow + TileRows, _sideLength);
+
+		float* faceData = _outCubeMap.levels[0].data() + static_cast<size_t>(face) * _sideLength * _sideLength * 4u;
+
+		for (uint32_t y = firstRow; y < lastRow; ++y)
+		{
+			for (uint32_t x = 0; x < _sideLength; ++x)
+			{
+				const float u = (static_cast<float>(x) + 0.5f) / static_cast<float>(_sideLength);
+				const float v = (static_cast<float>(y) + 0.5f) / static_cast<float>(_sideLength);
+				const vec3 direction = normalize(uvToXYZ(face, u * 2.f - 1.f, v * 2.f - 1.f));
+
+				const float panoramaU = 0.5f + 0.5f * std::atan2(direction.z, direction.x) / PI;
+				const float panoramaV = 1.f - std::acos(direction.y) / PI;
+
+				float* texel = faceData + (static_cast<size_t>(y) * _sideLength + x) * 4u;
+				samplePanorama(_panorama, _width, _height, panoramaU, panoramaV, texel);
+				texel[3] = 1.f;
+			}
+		}
+	});
+}
+
+void IBLLib::generateMipmapLevelsOnCPU(ThreadPool& _pool, CpuCubeMap& _cubeMap, uint32_t _mipLevels)
+{
+	const uint32_t firstLevel = std::max(static_cast<uint32_t>(_cubeMap.levels.size()), 1u);
+	_cubeMap.levels.resize(_mipLevels);
+
+	for (uint32_t level = firstLevel; level < _mipLevels; ++level)
+	{
+		const uint32_t srcSide = std::max(_cubeMap.sideLength >> (level - 1u), 1u);
+		const uint32_t dstSide = std::max(_cubeMap.sideLength >> level, 1u);
+
+		const std::vector<float>& src = _cubeMap.levels[level - 1u];
+		std::vector<float>& dst = _cubeMap.levels[level];
+		dst.resize(static_cast<size_t>(dstSide) * dstSide * 6u * 4u);
+
+		const uint32_t tilesPerFace = (dstSide + TileRows - 1u) / TileRows;
+
+		_pool.parallelFor(6u * tilesPerFace, [&](uint32_t _job)
+		{
+			const uint32_t face = _job / tilesPerFace;
+			const uint32_t firstRow = (_job % tilesPerFace) * TileRows;
+			const uint32_t lastRow = std::min(firstRow + TileRows, dstSide);
+
+			const float* srcFace = src.data() + static_cast<size_t>(face) * srcSide * srcSide * 4u;
+			float* dstFace = dst.data() + static_cast<size_t>(face) * dstSide * dstSide * 4u;
+
+			for (uint32_t y = firstRow; y < lastRow; ++y)
+			{
+				const uint32_t y0 = std::min(2u * y, srcSide - 1u);
+				const uint32_t y1 = std::min(2u * y + 1u, srcSide - 1u);
+
+				for (uint32_t x = 0; x < dstSide; ++x)
+				{
+					const uint32_t x0 = std::min(2u * x, srcSide - 1u);
+					const uint32_t x1 = std::min(2u * x + 1u, srcSide - 1u);
+
+					const float* p00 = srcFace + (static_cast<size_t>(y0) * srcSide + x0) * 4u;
+					const float* p10 = srcFace + (static_cast<size_t>(y0) * srcSide + x1) * 4u;
+					const float* p01 = srcFace + (static_cast<size_t>(y1) * srcSide + x0) * 4u;
+					const float* p11 = srcFace + (static_cast<size_t>(y1) * srcSide + x1) * 4u;
+
+					float* texel = dstFace + (static_cast<size_t>(y) * dstSide + x) * 4u;
+					for (uint32_t c = 0; c < 4u; ++c)
+					{
+						texel[c] = 0.25f * ((p00[c] + p10[c]) + (p01[c] + p11[c]));
+					}
+				}
+			}
+		});
+	}
+}
+
+void IBLLib::computeSampleTable(Distribution _distribution, float _roughness, uint32_t _sampleCount, uint32_t _inputSideLength, float _lodBias,
+	std::vector<SampleTableEntry>& _outSamples)
+{
+	_outSamples.clear();
+	_outSamples.reserve(_sampleCount);
+
+	for (uint32_t i = 0; i < _sampleCount; ++i)
+	{
+		const ImportanceSample importanceSample = getImportanceSample(i, _sampleCount, _distribution, _roughness);
+
+		SampleTableEntry entry;
+		entry.lod = computeLod(importanceSample.pdf, _inputSideLength, _sampleCount) + _lodBias;
+
+		vec3 direction = importanceSample.direction;
+
+		if (_distribution != Distribution::Lambertian)
+		{
+			// V = N = +Z, L = reflect(-V, H)
+			const vec3 H = direction;
+			direction = normalize(H * (2.f * H.z) - vec3{ 0.f, 0.f, 1.f });
+
+			if (direction.z <= 0.f)
+			{
+				continue;
+			}
+
+			if (_roughness == 0.f)
+			{
+				// without this the roughness=0 lod is too high
+				entry.lod = _lodBias;
+			}
+		}
+
+		entry.direction[0] = direction.x;
+		entry.direction[1] = direction.y;
+		entry.direction[2] = direction.z;
+
+		_outSamples.push_back(entry);
+	}
+}
+
+void IBLLib::filterCubeMapOnCPU(ThreadPool& _pool, const CpuCubeMap& _input, uint32_t _inputMipLevels, Distribution _distribution,
+	uint32_t _sideLength, uint32_t _mipLevels, uint32_t _sampleCount, float _lodBias, CpuCubeMap& _outCubeMap)
+{
+	_outCubeMap.sideLength = _sideLength;
+	_outCubeMap.levels.resize(_mipLevels);
+
+	std::vector< std::vector<SampleTableEntry> > samples(_mipLevels);
+	std::vector<uint32_t> firstJob(_mipLevels + 1u, 0u);
+
+	for (uint32_t level = 0; level < _mipLevels; ++level)
+	{
+		const uint32_t side = std::max(_sideLength >> level, 1u);
+		_outCubeMap.levels[level].resize(static_cast<size_t>(side) * side * 6u * 4u);
+
+		const float roughness = _mipLevels > 1u ? static_cast<float>(level) / static_cast<float>(_mipLevels - 1u) : 0.f;
+		computeSampleTable(_distribution, roughness, _sampleCount, _input.sideLength, _lodBias, samples[level]);
+
+		firstJob[level + 1u] = firstJob[level] + 6u * ((side + TileRows - 1u) / TileRows);
+	}
+
+	// all levels and faces are independent, split them into tiles of rows
+	_pool.parallelFor(firstJob[_mipLevels], [&](uint32_t _job)
+	{
+		const uint32_t level = static_cast<uint32_t>(std::upper_bound(firstJob.begin(), firstJob.end(), _job) - firstJob.begin()) - 1u;
+		const uint32_t side = std::max(_sideLength >> level, 1u);
+		const uint32_t tilesPerFace = (side + TileRows - 1u) / TileRows;
+		const uint32_t face = (_job - firstJob[level]) / tilesPerFace;
+		const uint32_t firstRow = ((_job - firstJob[level]) % tilesPerFace) * TileRows;
+		const uint32_t lastRow = std::min(firstRow + TileRows, side);
+
+		float* faceData = _outCubeMap.levels[level].data() + static_cast<size_t>(face) * side * side * 4u;
+
+		for (uint32_t y = firstRow; y < lastRow; ++y)
+		{
+			for (uint32_t x = 0; x < side; x += Lanes::Count)
+			{
+				const uint32_t validLanes = side - x < Lanes::Count ? side - x : Lanes::Count;
+
+				float normals[3][Lanes::Count];
+				for (uint32_t lane = 0; lane < Lanes::Count; ++lane)
+				{
+					// texel centers of the current level, padding lanes repeat the last texel
+					const uint32_t px = x + std::min(lane, validLanes - 1u);
+					const float u = (static_cast<float>(px) + 0.5f) / static_cast<float>(side);
+					const float v = (static_cast<float>(y) + 0.5f) / static_cast<float>(side);
+
+					vec3 direction = normalize(uvToXYZ(face, u * 2.f - 1.f, v * 2.f - 1.f));
+					direction.y = -direction.y;
+
+					normals[0][lane] = direction.x;
+					normals[1][lane] = direction.y;
+					normals[2][lane] = direction.z;
+				}
+
+				filterTexels(_input, _inputMipLevels, _distribution, _sampleCount, samples[level], normals, validLanes,
+					faceData + (static_cast<size_t>(y) * side + x) * 4u);
+			}
+		}
+	});
+}
+
+void IBLLib::computeLUTOnCPU(ThreadPool& _pool, Distribution _distribution, uint32_t _sideLength, uint32_t _sampleCount, std::vector<uint8_t>& _outLUT)
+{
+	_outLUT.resize(static_cast<size_t>(_sideLength) * _sideLength * 4u);
+
+	_pool.parallelFor(_sideLength, [&](uint32_t _y)
+	{
+		// x-coordinate: NdotV, y-coordinate: roughness
+		const float roughness = (static_cast<float>(_y) + 0.5f) / static_cast<float>(_sideLength);
+
+		for (uint32_t x = 0; x < _sideLength; ++x)
+		{
+			const float NdotV = (static_cast<float>(x) + 0.5f) / static_cast<float>(_sideLength);
+			const vec3 value = LUT(_distribution, NdotV, roughness, _sampleCount);
+
+			uint8_t* texel = _outLUT.data() + (static_cast<size_t>(_y) * _sideLength + x) * 4u;
+			texel[0] = toUnorm8(value.x);
+			texel[1] = toUnorm8(value.y);
+			texel[2] = toUnorm8(value.z);
+			texel[3] = 255u;
+		}
+	});
+}
+
+void IBLLib::projectSH9OnCPU(const CpuCubeMap& _cubeMap, uint32_t _level, float (&_outCoefficients)[SH9CoefficientCount])
+{
+	const uint32_t side = std::max(_cubeMap.sideLength >> _level, 1u);
+	const float* levelData = _cubeMap.levels[_level].data();
+
+	// accumulate in double, a level can have millions of texels
+	double coefficients[SH9CoefficientCount] = {};
+
+	for (uint32_t face = 0; face < 6u; ++face)
+	{
+		for (uint32_t y = 0; y < side; ++y)
+		{
+			for (uint32_t x = 0; x < side; ++x)
+			{
+				const float* texel = levelData + ((static_cast<size_t>(face) * side + y) * side + x) * 4u;
+				const float solidAngle = texelSolidAngle(x, y, side);
+
+				float basis[9];
+				evaluateSH9Basis(texelDirection(face, x, y, side), basis);
+
+				for (uint32_t i = 0; i < 9u; ++i)
+				{
+					const float weight = basis[i] * solidAngle;
+					coefficients[i * 3u + 0u] += texel[0] * weight;
+					coefficients[i * 3u + 1u] += texel[1] * weight;
+					coefficients[i * 3u + 2u] += texel[2] * weight;
+				}
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < SH9CoefficientCount; ++i)
+	{
+		_outCoefficients[i] = static_cast<float>(coefficients[i]);
+	}
+}
+
+void IBLLib::evaluateSH9IrradianceOnCPU(const float (&_coefficients)[SH9CoefficientCount], uint32_t _sideLength, CpuCubeMap& _outCubeMap)
+{
+	_outCubeMap.sideLength = _sideLength;
+	_outCubeMap.levels.resize(1u);
+	_outCubeMap.levels[0].resize(static_cast<size_t>(_sideLength) * _sideLength * 6u * 4u);
+
+	float convolved[SH9CoefficientCount];
+	for (uint32_t i = 0; i < SH9CoefficientCount; ++i)
+	{
+		convolved[i] = _coefficients[i] * SHCosineLobe[i / 3u];
+	}
+
+	for (uint32_t face = 0; face < 6u; ++face)
+	{
+		for (uint32_t y = 0; y < _sideLength; ++y)
+		{
+			for (uint32_t x = 0; x < _sideLength; ++x)
+			{
+				float basis[9];
+				evaluateSH9Basis(texelDirection(face, x, y, _sideLength), basis);
+
+				float color[3] = {};
+				for (uint32_t i = 0; i < 9u; ++i)
+				{
+					color[0] += convolved[i * 3u + 0u] * basis[i];
+					color[1] += convolved[i * 3u + 1u] * basis[i];
+					color[2] += convolved[i * 3u + 2u] * basis[i];
+				}
+
+				// ringing of the truncated series can go below zero for very bright light sources
+				float* texel = _outCubeMap.levels[0].data() + ((static_cast<size_t>(face) * _sideLength + y) * _sideLength + x) * 4u;
+				texel[0] = std::max(color[0], 0.f);
+				texel[1] = std::max(color[1], 0.f);
+				texel[2] = std::max(color[2], 0.f);
+				texel[3] = 1.f;
+			}
+		}
+	}
+}
+
+void IBLLib::measureSH9ErrorOnCPU(const CpuCubeMap& _input, uint32_t _inputMipLevels, const float (&_coefficients)[SH9CoefficientCount],
+	uint32_t _sampleCount, float _lodBias, uint32_t _sideLength, float& _outMeanError, float& _outMaxError)
+{
+	CpuCubeMap irradiance;
+	evaluateSH9IrradianceOnCPU(_coefficients, _sideLength, irradiance);
+
+	std::vector<SampleTableEntry> samples;
+	computeSampleTable(Distribution::Lambertian, 0.f, _sampleCount, _input.sideLength, _lodBias, samples);
+
+	double errorSum = 0.0;
+	_outMaxError = 0.f;
+
+	for (uint32_t face = 0; face < 6u; ++face)
+	{
+		for (uint32_t y = 0; y < _sideLength; ++y)
+		{
+			for (uint32_t x = 0; x < _sideLength; x += Lanes::Count)
+			{
+				const uint32_t validLanes = _sideLength - x < Lanes::Count ? _sideLength - x : Lanes::Count;
+
+				float normals[3][Lanes::Count];
+				for (uint32_t lane = 0; lane < Lanes::Count; ++lane)
+				{
+					const vec3 direction = texelDirection(face, x + std::min(lane, validLanes - 1u), y, _sideLength);
+					normals[0][lane] = direction.x;
+					normals[1][lane] = direction.y;
+					normals[2][lane] = direction.z;
+				}
+
+				float sampled[Lanes::Count * 4u];
+				filterTexels(_input, _inputMipLevels, Distribution::Lambertian, _sampleCount, samples, normals, validLanes, sampled);
+
+				for (uint32_t lane = 0; lane < validLanes; ++lane)
+				{
+					const float* reference = sampled + lane * 4u;
+					const float* texel = irradiance.levels[0].data() + ((static_cast<size_t>(face) * _sideLength + y) * _sideLength + x + lane) * 4u;
+
+					const float difference = std::fabs(texel[0] - reference[0]) + std::fabs(texel[1] - reference[1]) + std::fabs(texel[2] - reference[2]);
+					const float magnitude = std::max(reference[0] + reference[1] + reference[2], 1e-6f);
+					const float error = difference / magnitude;
+
+					errorSum += error;
+					_outMaxError = std::max(_outMaxError, error);
+				}
+			}
+		}
+	}
+
+	_outMeanError = static_cast<float>(errorSum / (6.0 * _sideLength * _sideLength));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GltfIblSampler.h"
+
+namespace IBLLib
+{
+	class ThreadPool;
+
+	// Mip levels of a cube map in host memory, RGBA32F.
+	// Each level holds the faces +X, -X, +Y, -Y, +Z, -Z tightly packed.
+	struct CpuCubeMap
+	{
+		uint32_t sideLength = 0u;
+		std::vector< std::vector<float> > levels;
+	};
+
+	// Importance sample of one mip level in tangent space (normal = +Z), same layout as the vec4 samples in filter.frag
+	struct SampleTableEntry
+	{
+		float direction[3];
+		float lod;
+	};
+
+	// The samples of a mip level only depend on the distribution, roughness, sample count and input size, not on the texel.
+	// GGX and Charlie entries hold L = reflect(-N, H) with NdotL in direction[2], samples with NdotL <= 0 are culled.
+	void computeSampleTable(Distribution _distribution, float _roughness, uint32_t _sampleCount, uint32_t _inputSideLength, float _lodBias,
+		std::vector<SampleTableEntry>& _outSamples);
+
+	// CPU implementation of the passes in filter.frag, results match the Vulkan path up to floating point differences
+
+	void panoramaToCubeMapOnCPU(ThreadPool& _pool, const float* _panorama, uint32_t _width, uint32_t _height, uint32_t _sideLength, CpuCubeMap& _outCubeMap);
+
+	// box filters the missing levels up to _mipLevels from the last present one like the linear blits on the GPU
+	void generateMipmapLevelsOnCPU(ThreadPool& _pool, CpuCubeMap& _cubeMap, uint32_t _mipLevels);
+
+	// _inputMipLevels limits the levels of _input that are sampled
+	void filterCubeMapOnCPU(ThreadPool& _pool, const CpuCubeMap& _input, uint32_t _inputMipLevels, Distribution _distribution,
+		uint32_t _sideLength, uint32_t _mipLevels, uint32_t _sampleCount, float _lodBias, CpuCubeMap& _outCubeMap);
+
+	// BRDF LUT as R8G8B8A8_UNORM, x: NdotV, y: roughness
+	void computeLUTOnCPU(ThreadPool& _pool, Distribution _distribution, uint32_t _sideLength, uint32_t _sampleCount, std::vector<uint8_t>& _outLUT);
+
+	// Irradiance from spherical harmonics (Distribution::LambertianSH)
+
+	// 9 RGB triples ordered (l, m) = (0, 0), (1, -1), (1, 0), (1, 1), (2, -2), (2, -1), (2, 0), (2, 1), (2, 2)
+	const uint32_t SH9CoefficientCount = 27u;
+
+	// bands 0-2 do not need more texels than this, the projection reads the first level that is at most this large
+	const uint32_t SHProjectionSideLength = 64u;
+
+	// projects one level of the cube map onto the SH basis, each texel weighted by its solid angle
+	void projectSH9OnCPU(const CpuCubeMap& _cubeMap, uint32_t _level, float (&_outCoefficients)[SH9CoefficientCount]);
+
+	// convolves the coefficients with the clamped cosine and evaluates them at the texel centers of a single level.
+	// The result is scaled like the Lambertian filter output, i.e. irradiance / PI.
+	void evaluateSH9IrradianceOnCPU(const float (&_coefficients)[SH9CoefficientCount], uint32_t _sideLength, CpuCubeMap& _outCubeMap);
+
+	// relative error of the SH irradiance against the sampled Lambertian filter of _input, measured at _sideLength texels per face side
+	void measureSH9ErrorOnCPU(const CpuCubeMap& _input, uint32_t _inputMipLevels, const float (&_coefficients)[SH9CoefficientCount],
+		uint32_t _sampleCount, float _lodBias, uint32_t _sideLength, float& _outMeanError, float& _outMaxError);
+} // !IBLLib
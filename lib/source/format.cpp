@@ -1,6 +1,7 @@
 
 #include "format.h"
 #include <cmath>
+#include <cstring>
 
 uint32_t IBLLib::getFormatSize(VkFormat _vkFormat)
 {
@@ -65,6 +66,7 @@ uint32_t IBLLib::getFormatSize(VkFormat _vkFormat)
 	case VK_FORMAT_A2B10G10R10_SINT_PACK32:
 
 	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
 
 	case VK_FORMAT_R8G8B8A8_UNORM:
 	case VK_FORMAT_R8G8B8A8_SNORM:
@@ -364,3 +366,76 @@ uint32_t IBLLib::getChannelCount(VkFormat _vkFormat)
 		return 0u; // invalid
 	}
 }
+
+uint16_t IBLLib::floatToHalf(float _value)
+{
+	uint32_t bits;
+	memcpy(&bits, &_value, 4);
+
+	const uint32_t sign = (bits >> 16) & 0x8000u;
+	const uint32_t absBits = bits & 0x7FFFFFFFu;
+
+	if (absBits >= 0x7F800000u) {
+		// Inf or NaN
+		return static_cast<uint16_t>(sign | 0x7C00u | (absBits > 0x7F800000u ? 0x200u : 0u));
+	}
+
+	if (absBits >= 0x477FF000u) {
+		// rounds to a value beyond the largest half
+		return static_cast<uint16_t>(sign | 0x7C00u);
+	}
+
+	if (absBits < 0x38800000u) {
+		// subnormal half, shift the mantissa with the implicit one into place, the result is in units of 2^-24
+		const uint32_t shift = 126u - (absBits >> 23);
+		if (shift > 24u) {
+			return static_cast<uint16_t>(sign);
+		}
+		const uint32_t mantissa = (absBits & 0x7FFFFFu) | 0x800000u;
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+		const uint32_t halfway = 1u << (shift - 1u);
+		if (remainder > halfway || (remainder == halfway && (half & 1u))) {
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	uint32_t half = ((absBits - 0x38000000u) >> 13);
+	const uint32_t remainder = absBits & 0x1FFFu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) {
+		half++;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+float IBLLib::halfToFloat(uint16_t _value)
+{
+	const uint32_t sign = static_cast<uint32_t>(_value & 0x8000u) << 16;
+	uint32_t exponent = (_value >> 10) & 0x1Fu;
+	uint32_t mantissa = _value & 0x3FFu;
+
+	uint32_t bits;
+	if (exponent == 0x1Fu) {
+		bits = sign | 0x7F800000u | (mantissa << 13);
+	}
+	else if (exponent != 0u) {
+		bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+	}
+	else if (mantissa == 0u) {
+		bits = sign;
+	}
+	else {
+		// normalize the subnormal half
+		exponent = 113u;
+		while ((mantissa & 0x400u) == 0u) {
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+	}
+
+	float value;
+	memcpy(&value, &bits, 4);
+	return value;
+}
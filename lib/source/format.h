@@ -10,4 +10,8 @@ namespace IBLLib
 uint32_t getFormatSize(VkFormat _vkFormat);
 
 uint32_t getChannelCount(VkFormat _vkFormat);
+
+// IEEE 754 binary16, round to nearest even
+uint16_t floatToHalf(float _value);
+float halfToFloat(uint16_t _value);
 }// IBLLib
@@ -0,0 +1,522 @@
+#include "formatConversion.h"
+#include "format.h"
+#include "threadPool.h"
+#include "trace.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IBLLIB_CPU_SSE2
+#endif
+
+using namespace IBLLib;
+
+namespace
+{
+// texels of one job of a parallel conversion, 1 MB of RGBA32F
+const size_t g_ChunkTexelCount = 65536u;
+
+// min and max return _b if _a is NaN, like minps and maxps
+struct ScalarLanes
+{
+	typedef float Floats;
+	typedef uint32_t Ints;
+	static const size_t Count = 1u;
+
+	static Floats load(const float* _p) { return *_p; }
+	static Floats set(float _f) { return _f; }
+	static Ints setInts(uint32_t _i) { return _i; }
+
+	static Floats add(Floats _a, Floats _b) { return _a + _b; }
+	static Floats mul(Floats _a, Floats _b) { return _a * _b; }
+	static Floats min(Floats _a, Floats _b) { return _a < _b ? _a : _b; }
+	static Floats max(Floats _a, Floats _b) { return _a > _b ? _a : _b; }
+	static Ints truncate(Floats _a) { return static_cast<uint32_t>(static_cast<int32_t>(_a)); }
+
+	static Ints asInts(Floats _a) { Ints i; memcpy(&i, &_a, sizeof(i)); return i; }
+	static Floats asFloats(Ints _a) { Floats f; memcpy(&f, &_a, sizeof(f)); return f; }
+
+	static Ints addInts(Ints _a, Ints _b) { return _a + _b; }
+	static Ints subInts(Ints _a, Ints _b) { return _a - _b; }
+	static Ints bitAnd(Ints _a, Ints _b) { return _a & _b; }
+	static Ints bitOr(Ints _a, Ints _b) { return _a | _b; }
+	static Ints shiftLeft(Ints _a, int _bits) { return _a << _bits; }
+	static Ints shiftRight(Ints _a, int _bits) { return _a >> _bits; }
+	static Ints greater(Ints _a, Ints _b) { return static_cast<int32_t>(_a) > static_cast<int32_t>(_b) ? 0xFFFFFFFFu : 0u; }
+	static Ints select(Ints _mask, Ints _a, Ints _b) { return (_mask & _a) | (~_mask & _b); }
+
+	// red, green and blue of Count RGBA texels
+	static void loadRGB(const float* _p, Floats& _r, Floats& _g, Floats& _b) { _r = _p[0]; _g = _p[1]; _b = _p[2]; }
+
+	static void storeInts(uint8_t* _p, Ints _a) { memcpy(_p, &_a, sizeof(_a)); }
+	static void storeUnorm8(uint8_t* _p, Ints _a) { *_p = static_cast<uint8_t>(_a); }
+	static void storeHalf(uint8_t* _p, Ints _a) { const uint16_t half = static_cast<uint16_t>(_a); memcpy(_p, &half, sizeof(half)); }
+};
+
+#if defined(__AVX2__)
+struct SimdLanes
+{
+	typedef __m256 Floats;
+	typedef __m256i Ints;
+	static const size_t Count = 8u;
+
+	static Floats load(const float* _p) { return _mm256_loadu_ps(_p); }
+	static Floats set(float _f) { return _mm256_set1_ps(_f); }
+	static Ints setInts(uint32_t _i) { return _mm256_set1_epi32(static_cast<int>(_i)); }
+
+	static Floats add(Floats _a, Floats _b) { return _mm256_add_ps(_a, _b); }
+	static Floats mul(Floats _a, Floats _b) { return _mm256_mul_ps(_a, _b); }
+	static Floats min(Floats _a, Floats _b) { return _mm256_min_ps(_a, _b); }
+	static Floats max(Floats _a, Floats _b) { return _mm256_max_ps(_a, _b); }
+	static Ints truncate(Floats _a) { return _mm256_cvttps_epi32(_a); }
+
+	static Ints asInts(Floats _a) { return _mm256_castps_si256(_a); }
+	static Floats asFloats(Ints _a) { return _mm256_castsi256_ps(_a); }
+
+	static Ints addInts(Ints _a, Ints _b) { return _mm256_add_epi32(_a, _b); }
+	static Ints subInts(Ints _a, Ints _b) { return _mm256_sub_epi32(_a, _b); }
+	static Ints bitAnd(Ints _a, Ints _b) { return _mm256_and_si256(_a, _b); }
+	static Ints bitOr(Ints _a, Ints _b) { return _mm256_or_si256(_a, _b); }
+	static Ints shiftLeft(Ints _a, int _bits) { return _mm256_sll_epi32(_a, _mm_cvtsi32_si128(_bits)); }
+	static Ints shiftRight(Ints _a, int _bits) { return _mm256_srl_epi32(_a, _mm_cvtsi32_si128(_bits)); }
+	static Ints greater(Ints _a, Ints _b) { return _mm256_cmpgt_epi32(_a, _b); }
+	static Ints select(Ints _mask, Ints _a, Ints _b) { return _mm256_or_si256(_mm256_and_si256(_mask, _a), _mm256_andnot_si256(_mask, _b)); }
+
+	static void loadRGB(const float* _p, Floats& _r, Floats& _g, Floats& _b)
+	{
+		__m128 t0 = _mm_loadu_ps(_p), t1 = _mm_loadu_ps(_p + 4), t2 = _mm_loadu_ps(_p + 8), t3 = _mm_loadu_ps(_p + 12);
+		__m128 u0 = _mm_loadu_ps(_p + 16), u1 = _mm_loadu_ps(_p + 20), u2 = _mm_loadu_ps(_p + 24), u3 = _mm_loadu_ps(_p + 28);
+		_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+		_MM_TRANSPOSE4_PS(u0, u1, u2, u3);
+		_r = _mm256_insertf128_ps(_mm256_castps128_ps256(t0), u0, 1);
+		_g = _mm256_insertf128_ps(_mm256_castps128_ps256(t1), u1, 1);
+		_b = _mm256_insertf128_ps(_mm256_castps128_ps256(t2), u2, 1);
+	}
+
+	static void storeInts(uint8_t* _p, Ints _a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(_p), _a); }
+
+	static void storeUnorm8(uint8_t* _p, Ints _a)
+	{
+		const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(_a), _mm256_extracti128_si256(_a, 1));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(_p), _mm_packus_epi16(words, words));
+	}
+
+	// packs_epi32 saturates signed, so the values are moved into its range and back
+	static void storeHalf(uint8_t* _p, Ints _a)
+	{
+		const __m256i biased = _mm256_sub_epi32(_a, _mm256_set1_epi32(0x8000));
+		const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(biased), _mm256_extracti128_si256(biased, 1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(_p), _mm_xor_si128(words, _mm_set1_epi16(static_cast<short>(0x8000))));
+	}
+};
+#elif defined(IBLLIB_CPU_SSE2)
+struct SimdLanes
+{
+	typedef __m128 Floats;
+	typedef __m128i Ints;
+	static const size_t Count = 4u;
+
+	static Floats load(const float* _p) { return _mm_loadu_ps(_p); }
+	static Floats set(float _f) { return _mm_set1_ps(_f); }
+	static Ints setInts(uint32_t _i) { return _mm_set1_epi32(static_cast<int>(_i)); }
+
+	static Floats add(Floats _a, Floats _b) { return _mm_add_ps(_a, _b); }
+	static Floats mul(Floats _a, Floats _b) { return _mm_mul_ps(_a, _b); }
+	static Floats min(Floats _a, Floats _b) { return _mm_min_ps(_a, _b); }
+	static Floats max(Floats _a, Floats _b) { return _mm_max_ps(_a, _b); }
+	static Ints truncate(Floats _a) { return _mm_cvttps_epi32(_a); }
+
+	static Ints asInts(Floats _a) { return _mm_castps_si128(_a); }
+	static Floats asFloats(Ints _a) { return _mm_castsi128_ps(_a); }
+
+	static Ints addInts(Ints _a, Ints _b) { return _mm_add_epi32(_a, _b); }
+	static Ints subInts(Ints _a, Ints _b) { return _mm_sub_epi32(_a, _b); }
+	static Ints bitAnd(Ints _a, Ints _b) { return _mm_and_si128(_a, _b); }
+	static Ints bitOr(Ints _a, Ints _b) { return _mm_or_si128(_a, _b); }
+	static Ints shiftLeft(Ints _a, int _bits) { return _mm_sll_epi32(_a, _mm_cvtsi32_si128(_bits)); }
+	static Ints shiftRight(Ints _a, int _bits) { return _mm_srl_epi32(_a, _mm_cvtsi32_si128(_bits)); }
+	static Ints greater(Ints _a, Ints _b) { return _mm_cmpgt_epi32(_a, _b); }
+	static Ints select(Ints _mask, Ints _a, Ints _b) { return _mm_or_si128(_mm_and_si128(_mask, _a), _mm_andnot_si128(_mask, _b)); }
+
+	static void loadRGB(const float* _p, Floats& _r, Floats& _g, Floats& _b)
+	{
+		__m128 t0 = _mm_loadu_ps(_p), t1 = _mm_loadu_ps(_p + 4), t2 = _mm_loadu_ps(_p + 8), t3 = _mm_loadu_ps(_p + 12);
+		_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+		_r = t0;
+		_g = t1;
+		_b = t2;
+	}
+
+	static void storeInts(uint8_t* _p, Ints _a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(_p), _a); }
+
+	static void storeUnorm8(uint8_t* _p, Ints _a)
+	{
+		const __m128i words = _mm_packs_epi32(_a, _a);
+		const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+		memcpy(_p, &bytes, sizeof(bytes));
+	}
+
+	// packs_epi32 saturates signed, so the values are moved into its range and back
+	static void storeHalf(uint8_t* _p, Ints _a)
+	{
+		const __m128i biased = _mm_sub_epi32(_a, _mm_set1_epi32(0x8000));
+		const __m128i words = _mm_packs_epi32(biased, biased);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(_p), _mm_xor_si128(words, _mm_set1_epi16(static_cast<short>(0x8000))));
+	}
+};
+#else
+typedef ScalarLanes SimdLanes;
+#endif
+
+// A kernel converts Lanes::Count elements, an element is a channel or a texel depending on the formats
+template <VkFormat Dst, VkFormat Src>
+struct Kernel;
+
+template <>
+struct Kernel<VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R32G32B32A32_SFLOAT>
+{
+	static const size_t ElementsPerTexel = 4u;
+	static const size_t SrcElementSize = 4u;
+	static const size_t DstElementSize = 1u;
+
+	template <class L>
+	static void convert(const uint8_t* _src, uint8_t* _dst)
+	{
+		const typename L::Floats value = L::max(L::min(L::load(reinterpret_cast<const float*>(_src)), L::set(1.0f)), L::set(0.0f));
+		L::storeUnorm8(_dst, L::truncate(L::add(L::mul(value, L::set(255.0f)), L::set(0.5f))));
+	}
+};
+
+template <>
+struct Kernel<VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT>
+{
+	static const size_t ElementsPerTexel = 4u;
+	static const size_t SrcElementSize = 4u;
+	static const size_t DstElementSize = 2u;
+
+	// floatToHalf without branches
+	template <class L>
+	static void convert(const uint8_t* _src, uint8_t* _dst)
+	{
+		const typename L::Ints bits = L::asInts(L::load(reinterpret_cast<const float*>(_src)));
+		const typename L::Ints absBits = L::bitAnd(bits, L::setInts(0x7FFFFFFFu));
+		const typename L::Ints sign = L::bitAnd(L::shiftRight(bits, 16), L::setInts(0x8000u));
+
+		// rounds to nearest even by adding just below half an ulp plus the lowest kept bit, a carry moves into the exponent
+		const typename L::Ints odd = L::bitAnd(L::shiftRight(absBits, 13), L::setInts(1u));
+		const typename L::Ints normal = L::shiftRight(L::addInts(L::subInts(absBits, L::setInts(0x38000000u)), L::addInts(L::setInts(0xFFFu), odd)), 13);
+
+		// the addition rounds the mantissa of a subnormal half into the lowest bits of 0.5
+		const typename L::Ints subnormal = L::subInts(L::asInts(L::add(L::asFloats(absBits), L::set(0.5f))), L::setInts(0x3F000000u));
+
+		typename L::Ints half = L::select(L::greater(L::setInts(0x38800000u), absBits), subnormal, normal);
+		half = L::select(L::greater(absBits, L::setInts(0x477FEFFFu)), L::setInts(0x7C00u), half);
+		half = L::select(L::greater(absBits, L::setInts(0x7F800000u)), L::setInts(0x7E00u), half);
+
+		L::storeHalf(_dst, L::bitOr(half, sign));
+	}
+};
+
+template <>
+struct Kernel<VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, VK_FORMAT_R32G32B32A32_SFLOAT>
+{
+	static const size_t ElementsPerTexel = 1u;
+	static const size_t SrcElementSize = 16u;
+	static const size_t DstElementSize = 4u;
+
+	// 2^(B + N - _exponent) as the divisor of EXT_texture_shared_exponent is a power of two
+	template <class L>
+	static typename L::Floats getScale(typename L::Ints _exponent)
+	{
+		return L::asFloats(L::shiftLeft(L::subInts(L::setInts(127u + 24u), _exponent), 23));
+	}
+
+	// https://registry.khronos.org/OpenGL/extensions/EXT/EXT_texture_shared_exponent.txt
+	template <class L>
+	static void convert(const uint8_t* _src, uint8_t* _dst)
+	{
+		typename L::Floats red, green, blue;
+		L::loadRGB(reinterpret_cast<const float*>(_src), red, green, blue);
+
+		// NaN is clamped to the maximum
+		const typename L::Floats sharedexpMax = L::set(65408.0f);
+		const typename L::Floats zero = L::set(0.0f);
+		red = L::max(L::min(red, sharedexpMax), zero);
+		green = L::max(L::min(green, sharedexpMax), zero);
+		blue = L::max(L::min(blue, sharedexpMax), zero);
+
+		const typename L::Floats maxC = L::max(L::max(red, green), blue);
+
+		// floor(log2(maxC)) is the unbiased exponent of maxC, zero and subnormals fall below the lower bound of -16
+		const typename L::Ints minExponent = L::setInts(127u - 16u);
+		typename L::Ints expSharedP = L::shiftRight(L::asInts(maxC), 23);
+		expSharedP = L::subInts(L::select(L::greater(expSharedP, minExponent), expSharedP, minExponent), minExponent);
+
+		const typename L::Floats half = L::set(0.5f);
+		const typename L::Ints maxS = L::truncate(L::add(L::mul(maxC, getScale<L>(expSharedP)), half));
+
+		// the mask of greater is -1
+		const typename L::Ints expShared = L::subInts(expSharedP, L::greater(maxS, L::setInts(511u)));
+		const typename L::Floats scale = getScale<L>(expShared);
+
+		const typename L::Ints redS = L::truncate(L::add(L::mul(red, scale), half));
+		const typename L::Ints greenS = L::truncate(L::add(L::mul(green, scale), half));
+		const typename L::Ints blueS = L::truncate(L::add(L::mul(blue, scale), half));
+
+		L::storeInts(_dst, L::bitOr(L::bitOr(redS, L::shiftLeft(greenS, 9)), L::bitOr(L::shiftLeft(blueS, 18), L::shiftLeft(expShared, 27))));
+	}
+};
+
+template <>
+struct Kernel<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT>
+{
+	static const size_t ElementsPerTexel = 4u;
+	static const size_t SrcElementSize = 2u;
+	static const size_t DstElementSize = 4u;
+
+	// only input images take this path, once per job
+	template <class L>
+	static void convert(const uint8_t* _src, uint8_t* _dst)
+	{
+		for (size_t i = 0; i < L::Count; ++i)
+		{
+			uint16_t half;
+			memcpy(&half, _src + i * SrcElementSize, sizeof(half));
+			const float value = halfToFloat(half);
+			memcpy(_dst + i * DstElementSize, &value, sizeof(value));
+		}
+	}
+};
+
+template <>
+struct Kernel<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_B10G11R11_UFLOAT_PACK32>
+{
+	static const size_t ElementsPerTexel = 1u;
+	static const size_t SrcElementSize = 4u;
+	static const size_t DstElementSize = 16u;
+
+	// unsigned float with a 5 bit exponent of bias 15
+	static float unpackFloat(uint32_t _bits, uint32_t _mantissaBits)
+	{
+		const uint32_t exponent = _bits >> _mantissaBits;
+		const uint32_t mantissa = _bits & ((1u << _mantissaBits) - 1u);
+
+		if (exponent == 0u)
+		{
+			return ldexpf(static_cast<float>(mantissa), -14 - static_cast<int>(_mantissaBits));
+		}
+		else if (exponent == 31u)
+		{
+			return mantissa == 0u ? INFINITY : NAN;
+		}
+
+		return ldexpf(static_cast<float>(mantissa | (1u << _mantissaBits)), static_cast<int>(exponent) - 15 - static_cast<int>(_mantissaBits));
+	}
+
+	// only the input cube map of Distribution::LambertianSH takes this path, once per output
+	template <class L>
+	static void convert(const uint8_t* _src, uint8_t* _dst)
+	{
+		for (size_t i = 0; i < L::Count; ++i)
+		{
+			uint32_t packed;
+			memcpy(&packed, _src + i * SrcElementSize, sizeof(packed));
+
+			const float texel[4] = { unpackFloat(packed & 0x7FFu, 6u), unpackFloat((packed >> 11) & 0x7FFu, 6u), unpackFloat(packed >> 22, 5u), 1.0f };
+			memcpy(_dst + i * DstElementSize, texel, sizeof(texel));
+		}
+	}
+};
+
+template <>
+struct Kernel<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R8G8B8A8_UNORM>
+{
+	static const size_t ElementsPerTexel = 4u;
+	static const size_t SrcElementSize = 1u;
+	static const size_t DstElementSize = 4u;
+
+	// KTX2 inputs the device can't use natively, once per job
+	template <class L>
+	static void convert(const uint8_t* _src, uint8_t* _dst)
+	{
+		for (size_t i = 0; i < L::Count; ++i)
+		{
+			const float value = static_cast<float>(_src[i]) / 255.0f;
+			memcpy(_dst + i * DstElementSize, &value, sizeof(value));
+		}
+	}
+};
+
+template <>
+struct Kernel<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_E5B9G9R9_UFLOAT_PACK32>
+{
+	static const size_t ElementsPerTexel = 1u;
+	static const size_t SrcElementSize = 4u;
+	static const size_t DstElementSize = 16u;
+
+	// KTX2 inputs the device can't use natively, once per job
+	template <class L>
+	static void convert(const uint8_t* _src, uint8_t* _dst)
+	{
+		for (size_t i = 0; i < L::Count; ++i)
+		{
+			uint32_t packed;
+			memcpy(&packed, _src + i * SrcElementSize, sizeof(packed));
+
+			// the mantissas have no implicit one, the exponent has a bias of 15
+			const int exponent = static_cast<int>(packed >> 27) - 15 - 9;
+			const float texel[4] = { ldexpf(static_cast<float>(packed & 0x1FFu), exponent), ldexpf(static_cast<float>((packed >> 9) & 0x1FFu), exponent),
+				ldexpf(static_cast<float>((packed >> 18) & 0x1FFu), exponent), 1.0f };
+			memcpy(_dst + i * DstElementSize, texel, sizeof(texel));
+		}
+	}
+};
+
+template <VkFormat Dst, VkFormat Src>
+void convertRange(const uint8_t* _src, uint8_t* _dst, size_t _texelCount)
+{
+	typedef Kernel<Dst, Src> K;
+
+	const size_t count = _texelCount * K::ElementsPerTexel;
+	size_t i = 0u;
+
+	for (; i + SimdLanes::Count <= count; i += SimdLanes::Count)
+	{
+		K::template convert<SimdLanes>(_src + i * K::SrcElementSize, _dst + i * K::DstElementSize);
+	}
+
+	for (; i < count; ++i)
+	{
+		K::template convert<ScalarLanes>(_src + i * K::SrcElementSize, _dst + i * K::DstElementSize);
+	}
+}
+
+typedef void (*ConvertFunction)(const uint8_t* _src, uint8_t* _dst, size_t _texelCount);
+
+// nullptr for copies and unsupported formats
+ConvertFunction getConvertFunction(VkFormat _dstFormat, VkFormat _srcFormat)
+{
+	if (_srcFormat == VK_FORMAT_R32G32B32A32_SFLOAT)
+	{
+		switch (_dstFormat)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+			return &convertRange<VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R32G32B32A32_SFLOAT>;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return &convertRange<VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT>;
+		case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+			return &convertRange<VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, VK_FORMAT_R32G32B32A32_SFLOAT>;
+		default:
+			break;
+		}
+	}
+	else if (_srcFormat == VK_FORMAT_R16G16B16A16_SFLOAT && _dstFormat == VK_FORMAT_R32G32B32A32_SFLOAT)
+	{
+		return &convertRange<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT>;
+	}
+	else if (_srcFormat == VK_FORMAT_B10G11R11_UFLOAT_PACK32 && _dstFormat == VK_FORMAT_R32G32B32A32_SFLOAT)
+	{
+		return &convertRange<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_B10G11R11_UFLOAT_PACK32>;
+	}
+	else if (_srcFormat == VK_FORMAT_R8G8B8A8_UNORM && _dstFormat == VK_FORMAT_R32G32B32A32_SFLOAT)
+	{
+		return &convertRange<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R8G8B8A8_UNORM>;
+	}
+	else if (_srcFormat == VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 && _dstFormat == VK_FORMAT_R32G32B32A32_SFLOAT)
+	{
+		return &convertRange<VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_E5B9G9R9_UFLOAT_PACK32>;
+	}
+
+	return nullptr;
+}
+
+struct Chunk
+{
+	size_t job;
+	size_t firstTexel;
+	size_t texelCount;
+};
+} // !anonymous namespace
+
+bool IBLLib::isConversionSupported(VkFormat _dstFormat, VkFormat _srcFormat)
+{
+	if (_dstFormat == _srcFormat)
+	{
+		return getFormatSize(_dstFormat) != 0u;
+	}
+
+	return getConvertFunction(_dstFormat, _srcFormat) != nullptr;
+}
+
+bool IBLLib::convertTexels(const ConversionJob* _jobs, size_t _jobCount, VkFormat _dstFormat, VkFormat _srcFormat, ThreadPool* _pool)
+{
+	if (isConversionSupported(_dstFormat, _srcFormat) == false)
+	{
+		printf("Conversion from format %d to %d is not supported\n", _srcFormat, _dstFormat);
+		return false;
+	}
+
+	const ConvertFunction convert = getConvertFunction(_dstFormat, _srcFormat);
+	const size_t srcTexelSize = getFormatSize(_srcFormat);
+	const size_t dstTexelSize = getFormatSize(_dstFormat);
+
+	// chunks of all jobs go to the pool at once, so the small mip levels do not leave threads idle
+	std::vector<Chunk> chunks;
+	size_t byteSize = 0u;
+
+	for (size_t job = 0; job < _jobCount; ++job)
+	{
+		for (size_t first = 0; first < _jobs[job].texelCount; first += g_ChunkTexelCount)
+		{
+			const size_t remaining = _jobs[job].texelCount - first;
+			chunks.push_back({ job, first, remaining < g_ChunkTexelCount ? remaining : g_ChunkTexelCount });
+		}
+
+		byteSize += _jobs[job].texelCount * srcTexelSize;
+	}
+
+	TraceScope trace("convertTexels", byteSize);
+
+	const auto convertChunk = [&](uint32_t _chunk)
+	{
+		const Chunk& chunk = chunks[_chunk];
+		const ConversionJob& job = _jobs[chunk.job];
+		const uint8_t* src = job.src + chunk.firstTexel * srcTexelSize;
+		uint8_t* dst = job.dst + chunk.firstTexel * dstTexelSize;
+
+		if (convert != nullptr)
+		{
+			convert(src, dst, chunk.texelCount);
+		}
+		else
+		{
+			memcpy(dst, src, chunk.texelCount * dstTexelSize);
+		}
+	};
+
+	if (_pool != nullptr)
+	{
+		_pool->parallelFor(static_cast<uint32_t>(chunks.size()), convertChunk);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < chunks.size(); ++i)
+		{
+			convertChunk(i);
+		}
+	}
+
+	return true;
+}
+
+bool IBLLib::convertTexels(uint8_t* _dst, VkFormat _dstFormat, const uint8_t* _src, VkFormat _srcFormat, size_t _texelCount, ThreadPool* _pool)
+{
+	const ConversionJob job = { _src, _dst, _texelCount };
+	return convertTexels(&job, 1u, _dstFormat, _srcFormat, _pool);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk.h>
+
+namespace IBLLib
+{
+class ThreadPool;
+
+// A range of texels converted by convertTexels, source and destination must not overlap
+struct ConversionJob
+{
+	const uint8_t* src;
+	uint8_t* dst;
+	size_t texelCount;
+};
+
+// RGBA32F to R8G8B8A8_UNORM, R16G16B16A16_SFLOAT and E5B9G9R9_UFLOAT_PACK32, all of these and B10G11R11_UFLOAT_PACK32 to RGBA32F
+// and copies of equal formats
+bool isConversionSupported(VkFormat _dstFormat, VkFormat _srcFormat);
+
+// Converts the jobs into their preallocated destinations, the results match floatToHalf and the scalar definitions of the formats bit for bit.
+// The jobs are split into chunks that run on _pool if it is not nullptr. Returns false if the formats are not supported.
+bool convertTexels(const ConversionJob* _jobs, size_t _jobCount, VkFormat _dstFormat, VkFormat _srcFormat, ThreadPool* _pool = nullptr);
+
+bool convertTexels(uint8_t* _dst, VkFormat _dstFormat, const uint8_t* _src, VkFormat _srcFormat, size_t _texelCount, ThreadPool* _pool = nullptr);
+}// IBLLib
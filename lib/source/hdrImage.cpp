@@ -0,0 +1,275 @@
+#include "hdrImage.h"
+#include "format.h"
+#include "formatConversion.h"
+#include "threadPool.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+	// rows decoded by one job of the thread pool
+	const uint32_t RowsPerJob = 16u;
+
+	// 2^(e - 136) of stbi__hdr_convert for every exponent, zero for an exponent of 0
+	struct ExponentScales
+	{
+		float scales[256];
+
+		ExponentScales()
+		{
+			scales[0] = 0.0f;
+			for (int e = 1; e < 256; ++e)
+			{
+				scales[e] = ldexpf(1.0f, e - (128 + 8));
+			}
+		}
+	};
+
+	// texel of stbi__hdr_convert with 4 components
+	void convertRGBE(const uint8_t* _rgbe, const float* _scales, float* _texel)
+	{
+		const float scale = _scales[_rgbe[3]];
+		_texel[0] = _rgbe[0] * scale;
+		_texel[1] = _rgbe[1] * scale;
+		_texel[2] = _rgbe[2] * scale;
+		_texel[3] = 1.0f;
+	}
+} // !anonymous namespace
+
+bool IBLLib::HdrImage::open(const char* _path)
+{
+	TraceScope trace("HdrImage::open");
+
+	if (m_file.open(_path) == false)
+	{
+		return false;
+	}
+
+	const char* data = reinterpret_cast<const char*>(m_file.getData());
+	const size_t size = m_file.getSize();
+	size_t offset = 0u;
+
+	// the header lines end at an empty line, the resolution follows on the next one
+	const auto readLine = [data, size, &offset](std::string& _line)
+	{
+		const char* end = static_cast<const char*>(memchr(data + offset, '\n', size - offset));
+		if (end == nullptr)
+		{
+			return false;
+		}
+
+		_line.assign(data + offset, end);
+		offset = end - data + 1u;
+		return true;
+	};
+
+	std::string line;
+	if (readLine(line) == false || (line != "#?RADIANCE" && line != "#?RGBE"))
+	{
+		return false;
+	}
+
+	bool isRGBE = false;
+	while (readLine(line) && line.empty() == false)
+	{
+		isRGBE |= line == "FORMAT=32-bit_rle_rgbe";
+	}
+
+	// only the orientation of stb_image, -Y height +X width
+	if (isRGBE == false || readLine(line) == false || line.compare(0, 3, "-Y ") != 0)
+	{
+		return false;
+	}
+
+	char* end = nullptr;
+	const long height = strtol(line.c_str() + 3, &end, 10);
+	while (*end == ' ')
+	{
+		++end;
+	}
+
+	if (strncmp(end, "+X ", 3) != 0)
+	{
+		return false;
+	}
+
+	const long width = strtol(end + 3, nullptr, 10);
+	if (width <= 0 || height <= 0 || width > (1 << 24) || height > (1 << 24))
+	{
+		return false;
+	}
+
+	m_width = static_cast<uint32_t>(width);
+	m_height = static_cast<uint32_t>(height);
+	m_dataOffset = offset;
+
+	return locateScanlines();
+}
+
+// Run length encoded scanlines differ in size, a sequential pass over the run headers finds where each one starts
+bool IBLLib::HdrImage::locateScanlines()
+{
+	const uint8_t* data = m_file.getData();
+	const size_t size = m_file.getSize();
+	size_t offset = m_dataOffset;
+
+	m_scanlineOffsets.clear();
+
+	const bool isFlat = m_width < 8u || m_width >= 32768u || size - offset < 4u ||
+		data[offset] != 2u || data[offset + 1u] != 2u || (data[offset + 2u] & 0x80u) != 0u;
+
+	if (isFlat)
+	{
+		return (size - offset) / 4u / m_width >= m_height;
+	}
+
+	m_scanlineOffsets.resize(m_height);
+
+	for (uint32_t row = 0; row < m_height; ++row)
+	{
+		if (size - offset < 4u || data[offset] != 2u || data[offset + 1u] != 2u ||
+			((static_cast<uint32_t>(data[offset + 2u]) << 8) | data[offset + 3u]) != m_width)
+		{
+			return false;
+		}
+
+		m_scanlineOffsets[row] = offset;
+		offset += 4u;
+
+		for (uint32_t component = 0; component < 4u; ++component)
+		{
+			for (uint32_t x = 0; x < m_width; )
+			{
+				if (offset >= size)
+				{
+					return false;
+				}
+
+				uint32_t count = data[offset];
+				size_t runBytes = 1u + count;
+
+				if (count > 128u)
+				{
+					count -= 128u;
+					runBytes = 2u;
+				}
+
+				if (count == 0u || count > m_width - x || runBytes > size - offset)
+				{
+					return false;
+				}
+
+				offset += runBytes;
+				x += count;
+			}
+		}
+	}
+
+	return true;
+}
+
+void IBLLib::HdrImage::decodeScanline(uint32_t _row, uint8_t* _rgbe) const
+{
+	const uint8_t* data = m_file.getData();
+
+	if (m_scanlineOffsets.empty())
+	{
+		memcpy(_rgbe, data + m_dataOffset + static_cast<size_t>(_row) * m_width * 4u, m_width * 4u);
+		return;
+	}
+
+	const uint8_t* p = data + m_scanlineOffsets[_row] + 4u;
+
+	// the bounds were checked by locateScanlines
+	for (uint32_t component = 0; component < 4u; ++component)
+	{
+		for (uint32_t x = 0; x < m_width; )
+		{
+			uint32_t count = *p++;
+
+			if (count > 128u)
+			{
+				count -= 128u;
+				const uint8_t value = *p++;
+				for (uint32_t end = x + count; x < end; ++x)
+				{
+					_rgbe[x * 4u + component] = value;
+				}
+			}
+			else
+			{
+				for (uint32_t end = x + count; x < end; ++x)
+				{
+					_rgbe[x * 4u + component] = *p++;
+				}
+			}
+		}
+	}
+}
+
+bool IBLLib::HdrImage::decode(uint8_t* _dst, VkFormat _format, ThreadPool* _pool) const
+{
+	if (m_width == 0u || isConversionSupported(_format, VK_FORMAT_R32G32B32A32_SFLOAT) == false)
+	{
+		return false;
+	}
+
+	const size_t rowByteSize = static_cast<size_t>(m_width) * getFormatSize(_format);
+	TraceScope trace("HdrImage::decode", rowByteSize * m_height);
+
+	const uint32_t jobCount = (m_height + RowsPerJob - 1u) / RowsPerJob;
+
+	static const ExponentScales exponentScales;
+	const float* scales = exponentScales.scales;
+
+	// RGBA32F rows are written in place, other formats are converted from a row of RGBA32F
+	const bool isFloat = _format == VK_FORMAT_R32G32B32A32_SFLOAT;
+
+	const auto decodeRows = [this, _dst, _format, rowByteSize, scales, isFloat](uint32_t _job)
+	{
+		std::vector<uint8_t> rgbe(m_width * 4u);
+		std::vector<float> texels(isFloat ? 0u : m_width * 4u);
+
+		const uint32_t lastRow = std::min((_job + 1u) * RowsPerJob, m_height);
+
+		for (uint32_t row = _job * RowsPerJob; row < lastRow; ++row)
+		{
+			decodeScanline(row, rgbe.data());
+
+			uint8_t* dst = _dst + row * rowByteSize;
+			for (uint32_t x = 0; x < m_width; ++x)
+			{
+				float texel[4];
+				convertRGBE(&rgbe[x * 4u], scales, isFloat ? texel : &texels[x * 4u]);
+
+				if (isFloat)
+				{
+					memcpy(dst + x * sizeof(texel), texel, sizeof(texel));
+				}
+			}
+
+			if (!isFloat)
+			{
+				convertTexels(dst, _format, reinterpret_cast<const uint8_t*>(texels.data()), VK_FORMAT_R32G32B32A32_SFLOAT, m_width);
+			}
+		}
+	};
+
+	if (_pool != nullptr)
+	{
+		_pool->parallelFor(jobCount, decodeRows);
+	}
+	else
+	{
+		for (uint32_t job = 0; job < jobCount; ++job)
+		{
+			decodeRows(job);
+		}
+	}
+
+	return true;
+}
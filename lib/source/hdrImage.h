@@ -0,0 +1,40 @@
+#pragma once
+
+#include "FileHelper.h"
+#include <volk.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace IBLLib
+{
+	class ThreadPool;
+
+	// Radiance RGBE (.hdr) panorama whose scanlines are decoded in parallel straight into a caller provided buffer.
+	// Files in other orientations, XYZE files and images that mix run length encoded and flat scanlines are left to STBImage.
+	class HdrImage
+	{
+	public:
+		// maps the file, parses the header and locates every scanline, false if the file is not supported
+		bool open(const char* _path);
+
+		uint32_t getWidth() const { return m_width; }
+		uint32_t getHeight() const { return m_height; }
+
+		// decodes the rows top to bottom into tightly packed texels of _format with an alpha of 1,
+		// RGBA32F matches stbi_loadf bit for bit and the other formats convertTexels of it
+		bool decode(uint8_t* _dst, VkFormat _format, ThreadPool* _pool = nullptr) const;
+
+	private:
+		bool locateScanlines();
+		void decodeScanline(uint32_t _row, uint8_t* _rgbe) const;
+
+		MappedFile m_file;
+		uint32_t m_width = 0u;
+		uint32_t m_height = 0u;
+
+		// file offset of every scanline, empty for flat files whose scanlines all hold 4 * width bytes
+		std::vector<size_t> m_scanlineOffsets;
+		size_t m_dataOffset = 0u;
+	};
+} // !IBLLib
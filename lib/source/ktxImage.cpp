@@ -1,10 +1,12 @@
 #include "khr_df.h"
 #include "ktxImage.h"
+#include "trace.h"
 
 #include <stdio.h>
 
 #include <volk.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
@@ -386,7 +388,7 @@ uint32_t *createDFDPacked(int bigEndian, int numChannels,
 
 }	// end anonymous namespace
 
-KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap)
+KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap, const KtxKeyValues& _keyValues)
 {
 	uint32_t *dfdData;
 	size_t bytesPerPixel;
@@ -452,6 +454,30 @@ KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32
 
 	index.kvdByteOffset = 0;
 	index.kvdByteLength = 0;
+
+	if (!_keyValues.empty()) {
+		// The spec requires the entries sorted by key.
+		KtxKeyValues keyValues(_keyValues);
+		std::sort(keyValues.begin(), keyValues.end());
+
+		index.kvdByteOffset = static_cast<uint32_t>(mData.size());
+		for (const auto& keyValue : keyValues) {
+			uint32_t keyAndValueByteLength = static_cast<uint32_t>(keyValue.first.size() + keyValue.second.size() + 2);
+			mData.insert(
+				mData.end(),
+				reinterpret_cast<uint8_t *>(&keyAndValueByteLength),
+				reinterpret_cast<uint8_t *>(&keyAndValueByteLength + 1));
+			mData.insert(mData.end(), keyValue.first.begin(), keyValue.first.end());
+			mData.push_back(0);
+			mData.insert(mData.end(), keyValue.second.begin(), keyValue.second.end());
+			mData.push_back(0);
+
+			// Every entry is padded to 4 bytes.
+			mData.resize((mData.size() + 3) & ~static_cast<size_t>(3));
+		}
+		index.kvdByteLength = static_cast<uint32_t>(mData.size()) - index.kvdByteOffset;
+	}
+
 	index.sgdByteOffset = 0;
 	index.sgdByteLength = 0;
 	memcpy(&mData[indexOffset], &index, sizeof(index));
@@ -467,11 +493,10 @@ KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32
 		mipHeight /= 2;
 	}
 
-	// Compute mip lengths.
+	// Compute mip lengths. The levels start at multiples of lcm(texel size, 4), all formats have texels of 4, 8 or 16 bytes.
 	size_t mipOffset = mData.size();
 	for (int mip = _levels - 1; mip >= 0; mip--) {
-		if ((mipOffset & 0xf) != 0)
-			mipOffset += bytesPerPixel - (mipOffset & 0xf);
+		mipOffset = (mipOffset + bytesPerPixel - 1) / bytesPerPixel * bytesPerPixel;
 		mLevelIndices[mip].byteOffset = mipOffset;
 		mipOffset += mLevelIndices[mip].byteLength;
 	}
@@ -479,8 +504,51 @@ KtxImage::KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32
 	// Copy in mip level data.
 	memcpy(&mData[levelIndexOffset], &mLevelIndices[0], _levels * sizeof(mLevelIndices[0]));
 
-	// Reserve space for mip levels.
-	mData.resize(mipOffset);
+	// Space for the mip levels is reserved by the first write unless the image is streamed to a file.
+	mFileSize = mipOffset;
+}
+
+Result KtxImage::open(const char* _pathOut)
+{
+	TraceScope trace("KtxImage::open", mData.size());
+
+	mOut.open(_pathOut, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!mOut.is_open())
+	{
+		printf("Failed to open file %s\n", _pathOut);
+		return FileNotFound;
+	}
+
+	mOut.write((const char *)&mData[0], mData.size());
+
+	// the smallest level comes first, so the file has its final size once level 0 is written
+	return mOut.good() ? Success : KtxError;
+}
+
+Result KtxImage::close()
+{
+	TraceScope trace("KtxImage::close");
+
+	mOut.close();
+	return mOut.good() ? Success : KtxError;
+}
+
+Result KtxImage::write(const uint8_t* _inData, size_t _byteSize, uint64_t _offset)
+{
+	if (mOut.is_open())
+	{
+		mOut.seekp(static_cast<std::streamoff>(_offset));
+		mOut.write((const char *)_inData, _byteSize);
+		return mOut.good() ? Success : KtxError;
+	}
+
+	if (mData.size() < mFileSize)
+	{
+		mData.resize(mFileSize);
+	}
+
+	memcpy(&mData[_offset], _inData, _byteSize);
+	return Success;
 }
 
 Result KtxImage::writeFace(const std::vector<uint8_t>& _inData, uint32_t _side, uint32_t _level)
@@ -492,13 +560,27 @@ Result KtxImage::writeFace(const std::vector<uint8_t>& _inData, uint32_t _side,
 	size_t mipFaceSize = levelIndex.uncompressedByteLength / mHeader.faceCount;
 	assert(_inData.size() == mipFaceSize && "Face size has an incorrect length");
 
-	memcpy(&mData[levelIndex.byteOffset + mipFaceSize * _side], &_inData[0], mipFaceSize);
+	TraceScope trace("KtxImage::writeFace", mipFaceSize);
+	return write(&_inData[0], mipFaceSize, levelIndex.byteOffset + mipFaceSize * _side);
+}
 
-	return Success;
+Result KtxImage::writeLevel(const uint8_t* _inData, size_t _byteSize, uint32_t _level)
+{
+	assert(_level < mHeader.levelCount && "Level out of range");
+
+	const KTXLevelIndex &levelIndex = mLevelIndices[_level];
+	assert(_byteSize == levelIndex.uncompressedByteLength && "Level size has an incorrect length");
+
+	TraceScope trace("KtxImage::writeLevel", _byteSize);
+	return write(_inData, _byteSize, levelIndex.byteOffset);
 }
 
 Result KtxImage::save(const char* _pathOut)
 {
+	TraceScope trace("KtxImage::save", mFileSize);
+
+	mData.resize(mFileSize);
+
 	std::ofstream out;
 	out.open(_pathOut, std::ios::out | std::ios::trunc | std::ios::binary);
 	out.write((const char *)&mData[0], mData.size());
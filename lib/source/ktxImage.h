@@ -1,5 +1,8 @@
 #pragma once
 
+#include <fstream>
+#include <string>
+#include <utility>
 #include <vector>
 #include <volk.h>
 #include <cstdint>
@@ -39,13 +42,23 @@ namespace IBLLib
 		uint64_t uncompressedByteLength;
 	};
 
+	// key/value data of a KTX2 file, the values are written as NUL terminated strings
+	using KtxKeyValues = std::vector< std::pair<std::string, std::string> >;
+
 	class KtxImage
 	{
 	public:
 		// use this constructor if you want to create a ktx file
-		KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap);
+		KtxImage(uint32_t _width, uint32_t _height, VkFormat _vkFormat, uint32_t _levels, bool _isCubeMap, const KtxKeyValues& _keyValues = KtxKeyValues());
+
+		// Writes the header, DFD, key/value data and level index to _pathOut. From then on the faces and levels go straight to their final
+		// offsets in the file instead of being gathered in memory, close() completes the file. Use save() otherwise.
+		Result open(const char* _pathOut);
+		Result close();
 
 		Result writeFace(const std::vector<uint8_t>& _inData, uint32_t _side, uint32_t _level);
+		// all faces of a level, one after another
+		Result writeLevel(const uint8_t* _inData, size_t _byteSize, uint32_t _level);
 		Result save(const char* _pathOut);
 
 		uint32_t getWidth() const;
@@ -55,7 +68,12 @@ namespace IBLLib
 		VkFormat getFormat() const;
 
 	private:
+		Result write(const uint8_t* _inData, size_t _byteSize, uint64_t _offset);
+
+		// header up to the level data, the level data is only allocated when the image is not streamed
 		std::vector<uint8_t> mData;
+		size_t mFileSize = 0;
+		std::ofstream mOut;
 		KTXHeader mHeader;
 		std::vector<KTXLevelIndex> mLevelIndices;
 	};
@@ -3,14 +3,23 @@
 #include "STBImage.h"
 #include "FileHelper.h"
 #include "ktxImage.h"
+#include "hdrImage.h"
+#include "threadPool.h"
+#include "cpuFilter.h"
+#include "trace.h"
 #include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
 #include <cstring>
 #include <cassert>
+#include <cmath>
+#include <chrono>
+#include <functional>
+#include <memory>
 
 #include "format.h"
+#include "formatConversion.h"
 
 namespace IBLLib
 {
@@ -23,6 +32,14 @@ const uint32_t filterCubeMapShaderSource[] = {
 #include "shaders/gen/filter_cube_map.frag.inc"
 };
 
+const uint32_t filterCubeMapComputeShaderSource[] = {
+#include "shaders/gen/filter_cube_map.comp.inc"
+};
+
+const uint32_t encodeB9G9R9E5ComputeShaderSource[] = {
+#include "shaders/gen/encode_b9g9r9e5.comp.inc"
+};
+
 const uint32_t primitiveShaderSource[] = {
 #include "shaders/gen/primitive.vert.inc"
 };
@@ -39,7 +56,24 @@ Result compileShader(vkHelper& _vulkan, VkShaderModule& _outModule, const uint32
 	return Result::Success;
 }
 
-Result uploadImage(vkHelper& _vulkan, int width, int height, int faces, const float *hdrData, uint32_t &_defaultCubemapResolution, uint32_t explicitCubemapResolution, uint32_t explicitMipCount, VkImage& _outImage)
+// Panoramas and input cube maps are uploaded in the precision of the intermediate cube map, RGBA32F data as R16G16B16A16_SFLOAT for
+// B10G11R11_UFLOAT, data of lower precision keeps its format
+VkFormat getUploadFormat(VkFormat _intermediateFormat, VkFormat _dataFormat)
+{
+	return _intermediateFormat == VK_FORMAT_R32G32B32A32_SFLOAT || _dataFormat != VK_FORMAT_R32G32B32A32_SFLOAT ? _dataFormat : VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
+// Fills the mapped staging memory of uploadImage, _regions holds the offset and extent of every level in _imageFormat
+using StagingWriter = std::function<bool(uint8_t* _staging, VkFormat _imageFormat, const std::vector<VkBufferImageCopy>& _regions)>;
+
+// Returns a buffer that already holds the levels in _imageFormat and points _regions at them, or VK_NULL_HANDLE
+using StagingImporter = std::function<VkBuffer(VkFormat _imageFormat, std::vector<VkBufferImageCopy>& _regions)>;
+
+// Creates the image of a panorama or cube map input with _dataLevelCount levels of data in _imageFormat, or in RGBA32F
+// if the device can not filter, blit or render _imageFormat. _outLevelCount receives the number of uploaded levels, the remaining ones
+// are generated later.
+Result uploadImage(vkHelper& _vulkan, int width, int height, int faces, uint32_t _dataLevelCount, VkFormat _imageFormat, uint32_t &_defaultCubemapResolution, uint32_t explicitCubemapResolution, uint32_t explicitMipCount,
+	VkImage& _outImage, uint32_t& _outLevelCount, const StagingWriter& _writeStaging, const StagingImporter& _importStaging = nullptr)
 {
 	if (faces == 6)
 	{
@@ -71,33 +105,76 @@ Result uploadImage(vkHelper& _vulkan, int width, int height, int faces, const fl
 		maxMipLevels = explicitMipCount;
 	}
 
+	const uint32_t imageMipLevels = faces == 6 ? maxMipLevels : 1u;
+	_outLevelCount = std::min(_dataLevelCount, imageMipLevels);
+
+	// panoramas are rendered to a cube map, cube maps are sampled and the missing levels blitted
+	const VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+		(faces == 6 ? 0u : static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT));
+
+	VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+		(faces == 6 ? 0u : static_cast<VkFormatFeatureFlags>(VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT));
+	if (_outLevelCount < imageMipLevels)
+	{
+		requiredFeatures |= VK_FORMAT_FEATURE_BLIT_DST_BIT;
+	}
+
+	if ((_vulkan.getOptimalTilingFeatures(_imageFormat) & requiredFeatures) != requiredFeatures)
+	{
+		_imageFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+	}
+
 	VkCommandBuffer uploadCmds = VK_NULL_HANDLE;
 	if (_vulkan.createCommandBuffer(uploadCmds) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	// Calculate mip size.
-	uint32_t byteSize = 0;
-	uint32_t mipWidth = static_cast<uint32_t>(width), mipHeight = static_cast<uint32_t>(height);
-	for (uint32_t mip = 0; mip < maxMipLevels; mip++) {
-		byteSize += mipWidth * mipHeight * static_cast<uint32_t>(faces) * 4 * sizeof(float);
-		mipWidth /= 2;
-		mipHeight /= 2;
-	}
+	const uint32_t formatByteSize = getFormatSize(_imageFormat);
 
-	// create staging buffer for image data
-	VkBuffer stagingBuffer = VK_NULL_HANDLE;
-	if (_vulkan.createBufferAndAllocate(stagingBuffer, byteSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
+	// one region per level, the faces of a level follow each other like in KTX2
+	std::vector<VkBufferImageCopy> regions(_outLevelCount);
+	VkDeviceSize stagingByteSize = 0u;
+
+	for (uint32_t level = 0; level < _outLevelCount; ++level)
 	{
-		return Result::VulkanError;
+		const uint32_t levelWidth = std::max(static_cast<uint32_t>(width) >> level, 1u);
+		const uint32_t levelHeight = std::max(static_cast<uint32_t>(height) >> level, 1u);
+
+		VkBufferImageCopy& region = regions[level];
+		region.bufferOffset = stagingByteSize;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0u, static_cast<uint32_t>(faces) };
+		region.imageExtent = { levelWidth, levelHeight, 1u };
+
+		stagingByteSize += static_cast<VkDeviceSize>(levelWidth) * levelHeight * faces * formatByteSize;
 	}
 
-	// transfer data to the host coherent staging buffer
-	uint32_t firstMipByteSize = static_cast<uint32_t>(width) * static_cast<uint32_t>(height) * static_cast<uint32_t>(faces) * 4 * sizeof(float);
-	if (_vulkan.writeBufferData(stagingBuffer, hdrData, firstMipByteSize) != VK_SUCCESS)
+	VkBuffer stagingBuffer = _importStaging ? _importStaging(_imageFormat, regions) : VK_NULL_HANDLE;
+
+	if (stagingBuffer == VK_NULL_HANDLE)
 	{
-		return Result::VulkanError;
+		if (_vulkan.createBufferAndAllocate(stagingBuffer, stagingByteSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		uint8_t* stagingData = nullptr;
+		if (_vulkan.getMappedData(stagingBuffer, stagingData) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		// the input is decoded, converted or copied straight into the host coherent staging memory, a single pass over the data
+		TraceScope trace("writeStaging", static_cast<size_t>(stagingByteSize));
+		if (_writeStaging(stagingData, _imageFormat, regions) == false)
+		{
+			return Result::InvalidArgument;
+		}
+
+		if (_vulkan.flushBuffer(stagingBuffer) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 	}
 
 	// create the destination image we want to sample in the shader
@@ -105,9 +182,9 @@ Result uploadImage(vkHelper& _vulkan, int width, int height, int faces, const fl
 		_outImage,
 		width,
 		height,
-		VK_FORMAT_R32G32B32A32_SFLOAT,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		faces == 6 ? maxMipLevels : 1,
+		_imageFormat,
+		usage,
+		imageMipLevels,
 		faces,
 		VK_IMAGE_TILING_OPTIMAL,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
@@ -122,11 +199,15 @@ Result uploadImage(vkHelper& _vulkan, int width, int height, int faces, const fl
 		return Result::VulkanError;
 	}
 
+	const uint32_t profileStage = _vulkan.beginGpuStage(uploadCmds, "upload");
+
 	// transition to write dst layout
 	_vulkan.transitionImageToTransferWrite(uploadCmds, _outImage);
-	_vulkan.copyBufferToBasicImage2D(uploadCmds, stagingBuffer, _outImage);
+	_vulkan.copyBufferToImage2D(uploadCmds, stagingBuffer, _outImage, regions);
 	_vulkan.transitionImageToShaderRead(uploadCmds, _outImage);
 
+	_vulkan.endGpuStage(uploadCmds, profileStage);
+
 	if (_vulkan.endCommandBuffer(uploadCmds) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
@@ -143,33 +224,192 @@ Result uploadImage(vkHelper& _vulkan, int width, int height, int faces, const fl
 	return Result::Success;
 }
 
-Result uploadImage(vkHelper& _vulkan, const char* _inputPath, VkImage& _outImage, uint32_t& _defaultCubemapResolution, uint32_t explicitCubemapResolution, uint32_t explicitMipCount, bool& _isCubemap)
+// _levels holds the data of the first mip levels in _format, level 0 first, it is converted to the format of the image on the host.
+// Data that points into _dataFile may be imported instead of copied.
+Result uploadImage(vkHelper& _vulkan, ThreadPool* _pool, int width, int height, int faces, VkFormat _format, const std::vector<const uint8_t*>& _levels, VkFormat _imageFormat, uint32_t &_defaultCubemapResolution, uint32_t explicitCubemapResolution, uint32_t explicitMipCount, VkImage& _outImage, uint32_t& _outLevelCount, const MappedFile* _dataFile = nullptr)
 {
-	_outImage = VK_NULL_HANDLE;
+	const auto writeStaging = [_pool, faces, _format, &_levels](uint8_t* _staging, VkFormat _imageFormat, const std::vector<VkBufferImageCopy>& _regions)
+	{
+		std::vector<ConversionJob> jobs(_regions.size());
+		for (size_t level = 0; level < _regions.size(); ++level)
+		{
+			const VkExtent3D& extent = _regions[level].imageExtent;
+			jobs[level] = { _levels[level], _staging + _regions[level].bufferOffset, static_cast<size_t>(extent.width) * extent.height * faces };
+		}
+
+		return convertTexels(jobs.data(), jobs.size(), _imageFormat, _format, _pool);
+	};
 
+	// file data that needs no conversion is imported as the transfer source, so the GPU reads the pages of the file without a host copy
+	VkBuffer importedBuffer = VK_NULL_HANDLE;
+	const auto importStaging = [&_vulkan, _format, &_levels, _dataFile, &importedBuffer](VkFormat _imageFormat, std::vector<VkBufferImageCopy>& _regions)
 	{
-		std::ifstream inputFile(_inputPath, std::ios::binary);
+		VkBuffer buffer = VK_NULL_HANDLE;
+		const VkDeviceSize hostPointerAlignment = _vulkan.getHostPointerAlignment();
 
-		KTXHeader ktxHeader;
-		inputFile.read(reinterpret_cast<char *>(&ktxHeader), sizeof(ktxHeader));
-		if (inputFile.gcount() == sizeof(ktxHeader) && memcmp(ktxHeader.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0)
-		{
-			// This is a KTX2 file.
-			inputFile.seekg(sizeof(KTXIndex), std::ios_base::cur);
-			KTXLevelIndex ktxLevelIndex;
-			inputFile.read(reinterpret_cast<char *>(&ktxLevelIndex), sizeof(ktxLevelIndex));
-			inputFile.seekg(ktxLevelIndex.byteOffset, std::ios_base::beg);
-
-			std::vector<float> cubemapData;
-			cubemapData.resize(ktxLevelIndex.byteLength / sizeof(float));
-			inputFile.read(reinterpret_cast<char *>(&cubemapData[0]), ktxLevelIndex.byteLength);
-			if (static_cast<uint64_t>(inputFile.gcount()) != ktxLevelIndex.byteLength)
+		if (_dataFile == nullptr || _imageFormat != _format || hostPointerAlignment == 0u ||
+			reinterpret_cast<uintptr_t>(_dataFile->getData()) % hostPointerAlignment != 0u)
+		{
+			return buffer;
+		}
+
+		const size_t importByteSize = static_cast<size_t>((_dataFile->getSize() + hostPointerAlignment - 1u) / hostPointerAlignment * hostPointerAlignment);
+		const uint32_t formatByteSize = getFormatSize(_imageFormat);
+
+		for (size_t level = 0; level < _regions.size(); ++level)
+		{
+			const size_t dataOffset = _levels[level] - _dataFile->getData();
+			if (dataOffset % formatByteSize != 0u || dataOffset % 4u != 0u)
+			{
+				return buffer;
+			}
+		}
+
+		if (importByteSize <= _dataFile->getMappedSize() &&
+			_vulkan.importHostBuffer(buffer, _dataFile->getData(), importByteSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT) == VK_SUCCESS)
+		{
+			for (size_t level = 0; level < _regions.size(); ++level)
 			{
-				return Result::InputPanoramaFileNotFound;
+				_regions[level].bufferOffset = _levels[level] - _dataFile->getData();
 			}
 
-			_isCubemap = true;
-			return uploadImage(_vulkan, ktxHeader.pixelWidth, ktxHeader.pixelHeight, ktxHeader.faceCount, &cubemapData[0], _defaultCubemapResolution, explicitCubemapResolution, explicitMipCount, _outImage);
+			importedBuffer = buffer;
+		}
+
+		return buffer;
+	};
+
+	const Result res = uploadImage(_vulkan, width, height, faces, static_cast<uint32_t>(_levels.size()), _imageFormat, _defaultCubemapResolution, explicitCubemapResolution, explicitMipCount,
+		_outImage, _outLevelCount, writeStaging, importStaging);
+
+	// the imported memory must be freed before the file is unmapped, a successful upload has destroyed the buffer already
+	if (res != Result::Success)
+	{
+		_vulkan.destroyBuffer(importedBuffer);
+	}
+
+	return res;
+}
+
+// Maps a KTX2 file and locates its mip levels, level 0 first. _isKtx is false if the file is not a KTX2 file.
+Result loadKtxImage(const char* _inputPath, MappedFile& _outFile, bool& _isKtx, KTXHeader& _outHeader, std::vector<const uint8_t*>& _outLevels)
+{
+	const size_t levelIndexOffset = sizeof(KTXHeader) + sizeof(KTXIndex);
+
+	_isKtx = _outFile.open(_inputPath) && _outFile.getSize() >= levelIndexOffset + sizeof(KTXLevelIndex) &&
+		memcmp(_outFile.getData(), KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0;
+
+	if (!_isKtx)
+	{
+		_outFile.close();
+		return Result::Success;
+	}
+
+	memcpy(&_outHeader, _outFile.getData(), sizeof(_outHeader));
+
+	const VkFormat format = static_cast<VkFormat>(_outHeader.vkFormat);
+	if (format != VK_FORMAT_R32G32B32A32_SFLOAT && format != VK_FORMAT_R16G16B16A16_SFLOAT &&
+		format != VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 && format != VK_FORMAT_R8G8B8A8_UNORM)
+	{
+		printf("Input KTX2 format %u is not supported\n", _outHeader.vkFormat);
+		return Result::InvalidArgument;
+	}
+
+	if (_outHeader.supercompressionScheme != 0u)
+	{
+		printf("Supercompressed KTX2 inputs are not supported\n");
+		return Result::InvalidArgument;
+	}
+
+	if (_outHeader.pixelWidth == 0u || _outHeader.pixelHeight == 0u || _outHeader.pixelDepth != 0u || _outHeader.layerCount > 1u ||
+		(_outHeader.faceCount != 1u && _outHeader.faceCount != 6u) || (_outHeader.faceCount == 6u && _outHeader.pixelWidth != _outHeader.pixelHeight))
+	{
+		printf("Input KTX2 file is neither a 2D image nor a cube map\n");
+		return Result::InvalidArgument;
+	}
+
+	// a level count of 0 asks the loader to generate the mip levels
+	const uint32_t levelCount = std::max(_outHeader.levelCount, 1u);
+
+	if (_outFile.getSize() < levelIndexOffset + levelCount * sizeof(KTXLevelIndex))
+	{
+		return Result::InputPanoramaFileNotFound;
+	}
+
+	const size_t texelByteSize = getFormatSize(format);
+	size_t byteSize = 0u;
+
+	_outLevels.resize(levelCount);
+
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		KTXLevelIndex ktxLevelIndex;
+		memcpy(&ktxLevelIndex, _outFile.getData() + levelIndexOffset + level * sizeof(KTXLevelIndex), sizeof(ktxLevelIndex));
+
+		const size_t levelByteSize = static_cast<size_t>(std::max(_outHeader.pixelWidth >> level, 1u)) * std::max(_outHeader.pixelHeight >> level, 1u) *
+			_outHeader.faceCount * texelByteSize;
+
+		if (ktxLevelIndex.byteOffset > _outFile.getSize() || ktxLevelIndex.byteLength > _outFile.getSize() - ktxLevelIndex.byteOffset ||
+			ktxLevelIndex.byteLength < levelByteSize)
+		{
+			return Result::InputPanoramaFileNotFound;
+		}
+
+		_outLevels[level] = _outFile.getData() + ktxLevelIndex.byteOffset;
+		byteSize += levelByteSize;
+	}
+
+	TraceScope trace("loadKtxImage", byteSize);
+
+	return Result::Success;
+}
+
+Result uploadImage(vkHelper& _vulkan, ThreadPool* _pool, const char* _inputPath, VkFormat _intermediateFormat, VkImage& _outImage, uint32_t& _defaultCubemapResolution, uint32_t explicitCubemapResolution, uint32_t explicitMipCount, bool& _isCubemap, uint32_t& _outLevelCount)
+{
+	_outImage = VK_NULL_HANDLE;
+
+	const uint32_t profileStage = _vulkan.beginHostStage("decode");
+
+	{
+		bool isKtx = false;
+		KTXHeader ktxHeader;
+		MappedFile ktxFile;
+		std::vector<const uint8_t*> ktxLevels;
+
+		Result res = loadKtxImage(_inputPath, ktxFile, isKtx, ktxHeader, ktxLevels);
+		if (res != Result::Success)
+		{
+			return res;
+		}
+
+		if (isKtx)
+		{
+			const VkFormat ktxFormat = static_cast<VkFormat>(ktxHeader.vkFormat);
+
+			_vulkan.endHostStage(profileStage);
+			_isCubemap = ktxHeader.faceCount == 6u;
+			return uploadImage(_vulkan, _pool, ktxHeader.pixelWidth, ktxHeader.pixelHeight, ktxHeader.faceCount, ktxFormat, ktxLevels, getUploadFormat(_intermediateFormat, ktxFormat),
+				_defaultCubemapResolution, explicitCubemapResolution, explicitMipCount, _outImage, _outLevelCount, &ktxFile);
+		}
+	}
+
+	_isCubemap = false;
+
+	// Radiance files are decoded on the thread pool straight into the staging buffer, the decode stage ends with the staging write
+	{
+		HdrImage hdrImage;
+		if (hdrImage.open(_inputPath))
+		{
+			printf("Successfully loaded %s %u x %u x 3 \n", _inputPath, hdrImage.getWidth(), hdrImage.getHeight());
+
+			return uploadImage(_vulkan, hdrImage.getWidth(), hdrImage.getHeight(), 1, 1u, getUploadFormat(_intermediateFormat, VK_FORMAT_R32G32B32A32_SFLOAT),
+				_defaultCubemapResolution, explicitCubemapResolution, explicitMipCount, _outImage, _outLevelCount,
+				[&_vulkan, _pool, profileStage, &hdrImage](uint8_t* _staging, VkFormat _imageFormat, const std::vector<VkBufferImageCopy>&)
+			{
+				const bool decoded = hdrImage.decode(_staging, _imageFormat, _pool);
+				_vulkan.endHostStage(profileStage);
+				return decoded;
+			});
 		}
 	}
 
@@ -179,9 +419,10 @@ Result uploadImage(vkHelper& _vulkan, const char* _inputPath, VkImage& _outImage
 	{
 		return Result::InputPanoramaFileNotFound;
 	}
+	_vulkan.endHostStage(profileStage);
 
-	_isCubemap = false;
-	return uploadImage(_vulkan, panorama.getWidth(), panorama.getHeight(), 1, panorama.getHdrData(), _defaultCubemapResolution, explicitCubemapResolution, explicitMipCount, _outImage);
+	return uploadImage(_vulkan, _pool, panorama.getWidth(), panorama.getHeight(), 1, VK_FORMAT_R32G32B32A32_SFLOAT, { reinterpret_cast<const uint8_t*>(panorama.getHdrData()) },
+		getUploadFormat(_intermediateFormat, VK_FORMAT_R32G32B32A32_SFLOAT), _defaultCubemapResolution, explicitCubemapResolution, explicitMipCount, _outImage, _outLevelCount);
 }
 
 Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _srcImage, VkImage& _outImage, VkFormat _dstFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
@@ -216,6 +457,8 @@ Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer,
 	subresourceRange.baseMipLevel = 0;
 	subresourceRange.levelCount = mipLevels;
 	subresourceRange.layerCount = arrayLayers;
+
+	const uint32_t profileStage = _vulkan.beginGpuStage(_commandBuffer, "convertVkFormat");
 	
 	_vulkan.imageBarrier(_commandBuffer, _outImage,
 											 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -264,53 +507,102 @@ Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer,
 		currentSideLength = currentSideLength >> 1;
 	}
 
+	_vulkan.endGpuStage(_commandBuffer, profileStage);
+
 	return Result::Success;
 }
 
-void convertImageOnCPU(std::vector<uint8_t> &destBuffer, const std::vector<uint8_t> &srcBuffer, VkFormat destFormat, VkFormat srcFormat)
+// Receives one mip level converted to the target format, the six faces one after another. The data is only valid for the duration of the call.
+using LevelWriter = std::function<Result(uint32_t _level, uint32_t _sideLength, const uint8_t* _data, size_t _byteSize)>;
+
+// Compute pipeline of encode_b9g9r9e5.comp, created by Context::initialize for the Vulkan backends
+struct SharedExponentEncoder
+{
+	VkShaderModule shader = VK_NULL_HANDLE;
+	VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkSampler sampler = VK_NULL_HANDLE;
+};
+
+struct EncodePushConstant
+{
+	uint32_t mipLevel;
+	uint32_t sideLength;
+	uint32_t offset;
+};
+
+// Records the packing of all levels of _srcImage into _packedBuffer, level by level with the faces of a level one after another.
+// _levelOffsets holds the first texel of each level, the image is left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+Result encodeSharedExponent(vkHelper& _vulkan, const SharedExponentEncoder& _encoder, VkCommandBuffer _commandBuffer, const VkImage _srcImage, const VkImageLayout _srcImageLayout,
+	VkBuffer _packedBuffer, const std::vector<uint32_t>& _levelOffsets)
 {
-	if (destFormat == srcFormat) {
-		std::copy(srcBuffer.begin(), srcBuffer.end(), std::back_inserter(destBuffer));
-		return;
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	if (pInfo == nullptr)
+	{
+		return Result::InvalidArgument;
 	}
 
-	assert(destFormat == VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 && srcFormat == VK_FORMAT_R32G32B32A32_SFLOAT);
+	const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, pInfo->mipLevels, 0u, 6u };
 
-	for (uint32_t i = 0; i < srcBuffer.size() / 16; i++) {
-		float r = *(float *)&srcBuffer[i * 16 + 0];
-		float g = *(float *)&srcBuffer[i * 16 + 4];
-		float b = *(float *)&srcBuffer[i * 16 + 8];
-		float a = *(float *)&srcBuffer[i * 16 + 12];
+	VkImageView srcView = VK_NULL_HANDLE;
+	if (_vulkan.createImageView(srcView, _srcImage, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D_ARRAY) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	{
+		DescriptorSetInfo setLayout0;
+		setLayout0.addCombinedImageSampler(_encoder.sampler, srcView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0u, VK_SHADER_STAGE_COMPUTE_BIT);
+		setLayout0.addStorageBuffer(_packedBuffer, 0u, VK_WHOLE_SIZE, 1u, VK_SHADER_STAGE_COMPUTE_BIT);
 
-		// https://registry.khronos.org/OpenGL/extensions/EXT/EXT_texture_shared_exponent.txt
-		const float N = 9.0f, B = 15.0f;
-		const float sharedexpMax = 65408.0f;
-		float redC = fmaxf(0.0f, fminf(sharedexpMax, r));
-		float greenC = fmaxf(0.0f, fminf(sharedexpMax, g));
-		float blueC = fmaxf(0.0f, fminf(sharedexpMax, b));
+		if (setLayout0.allocate(_vulkan, _encoder.setLayout, descriptorSet) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 
-		float maxC = fmaxf(fmaxf(redC, greenC), blueC);
+		_vulkan.updateDescriptorSets(setLayout0.getWrites());
+	}
 
-		float expSharedP = fmaxf(-16.0f, floorf(log2f(maxC))) + 16.0f;
+	if (_srcImageLayout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+	{
+		_vulkan.imageBarrier(_commandBuffer, _srcImage,
+			_srcImageLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			subresourceRange);
+	}
 
-		float maxS = floorf(maxC / powf(2.0f, expSharedP - B - N) + 0.5f);
-		float expShared = maxS < 512.0f ? expSharedP : expSharedP + 1.0f;
+	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _encoder.pipeline);
+	_vulkan.bindDescriptorSet(_commandBuffer, _encoder.pipelineLayout, descriptorSet, VK_PIPELINE_BIND_POINT_COMPUTE);
 
-		float redS = floorf(redC / powf(2.0f, expShared - B - N) + 0.5f);
-		float greenS = floorf(greenC / powf(2.0f, expShared - B - N) + 0.5f);
-		float blueS = floorf(blueC / powf(2.0f, expShared - B - N) + 0.5f);
+	for (uint32_t level = 0; level < pInfo->mipLevels; level++)
+	{
+		EncodePushConstant values{};
+		values.mipLevel = level;
+		values.sideLength = std::max(pInfo->extent.width >> level, 1u);
+		values.offset = _levelOffsets[level];
 
-		uint32_t packedR = static_cast<uint32_t>(redS);
-		uint32_t packedG = static_cast<uint32_t>(greenS);
-		uint32_t packedB = static_cast<uint32_t>(blueS);
-		uint32_t packedE = static_cast<uint32_t>(expShared);
+		vkCmdPushConstants(_commandBuffer, _encoder.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(EncodePushConstant), &values);
 
-		uint32_t packed = packedR | (packedG << 9) | (packedB << 18) | (packedE << 27);
-		std::copy((uint8_t *)&packed, (uint8_t *)(&packed + 1), std::back_inserter(destBuffer));
+		// 8x8 work groups, one layer per cube face
+		const uint32_t groupCount = (values.sideLength + 7u) / 8u;
+		vkCmdDispatch(_commandBuffer, groupCount, groupCount, 6u);
 	}
+
+	// the host maps the buffer after the fence
+	VkMemoryBarrier hostBarrier{};
+	hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	hostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0u, 1u, &hostBarrier, 0u, nullptr, 0u, nullptr);
+
+	return Result::Success;
 }
 
-Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkFormat targetFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+Result downloadCubemap(vkHelper& _vulkan, ThreadPool* _pool, const SharedExponentEncoder* _encoder, const VkImage _srcImage, const LevelWriter& _writeLevel, const VkFormat targetFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
 {
 	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
 	if (pInfo == nullptr)
@@ -321,50 +613,35 @@ Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 	Result res = Success;
 
 	const VkFormat cubeMapFormat = pInfo->format;
-	const uint32_t cubeMapFormatByteSize = getFormatSize(cubeMapFormat);
-	const uint32_t targetFormatByteSize = getFormatSize(targetFormat);
 	const uint32_t cubeMapSideLength = pInfo->extent.width;
 	const uint32_t mipLevels = pInfo->mipLevels;
 
-	using Faces = std::vector<VkBuffer>;
-	using MipLevels = std::vector<Faces>;
-
-	MipLevels stagingBuffer(mipLevels);
-
+	size_t packedByteSize = 0u;
+	for (uint32_t level = 0; level < mipLevels; level++)
 	{
-		uint32_t currentSideLength = cubeMapSideLength;
-
-		for (uint32_t level = 0; level < mipLevels; level++)
-		{
-			Faces& faces = stagingBuffer[level];
-			faces.resize(6u);
+		const size_t sideLength = cubeMapSideLength >> level;
+		packedByteSize += sideLength * sideLength * 6u * 4u;
+	}
 
-			for (uint32_t face = 0; face < 6u; face++)
-			{
-				if (_vulkan.createBufferAndAllocate(
-																						faces[face], currentSideLength * currentSideLength * cubeMapFormatByteSize,
-																						VK_BUFFER_USAGE_TRANSFER_DST_BIT,// VkBufferUsageFlags _usage,
-																						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)//VkMemoryPropertyFlags _memoryFlags,
-						!= VK_SUCCESS)
-				{
-					return Result::VulkanError;
-				}
-			}
+	// B9G9R9E5 is packed on the GPU, so only a quarter of the RGBA32F data is read back
+	const bool encodeOnGpu = targetFormat == VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 && cubeMapFormat == VK_FORMAT_R32G32B32A32_SFLOAT &&
+		_encoder != nullptr && _encoder->pipeline != VK_NULL_HANDLE && packedByteSize <= _vulkan.getLimits().maxStorageBufferRange &&
+		packedByteSize <= _vulkan.getMaxAllocationSize();
 
-			currentSideLength = currentSideLength >> 1;
-		}
-	}
+	const VkFormat readbackFormat = encodeOnGpu ? targetFormat : cubeMapFormat;
+	const size_t readbackFormatByteSize = getFormatSize(readbackFormat);
+	const size_t targetFormatByteSize = getFormatSize(targetFormat);
 
-	VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
-	if (_vulkan.createCommandBuffer(downloadCmds) != VK_SUCCESS)
+	// all levels in one buffer with the faces of a level one after another, like the level data of KTX2
+	std::vector<size_t> levelOffsets(mipLevels + 1u);
+	for (uint32_t level = 0; level < mipLevels; level++)
 	{
-		return Result::VulkanError;
+		const size_t sideLength = cubeMapSideLength >> level;
+		levelOffsets[level + 1u] = levelOffsets[level] + sideLength * sideLength * 6u * readbackFormatByteSize;
 	}
 
-	if (_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+	// a chain that does not fit into one allocation is read back with one buffer per level
+	bool readbackPerLevel = encodeOnGpu == false && levelOffsets[mipLevels] > _vulkan.getMaxAllocationSize();
 
 	// barrier on complete image
 	VkImageSubresourceRange  subresourceRange{};
@@ -374,102 +651,169 @@ Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 	subresourceRange.baseMipLevel = 0u;
 	subresourceRange.levelCount = mipLevels;
 
-	_vulkan.imageBarrier(downloadCmds, _srcImage,
-											 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // src stage, access
-											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-											 subresourceRange);//dst stage, access
-
-	// copy all faces & levels into staging buffers
+	uint32_t endLevel = 0u;
+	for (uint32_t firstLevel = 0u; firstLevel < mipLevels && res == Result::Success; firstLevel = endLevel)
 	{
-		uint32_t currentSideLength = cubeMapSideLength;
+		endLevel = readbackPerLevel ? firstLevel + 1u : mipLevels;
 
-		VkBufferImageCopy region{};
+		// the host reads the whole buffer, cached memory makes that a lot faster than write combined memory
+		VkBuffer readbackBuffer = VK_NULL_HANDLE;
+		if (_vulkan.createBufferAndAllocate(readbackBuffer, levelOffsets[endLevel] - levelOffsets[firstLevel],
+			encodeOnGpu ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_TRANSFER_DST_BIT, _vulkan.getReadbackMemoryFlags()) != VK_SUCCESS)
+		{
+			_vulkan.destroyBuffer(readbackBuffer);
 
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.layerCount = 1u;
+			if (encodeOnGpu || readbackPerLevel)
+			{
+				return Result::VulkanError;
+			}
+
+			// retry the chain level by level
+			readbackPerLevel = true;
+			endLevel = firstLevel;
+			continue;
+		}
 
-		for (uint32_t level = 0; level < mipLevels; level++)
+		VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
+		if (_vulkan.createCommandBuffer(downloadCmds) != VK_SUCCESS)
 		{
-			region.imageSubresource.mipLevel = level;
-			Faces& faces = stagingBuffer[level];
+			return Result::VulkanError;
+		}
 
-			for (uint32_t face = 0; face < 6u; face++)
-			{
-				region.imageSubresource.baseArrayLayer = face;
-				region.imageExtent = { currentSideLength , currentSideLength , 1u };
+		if (_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		const uint32_t readbackStage = _vulkan.beginGpuStage(downloadCmds, encodeOnGpu ? "B9G9R9E5 encode" : "readback");
 
-				_vulkan.copyImage2DToBuffer(downloadCmds, _srcImage, faces[face], region);
+		if (encodeOnGpu)
+		{
+			// the encoder addresses the buffer in texels
+			std::vector<uint32_t> levelTexelOffsets(mipLevels);
+			for (uint32_t level = 0; level < mipLevels; level++)
+			{
+				levelTexelOffsets[level] = static_cast<uint32_t>(levelOffsets[level] / readbackFormatByteSize);
 			}
 
-			currentSideLength = currentSideLength >> 1;
+			if ((res = encodeSharedExponent(_vulkan, *_encoder, downloadCmds, _srcImage, inputImageLayout, readbackBuffer, levelTexelOffsets)) != Result::Success)
+			{
+				return res;
+			}
 		}
-	}
+		else
+		{
+			if (firstLevel == 0u)
+			{
+				_vulkan.imageBarrier(downloadCmds, _srcImage,
+														 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+														 // written by a render pass, the compute filter or a transfer (LambertianSH)
+														 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+														 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+														 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+														 subresourceRange);
+			}
 
-	if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+			// one region per level, the six layers of a level land one after another
+			std::vector<VkBufferImageCopy> regions(endLevel - firstLevel);
 
-	if (_vulkan.executeCommandBuffer(downloadCmds) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+			for (uint32_t level = firstLevel; level < endLevel; level++)
+			{
+				const uint32_t sideLength = cubeMapSideLength >> level;
+
+				VkBufferImageCopy& region = regions[level - firstLevel];
+				region.bufferOffset = levelOffsets[level] - levelOffsets[firstLevel];
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = level;
+				region.imageSubresource.baseArrayLayer = 0u;
+				region.imageSubresource.layerCount = 6u;
+				region.imageExtent = { sideLength, sideLength, 1u };
+			}
 
-	_vulkan.destroyCommandBuffer(downloadCmds);
+			_vulkan.copyImage2DToBuffer(downloadCmds, _srcImage, readbackBuffer, regions);
 
-	// Image is copied to buffer
-	// Now map buffer and copy to ram
-	{
-		KtxImage ktxImage(cubeMapSideLength, cubeMapSideLength, targetFormat, mipLevels, true);
+			// a shader read only image can be the shared input cube map of Distribution::None, which later outputs of the job sample
+			if (endLevel == mipLevels && inputImageLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			{
+				_vulkan.imageBarrier(downloadCmds, _srcImage,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+					subresourceRange);
+			}
 
-		std::vector<uint8_t> cubemapImageData, targetImageData;
+			// the host maps the buffer after the fence
+			VkMemoryBarrier hostBarrier{};
+			hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(downloadCmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0u, 1u, &hostBarrier, 0u, nullptr, 0u, nullptr);
+		}
+
+		_vulkan.endGpuStage(downloadCmds, readbackStage);
 
-		uint32_t currentSideLength = cubeMapSideLength;
+		if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 
-		for (uint32_t level = 0; level < mipLevels; level++)
+		if (_vulkan.executeCommandBuffer(downloadCmds) != VK_SUCCESS)
 		{
-			const size_t cubemapByteSize = (size_t)currentSideLength * (size_t)currentSideLength * (size_t)cubeMapFormatByteSize;
-			const size_t targetByteSize = (size_t)currentSideLength * (size_t)currentSideLength * (size_t)targetFormatByteSize;
-			cubemapImageData.resize(cubemapByteSize);
+			return Result::VulkanError;
+		}
+
+		_vulkan.destroyCommandBuffer(downloadCmds);
 
-			Faces& faces = stagingBuffer[level];
+		// Image is copied to buffer
+		// Now map buffer and hand the levels to the writer
+		{
+			const uint32_t conversionStage = _vulkan.beginHostStage("format conversion");
 
-			for (uint32_t face = 0; face < 6u; face++)
+			uint8_t* readbackData = nullptr;
+			if (_vulkan.getMappedData(readbackBuffer, readbackData) != VK_SUCCESS || _vulkan.invalidateBuffer(readbackBuffer) != VK_SUCCESS)
 			{
-				if (_vulkan.readBufferData(faces[face], cubemapImageData.data(), cubemapByteSize) != VK_SUCCESS)
-				{
-					return Result::VulkanError;
-				}
+				return Result::VulkanError;
+			}
 
-				targetImageData.clear();
-				convertImageOnCPU(targetImageData, cubemapImageData, targetFormat, cubeMapFormat);
+			std::vector<uint8_t> targetLevelData;
 
-				res = ktxImage.writeFace(targetImageData, face, level);
+			for (uint32_t level = firstLevel; level < endLevel && res == Result::Success; level++)
+			{
+				const uint32_t sideLength = cubeMapSideLength >> level;
+				const size_t texelCount = static_cast<size_t>(sideLength) * sideLength * 6u;
+				const uint8_t* levelData = readbackData + (levelOffsets[level] - levelOffsets[firstLevel]);
 
-				if (res != Result::Success)
+				// without a conversion the writer reads straight from the mapped memory
+				if (readbackFormat == targetFormat)
 				{
-					return res;
+					res = _writeLevel(level, sideLength, levelData, texelCount * targetFormatByteSize);
+				}
+				else
+				{
+					targetLevelData.resize(texelCount * targetFormatByteSize);
+
+					if (convertTexels(targetLevelData.data(), targetFormat, levelData, readbackFormat, texelCount, _pool) == false)
+					{
+						res = Result::InvalidArgument;
+					}
+					else
+					{
+						res = _writeLevel(level, sideLength, targetLevelData.data(), targetLevelData.size());
+					}
 				}
-
-				_vulkan.destroyBuffer(faces[face]);
 			}
 
-			currentSideLength = currentSideLength >> 1;
-		}
+			_vulkan.destroyBuffer(readbackBuffer);
 
-		res = ktxImage.save(_outputPath);
-		if (res != Result::Success)
-		{
-			printf("Could not save to path %s \n", _outputPath);
-			return res;
+			_vulkan.endHostStage(conversionStage);
 		}
 	}
 
-	return Result::Success;
+	return res;
 }
 
-Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+Result downloadCubemap(vkHelper& _vulkan, ThreadPool* _pool, const SharedExponentEncoder* _encoder, const VkImage _srcImage, const char* _outputPath, const VkFormat targetFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	const KtxKeyValues& _keyValues = KtxKeyValues())
 {
 	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
 	if (pInfo == nullptr)
@@ -477,10 +821,133 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 		return Result::InvalidArgument;
 	}
 
-	Result res = Success;
+	// The levels are written to the file straight from the mapped readback memory, only a format conversion needs one more level of host memory.
+	// The readback buffer holds the whole chain unless it is larger than one allocation.
+	KtxImage ktxImage(pInfo->extent.width, pInfo->extent.width, targetFormat, pInfo->mipLevels, true, _keyValues);
 
-	const VkFormat format = pInfo->format;
-	const uint32_t formatByteSize = getFormatSize(format);
+	Result res = ktxImage.open(_outputPath);
+	if (res != Result::Success)
+	{
+		printf("Could not save to path %s \n", _outputPath);
+		return res;
+	}
+
+	res = downloadCubemap(_vulkan, _pool, _encoder, _srcImage, [&ktxImage](uint32_t _level, uint32_t, const uint8_t* _data, size_t _byteSize)
+	{
+		return ktxImage.writeLevel(_data, _byteSize, _level);
+	}, targetFormat, inputImageLayout);
+
+	if (res != Result::Success)
+	{
+		return res;
+	}
+
+	const uint32_t profileStage = _vulkan.beginHostStage("KTX write");
+	res = ktxImage.close();
+	if (res != Result::Success)
+	{
+		printf("Could not save to path %s \n", _outputPath);
+		return res;
+	}
+	_vulkan.endHostStage(profileStage);
+
+	return Result::Success;
+}
+
+// Forwards the levels to the level callback or copies them into the caller's buffer
+Result createLevelWriter(const OutputBuffers& _output, uint32_t _sideLength, uint32_t _mipLevels, const VkFormat targetFormat, LevelWriter& _outWriter)
+{
+	if (_output.levelCallback != nullptr)
+	{
+		_outWriter = [_output](uint32_t _level, uint32_t _sideLength, const uint8_t* _data, size_t _byteSize)
+		{
+			_output.levelCallback(_output.userData, _level, _sideLength, _data, _byteSize);
+			return Result::Success;
+		};
+
+		return Result::Success;
+	}
+
+	if (_output.cubeMapData != nullptr)
+	{
+		const size_t targetFormatByteSize = getFormatSize(targetFormat);
+
+		std::vector<size_t> levelOffsets(_mipLevels);
+		size_t byteSize = 0u;
+
+		for (uint32_t level = 0; level < _mipLevels; level++)
+		{
+			const size_t sideLength = _sideLength >> level;
+			levelOffsets[level] = byteSize;
+			byteSize += sideLength * sideLength * 6u * targetFormatByteSize;
+		}
+
+		if (_output.cubeMapByteSize < byteSize)
+		{
+			printf("Output buffer too small, %zu bytes needed\n", byteSize);
+			return Result::InvalidArgument;
+		}
+
+		uint8_t* cubeMapData = static_cast<uint8_t*>(_output.cubeMapData);
+
+		_outWriter = [cubeMapData, levelOffsets](uint32_t _level, uint32_t, const uint8_t* _data, size_t _byteSize)
+		{
+			memcpy(cubeMapData + levelOffsets[_level], _data, _byteSize);
+			return Result::Success;
+		};
+
+		return Result::Success;
+	}
+
+	_outWriter = [](uint32_t, uint32_t, const uint8_t*, size_t)
+	{
+		return Result::Success;
+	};
+
+	return Result::Success;
+}
+
+Result copyLUT(const OutputBuffers& _output, const std::vector<uint8_t>& _LUTData)
+{
+	if (_output.LUTByteSize < _LUTData.size())
+	{
+		printf("LUT buffer too small, %zu bytes needed\n", _LUTData.size());
+		return Result::InvalidArgument;
+	}
+
+	memcpy(_output.LUTData, _LUTData.data(), _LUTData.size());
+
+	return Result::Success;
+}
+
+Result downloadCubemap(vkHelper& _vulkan, ThreadPool* _pool, const SharedExponentEncoder* _encoder, const VkImage _srcImage, const OutputBuffers& _output, const VkFormat targetFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	if (pInfo == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	LevelWriter writeLevel;
+	Result res = createLevelWriter(_output, pInfo->extent.width, pInfo->mipLevels, targetFormat, writeLevel);
+	if (res != Result::Success)
+	{
+		return res;
+	}
+
+	return downloadCubemap(_vulkan, _pool, _encoder, _srcImage, writeLevel, targetFormat, inputImageLayout);
+}
+
+Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, std::vector<uint8_t>& _outImageData, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	if (pInfo == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	const VkFormat format = pInfo->format;
+	const uint32_t formatByteSize = getFormatSize(format);
 	const uint32_t width = pInfo->extent.width;
 	const uint32_t height = pInfo->extent.width;
 	const size_t imageByteSize = width * height * formatByteSize;
@@ -488,9 +955,9 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 	VkBuffer stagingBuffer{};
 
 	if (_vulkan.createBufferAndAllocate(
-																			stagingBuffer, static_cast<uint32_t>(imageByteSize),
+																			stagingBuffer, imageByteSize,
 																			VK_BUFFER_USAGE_TRANSFER_DST_BIT,// VkBufferUsageFlags _usage,
-																			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)//VkMemoryPropertyFlags _memoryFlags,
+																			_vulkan.getReadbackMemoryFlags())//VkMemoryPropertyFlags _memoryFlags,
 			!= VK_SUCCESS)
 	{
 		return Result::VulkanError;
@@ -515,6 +982,8 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 	subresourceRange.baseMipLevel = 0u;
 	subresourceRange.levelCount = 1u;
 
+	const uint32_t profileStage = _vulkan.beginGpuStage(downloadCmds, "LUT readback");
+
 	_vulkan.imageBarrier(downloadCmds, _srcImage,
 											 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // src stage, access
@@ -534,6 +1003,8 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 		_vulkan.copyImage2DToBuffer(downloadCmds, _srcImage, stagingBuffer, region);
 	}
 
+	_vulkan.endGpuStage(downloadCmds, profileStage);
+
 	if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
@@ -548,18 +1019,25 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 
 	// Image is copied to buffer
 	// Now map buffer and copy to ram
+	_outImageData.resize(imageByteSize);
+
+	if (_vulkan.readBufferData(stagingBuffer, _outImageData.data(), imageByteSize) != VK_SUCCESS)
 	{
+		return Result::VulkanError;
+	}
+
+	_vulkan.destroyBuffer(stagingBuffer);
 
-		std::vector<uint8_t> imageData;
-		imageData.resize(imageByteSize);
+	return Result::Success;
+}
 
-		if (_vulkan.readBufferData(stagingBuffer, imageData.data(), imageByteSize) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
+Result saveLUT(const char* _outputPath, const std::vector<uint8_t>& imageData, const uint32_t width, const uint32_t height, const VkFormat format)
+{
+	Result res = Success;
 
+	{
 		// Compute channel count by dividing the pixel byte length through each channels byte length.
-		const uint32_t channels = getChannelCount(pInfo->format);
+		const uint32_t channels = getChannelCount(format);
 
 		// Copy the outputted image (format with 1, 2 or 4 channels) into a 3-channel image.
 		// This is kind of a hack (this function is currently only used to write the BRDF LUT to disk):
@@ -583,20 +1061,41 @@ Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 		{
 			return res;
 		}
-
-		_vulkan.destroyBuffer(stagingBuffer);
 	}
 
 	return Result::Success;
 }
 
-void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _image, uint32_t _maxMipLevels, uint32_t _sideLength, const VkImageLayout _currentImageLayout)
+Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	if (pInfo == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	std::vector<uint8_t> imageData;
+	Result res = download2DImage(_vulkan, _srcImage, imageData, inputImageLayout);
+	if (res != Result::Success)
+	{
+		return res;
+	}
+
+	const uint32_t profileStage = _vulkan.beginHostStage("LUT write");
+	res = saveLUT(_outputPath, imageData, pInfo->extent.width, pInfo->extent.width, pInfo->format);
+	_vulkan.endHostStage(profileStage);
+
+	return res;
+}
+
+// Blits the levels from _firstLevel on, the levels before it already hold data
+void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _image, uint32_t _maxMipLevels, uint32_t _sideLength, const VkImageLayout _currentImageLayout, uint32_t _firstLevel = 1u)
 {
 	{
 		VkImageSubresourceRange mipbaseRange{};
 		mipbaseRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		mipbaseRange.baseMipLevel = 0u;
-		mipbaseRange.levelCount = 1u;
+		mipbaseRange.levelCount = _firstLevel;
 		mipbaseRange.layerCount = 6u;
 
 		_vulkan.imageBarrier(_commandBuffer, _image,
@@ -606,7 +1105,7 @@ void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffe
 												 mipbaseRange);
 	}
 
-	for (uint32_t i = 1; i < _maxMipLevels; i++)
+	for (uint32_t i = _firstLevel; i < _maxMipLevels; i++)
 	{
 		VkImageBlit imageBlit{};
 
@@ -674,178 +1173,288 @@ void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffe
 	}
 }
 
-Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, /*const VkRenderPass _renderPass,*/ const VkShaderModule fullscreenVertexShader, const VkImage _panoramaImage, const VkImage _cubeMapImage)
+//Push Constants for specular and diffuse filter passes
+struct FilterPushConstant
 {
-	IBLLib::Result res = Result::Success;
+	float roughness = 0.f;
+	uint32_t mipLevel = 1u;
+	uint32_t width = 1024u;
+	float lodBias = 0.f;
+};
 
-	const VkImageCreateInfo* textureInfo = _vulkan.getCreateInfo(_cubeMapImage);
+// size of SampleTable.levels in filter.frag
+const uint32_t MaxSampleTableLevels = 32u;
 
-	if (textureInfo == nullptr)
+// byte size of SampleTable.levels, also the largest minStorageBufferOffsetAlignment the specification allows
+const uint32_t SampleTableHeaderByteSize = MaxSampleTableLevels * 2u * sizeof(uint32_t);
+
+// The samples of one mip level that a filter pass accumulates
+struct SampleSlice
+{
+	uint32_t sampleCount = 0u;
+	float weight = 1.f; // share of the slice in the filtered color, the blend constant of the pass
+};
+
+// Uploads the importance samples of all mip levels of an output, the layout matches the SampleTable block in filter.frag:
+// the first sample and sample count of every level followed by the samples.
+// With several slices the buffer starts with one SampleTable.levels header per slice. Slice s is bound at the dynamic offset
+// s * SampleTableHeaderByteSize, its header points at its part of the samples behind the last header.
+// _outSlices holds the slices of every level, level by level.
+Result createSampleTable(vkHelper& _vulkan, const OutputDesc& _output, uint32_t _mipLevels, uint32_t _inputSideLength, uint32_t _sliceCount,
+	VkBuffer& _outBuffer, std::vector<SampleSlice>& _outSlices)
+{
+	if (_mipLevels > MaxSampleTableLevels)
 	{
+		printf("Error: At most %u mip levels are supported\n", MaxSampleTableLevels);
 		return Result::InvalidArgument;
 	}
 
-	const uint32_t cubeMapSideLength = textureInfo->extent.width;
-	const uint32_t maxMipLevels = textureInfo->mipLevels;
-	const VkFormat format = textureInfo->format;
+	const uint32_t entriesPerHeader = SampleTableHeaderByteSize / sizeof(SampleTableEntry);
 
-	VkShaderModule panoramaToCubeMapFragmentShader = VK_NULL_HANDLE;
-	if ((res = compileShader(
-		_vulkan,
-		panoramaToCubeMapFragmentShader,
-		panoramaToCubeMapShaderSource,
-		sizeof(panoramaToCubeMapShaderSource) / sizeof(panoramaToCubeMapShaderSource[0]))) !=
-		Result::Success)
-	{
-		return res;
-	}
+	std::vector<uint32_t> levels(MaxSampleTableLevels * 2u * _sliceCount, 0u);
+	std::vector<SampleTableEntry> samples;
+	std::vector<SampleTableEntry> levelSamples;
 
-	VkRenderPass renderPass = VK_NULL_HANDLE;
+	_outSlices.assign(_mipLevels * _sliceCount, SampleSlice());
+
+	for (uint32_t level = 0; level < _mipLevels; ++level)
 	{
-		RenderPassDesc renderPassDesc;
+		const float roughness = _mipLevels > 1u ? static_cast<float>(level) / static_cast<float>(_mipLevels - 1u) : 0.f;
+		computeSampleTable(_output.distribution, roughness, _output.sampleCount, _inputSideLength, _output.lodBias, levelSamples);
 
-		// add rendertargets (cubemap faces)
-		for (int face = 0; face < 6; ++face)
+		const uint32_t levelSampleCount = static_cast<uint32_t>(levelSamples.size());
+
+		// filter.frag normalizes GGX and Charlie by the summed NdotL of the samples it takes and Lambertian by the sample count
+		float totalWeight = 0.f;
+		for (const SampleTableEntry& entry : levelSamples)
 		{
-			renderPassDesc.addAttachment(format);
+			totalWeight += entry.direction[2];
 		}
-		if (_vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
+
+		for (uint32_t slice = 0; slice < _sliceCount; ++slice)
 		{
-			return Result::VulkanError;
+			const uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(levelSampleCount) * slice / _sliceCount);
+			const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(levelSampleCount) * (slice + 1u) / _sliceCount);
+
+			uint32_t* header = &levels[slice * MaxSampleTableLevels * 2u];
+			header[level * 2u] = static_cast<uint32_t>(samples.size()) + begin + (_sliceCount - 1u - slice) * entriesPerHeader;
+			header[level * 2u + 1u] = end - begin;
+
+			SampleSlice& sampleSlice = _outSlices[level * _sliceCount + slice];
+			sampleSlice.sampleCount = end - begin;
+
+			if (_output.distribution != Distribution::Lambertian && totalWeight > 0.f)
+			{
+				float weight = 0.f;
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					weight += levelSamples[i].direction[2];
+				}
+				sampleSlice.weight = weight / totalWeight;
+			}
 		}
+
+		samples.insert(samples.end(), levelSamples.begin(), levelSamples.end());
 	}
 
-	VkSamplerCreateInfo samplerInfo{};
-	_vulkan.fillSamplerCreateInfo(samplerInfo);
+	const size_t levelsByteSize = levels.size() * sizeof(uint32_t);
+	std::vector<uint8_t> data(levelsByteSize + samples.size() * sizeof(SampleTableEntry));
+	memcpy(data.data(), levels.data(), levelsByteSize);
+	if (samples.empty() == false)
+	{
+		memcpy(data.data() + levelsByteSize, samples.data(), samples.size() * sizeof(SampleTableEntry));
+	}
 
-	samplerInfo.maxLod = float(maxMipLevels + 1);
-	VkSampler panoramaSampler = VK_NULL_HANDLE;
-	if (_vulkan.createSampler(panoramaSampler, samplerInfo) != VK_SUCCESS)
+	if (_vulkan.createBufferAndAllocate(_outBuffer, data.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	VkImageView panoramaImageView = VK_NULL_HANDLE;
-	if (_vulkan.createImageView(panoramaImageView, _panoramaImage) != VK_SUCCESS)
+	if (_vulkan.writeBufferData(_outBuffer, data.data(), data.size()) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	VkPipelineLayout panoramaPipelineLayout = VK_NULL_HANDLE;
-	VkDescriptorSet panoramaSet = VK_NULL_HANDLE;
-	VkPipeline panoramaToCubeMapPipeline = VK_NULL_HANDLE;
-	{
-		//
-		// Create pipeline layout
-		//
-		VkDescriptorSetLayout panoramaSetLayout = VK_NULL_HANDLE;
-		DescriptorSetInfo setLayout0;
-		setLayout0.addCombinedImageSampler(panoramaSampler, panoramaImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	return Result::Success;
+}
 
-		if (setLayout0.create(_vulkan, panoramaSetLayout, panoramaSet) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
+// texels per face side of the sampled Lambertian reference that Distribution::LambertianSH outputs are compared to
+const uint32_t SHErrorSideLength = 8u;
 
-		_vulkan.updateDescriptorSets(setLayout0.getWrites());
+// first mip level of an input cube map that is small enough for the SH projection, or its last level
+uint32_t getSHProjectionLevel(uint32_t _inputSideLength, uint32_t _inputMipLevels)
+{
+	uint32_t level = 0u;
+	while (level + 1u < _inputMipLevels && (_inputSideLength >> level) > SHProjectionSideLength)
+	{
+		++level;
+	}
+	return level;
+}
+
+// The SH9 coefficients as text for the KTX2 key/value data, empty for outputs of other distributions
+KtxKeyValues createSHKeyValues(const std::vector<float>& _SHCoefficients)
+{
+	KtxKeyValues keyValues;
 
-		if (_vulkan.createPipelineLayout(panoramaPipelineLayout, panoramaSetLayout) != VK_SUCCESS)
+	if (_SHCoefficients.empty() == false)
+	{
+		std::string value;
+		char number[32];
+		for (size_t i = 0; i < _SHCoefficients.size(); ++i)
 		{
-			return Result::VulkanError;
+			snprintf(number, sizeof(number), i == 0 ? "%.9g" : " %.9g", _SHCoefficients[i]);
+			value += number;
 		}
 
-		GraphicsPipelineDesc panoramaToCubePipeline;
-
-		panoramaToCubePipeline.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
-		panoramaToCubePipeline.addShaderStage(panoramaToCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "main");
+		keyValues.emplace_back("GltfIblSampler.SH9", value);
+	}
 
-		panoramaToCubePipeline.setRenderPass(renderPass);
-		panoramaToCubePipeline.setPipelineLayout(panoramaPipelineLayout);
+	return keyValues;
+}
 
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
+void printSHError(const CpuCubeMap& _input, const float (&_coefficients)[SH9CoefficientCount], const OutputDesc& _output)
+{
+	// like the Lambertian filter, the reference only samples the first level
+	float meanError = 0.f, maxError = 0.f;
+	measureSH9ErrorOnCPU(_input, 1u, _coefficients, _output.sampleCount, _output.lodBias, SHErrorSideLength, meanError, maxError);
 
-		panoramaToCubePipeline.addColorBlendAttachment(colorBlendAttachment,6);
+	printf("SH9 irradiance error against %u samples: mean %.2f%%, max %.2f%%\n", _output.sampleCount, meanError * 100.f, maxError * 100.f);
+}
 
-		panoramaToCubePipeline.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
+// Specialization constants of filter.frag, the driver removes the code paths a variant does not need
+struct FilterVariant
+{
+	Distribution distribution = Distribution::Lambertian;
+	uint32_t sampleCount = 1024u;
+	bool writeLUT = true;
 
-		if (_vulkan.createPipeline(panoramaToCubeMapPipeline, panoramaToCubePipeline.getInfo()) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
-	}
+	// not a specialization constant: the faces are added to the attachments, scaled by the blend constants (sample slices)
+	bool accumulate = false;
 
-	/// Render Pass
-	std::vector<VkImageView> inputCubeMapViews(6u, VK_NULL_HANDLE);
-	for (size_t i = 0; i < inputCubeMapViews.size(); i++)
+	bool operator==(const FilterVariant& _other) const
 	{
-		if (_vulkan.createImageView(inputCubeMapViews[i], _cubeMapImage, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, static_cast<uint32_t>(i), 1u }) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
+		return distribution == _other.distribution && sampleCount == _other.sampleCount && writeLUT == _other.writeLUT && accumulate == _other.accumulate;
 	}
+};
 
-	VkFramebuffer cubeMapInputFramebuffer = VK_NULL_HANDLE;
-	if (_vulkan.createFramebuffer(cubeMapInputFramebuffer, renderPass, cubeMapSideLength, cubeMapSideLength, inputCubeMapViews, 1u) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+// Device, shader modules, samplers, layouts and pipelines that are shared by all jobs of a context.
+// Render passes and pipelines depend on the attachment formats and filter variants, they are created on first use
+// and go through the pipeline cache of vkHelper.
+class Context
+{
+public:
+	Result initialize(bool _debugOutput, Backend _backend = Backend::Vulkan);
 
-	{
-		VkImageSubresourceRange  subresourceRangeBaseMiplevel = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u };
+	Result getPanoramaToCubeMapPipeline(VkFormat _cubeMapFormat, VkRenderPass& _outRenderPass, VkPipeline& _outPipeline);
+	// the render passes of the formats only differ in the load op of the attachments and are compatible with all filter pipelines
+	Result getFilterRenderPass(VkFormat _cubeMapFormat, VkFormat _LUTFormat, VkAttachmentLoadOp _loadOp, VkRenderPass& _outRenderPass);
+	Result getFilterPipeline(VkFormat _cubeMapFormat, VkFormat _LUTFormat, const FilterVariant& _variant, VkPipeline& _outPipeline);
+	Result getFilterComputePipeline(const FilterVariant& _variant, VkPipeline& _outPipeline);
 
-		_vulkan.imageBarrier(_commandBuffer, _cubeMapImage,
-												 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-												 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,// src stage, access
-												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, //dst stage, access
-												 subresourceRangeBaseMiplevel);
-	}
+	// Shuts the lost device down and initializes a new one, the next attempt of the job uses half the tile size.
+	// Fails with Result::DeviceLost if the tiles would get smaller than MinRetryTileSize.
+	Result recreateLostDevice();
 
-	_vulkan.bindDescriptorSet(_commandBuffer, panoramaPipelineLayout, panoramaSet);
+	Backend backend = Backend::Vulkan;
+	bool debugOutput = false;
 
-	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, panoramaToCubeMapPipeline);
+	SubmitOptions submitOptions{};
 
-	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+	// format of the input cube map and its mip levels
+	VkFormat intermediateFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
 
-	_vulkan.beginRenderPass(_commandBuffer, renderPass, cubeMapInputFramebuffer, VkRect2D{ 0u, 0u, cubeMapSideLength, cubeMapSideLength }, clearValues);
-	vkCmdDraw(_commandBuffer, 3, 1u, 0, 0);
-	_vulkan.endRenderPass(_commandBuffer);
+	bool profiling = false;
+	std::vector<ProfileStage> profile;
 
-	return res;
-}
-} // !IBLLib
+	// largest tile side length filtered by the current job, the start of the retry after a device lost
+	uint32_t largestTileSize = 0u;
 
+	vkHelper vulkan;
 
-IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput)
-{
-	const VkFormat cubeMapFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
-	const VkFormat LUTFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	// filters of Backend::CPU and the host format conversions of all backends
+	std::unique_ptr<ThreadPool> threadPool;
 
-	IBLLib::Result res = Result::Success;
+	VkShaderModule fullscreenVertexShader = VK_NULL_HANDLE;
+	VkShaderModule panoramaToCubeMapFragmentShader = VK_NULL_HANDLE;
+	VkShaderModule filterCubeMapFragmentShader = VK_NULL_HANDLE;
+	VkShaderModule filterCubeMapComputeShader = VK_NULL_HANDLE;
 
-	vkHelper vulkan;
+	VkSampler sampler = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout panoramaSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout panoramaPipelineLayout = VK_NULL_HANDLE;
 
-	if (vulkan.initialize(0u, 1u, _debugOutput) != VK_SUCCESS)
+	VkDescriptorSetLayout filterSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout filterPipelineLayout = VK_NULL_HANDLE;
+
+	// packs B9G9R9E5 outputs before the readback
+	SharedExponentEncoder sharedExponentEncoder;
+
+	// only created for Backend::VulkanCompute
+	VkDescriptorSetLayout filterComputeSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout filterComputePipelineLayout = VK_NULL_HANDLE;
+
+private:
+	struct Pipeline
 	{
-		return Result::VulkanInitializationFailed;
-	}
+		VkFormat cubeMapFormat = VK_FORMAT_UNDEFINED;
+		VkFormat LUTFormat = VK_FORMAT_UNDEFINED;
+		FilterVariant variant;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+	};
 
-	VkImage panoramaImage;
-	bool inputIsCubemap;
+	struct RenderPass
+	{
+		VkFormat cubeMapFormat = VK_FORMAT_UNDEFINED;
+		VkFormat LUTFormat = VK_FORMAT_UNDEFINED;
+		VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+	};
 
-	uint32_t defaultCubemapResolution = 0;
-	if ((res = uploadImage(vulkan, _inputPath, panoramaImage, defaultCubemapResolution, _cubemapResolution, _mipmapCount, inputIsCubemap)) != Result::Success)
+	std::vector<Pipeline> m_panoramaToCubeMapPipelines;
+	std::vector<RenderPass> m_filterRenderPasses;
+	std::vector<Pipeline> m_filterPipelines;
+	std::vector<Pipeline> m_filterComputePipelines;
+};
+
+// smallest tile side length a job is restarted with after a device lost
+const uint32_t MinRetryTileSize = 64u;
+
+// time budget of the restarted job if the options had none, well below the two seconds of the Windows TDR default
+const uint32_t RetryTimeBudgetMs = 250u;
+
+void addSpecConstants(SpecConstantFactory& _factory, const FilterVariant& _variant)
+{
+	_factory.addConstant(static_cast<uint32_t>(_variant.distribution), 0u);
+	_factory.addConstant(_variant.sampleCount, 1u);
+	_factory.addConstant(static_cast<VkBool32>(_variant.writeLUT ? VK_TRUE : VK_FALSE), 2u);
+}
+
+Result Context::initialize(bool _debugOutput, Backend _backend)
+{
+	IBLLib::Result res = Result::Success;
+
+	backend = _backend;
+	debugOutput = _debugOutput;
+
+	threadPool.reset(new ThreadPool());
+
+	if (_backend == Backend::CPU)
 	{
-		return res;
+		return Result::Success;
 	}
 
-	if (_cubemapResolution == 0)
+	// every output of a job allocates its own filter descriptor set, the compute path one per mip level
+	const uint32_t descriptorPoolSizeFactor = _backend == Backend::VulkanCompute ? 32u : 8u;
+
+	if (vulkan.initialize(0u, descriptorPoolSizeFactor, _debugOutput) != VK_SUCCESS)
 	{
-		_cubemapResolution = defaultCubemapResolution;
+		return Result::VulkanInitializationFailed;
 	}
 
-	VkShaderModule fullscreenVertexShader = VK_NULL_HANDLE;
 	if ((res = compileShader(
 		vulkan,
 		fullscreenVertexShader,
@@ -856,7 +1465,16 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 		return res;
 	}
 
-	VkShaderModule filterCubeMapFragmentShader = VK_NULL_HANDLE;
+	if ((res = compileShader(
+		vulkan,
+		panoramaToCubeMapFragmentShader,
+		panoramaToCubeMapShaderSource,
+		sizeof(panoramaToCubeMapShaderSource) / sizeof(panoramaToCubeMapShaderSource[0]))) !=
+		Result::Success)
+	{
+		return res;
+	}
+
 	if ((res = compileShader(
 		vulkan,
 		filterCubeMapFragmentShader,
@@ -867,389 +1485,2078 @@ IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCub
 		return res;
 	}
 
-	VkExtent3D panoramaExtent = vulkan.getCreateInfo(panoramaImage)->extent;
-	_mipmapCount = _mipmapCount != 0 ? _mipmapCount : static_cast<uint32_t>(floor(log2(_cubemapResolution)));
-
-	const uint32_t cubeMapSideLength = _cubemapResolution;
-	const uint32_t maxMipLevels = _distribution == Distribution::Lambertian ? 1u : _mipmapCount;
-
-	if ((_cubemapResolution >> (maxMipLevels - 1)) < 1)
-	{
-		printf("Error: CubemapResolution incompatible with MipmapCount\n");
-		return Result::InvalidArgument;
-	}
-	
-	VkSampler cubeMipMapSampler = VK_NULL_HANDLE;
 	{
+		// the image views limit the accessible mip levels
 		VkSamplerCreateInfo samplerInfo{};
 		vulkan.fillSamplerCreateInfo(samplerInfo);
-		samplerInfo.maxLod = float(maxMipLevels + 1);
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
-		if (vulkan.createSampler(cubeMipMapSampler, samplerInfo) != VK_SUCCESS)
+		if (vulkan.createSampler(sampler, samplerInfo) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
-	
-	VkImage inputCubeMap = VK_NULL_HANDLE;
-	VkImageLayout currentInputCubeMapLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-	//VK_IMAGE_USAGE_TRANSFER_SRC_BIT needed for transfer to staging buffer
-	if (!inputIsCubemap)
 	{
-		if (vulkan.createImage2DAndAllocate(inputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
-																				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-																				maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+		DescriptorSetInfo setLayout0;
+		setLayout0.addCombinedImageSampler(sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		if (vulkan.createDecriptorSetLayout(panoramaSetLayout, setLayout0.getLayoutCreateInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
-	}
-	else
-	{
-		inputCubeMap = panoramaImage;
-	}
-
-	VkImageView inputCubeMapCompleteView = VK_NULL_HANDLE;
-	if (vulkan.createImageView(inputCubeMapCompleteView, inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
 
-	VkImage outputCubeMap = VK_NULL_HANDLE;
-	if (_distribution == IBLLib::Distribution::None)
-	{
-		outputCubeMap = inputCubeMap;
-	}
-	else if (vulkan.createImage2DAndAllocate(outputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
-																					 VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-																					 maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
+		if (vulkan.createPipelineLayout(panoramaPipelineLayout, panoramaSetLayout) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 	}
 
-	std::vector< std::vector<VkImageView> > outputCubeMapViews(maxMipLevels);
-	for (uint32_t i = 0; i < maxMipLevels; ++i)
 	{
-		outputCubeMapViews[i].resize(6, VK_NULL_HANDLE); //sides of the cube
+		DescriptorSetInfo setLayout0;
+		uint32_t binding = 1u;
+		setLayout0.addCombinedImageSampler(sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, binding, VK_SHADER_STAGE_FRAGMENT_BIT);
+		setLayout0.addStorageBufferDynamic(VK_NULL_HANDLE, 0u, VK_WHOLE_SIZE, 4u, VK_SHADER_STAGE_FRAGMENT_BIT); // selects the sample slice
 
-		for (uint32_t j = 0; j < 6; j++)
+		if (vulkan.createDecriptorSetLayout(filterSetLayout, setLayout0.getLayoutCreateInfo()) != VK_SUCCESS)
 		{
-			VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
-			subresourceRange.baseMipLevel = i;
-			subresourceRange.baseArrayLayer = j;
-			if (vulkan.createImageView(outputCubeMapViews[i][j], outputCubeMap, subresourceRange) != VK_SUCCESS)
-			{
-				return Result::VulkanError;
-			}
+			return Result::VulkanError;
 		}
-	}
 
-	VkImageView outputCubeMapCompleteView = VK_NULL_HANDLE;
-	{
-		VkImageSubresourceRange subresourceRange{};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.baseArrayLayer = 0u;
-		subresourceRange.baseMipLevel = 0u;
-		subresourceRange.layerCount = 6u;
-		subresourceRange.levelCount = maxMipLevels;
+		std::vector<VkPushConstantRange> ranges(1u);
+		VkPushConstantRange& range = ranges.front();
+
+		range.offset = 0u;
+		range.size = sizeof(FilterPushConstant);
+		range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		if (vulkan.createImageView(outputCubeMapCompleteView, outputCubeMap, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+		if (vulkan.createPipelineLayout(filterPipelineLayout, filterSetLayout, ranges) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
 
-	VkImage outputLUT = VK_NULL_HANDLE;
-	VkImageView outputLUTView = VK_NULL_HANDLE;
-	if (_distribution != IBLLib::Distribution::None)
 	{
-		if (vulkan.createImage2DAndAllocate(outputLUT, cubeMapSideLength, cubeMapSideLength, LUTFormat,
-																				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT /*| VK_IMAGE_USAGE_SAMPLED_BIT*/,
-																				1u, 1u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE) != VK_SUCCESS)
+		SharedExponentEncoder& encoder = sharedExponentEncoder;
+
+		if ((res = compileShader(
+			vulkan,
+			encoder.shader,
+			encodeB9G9R9E5ComputeShaderSource,
+			sizeof(encodeB9G9R9E5ComputeShaderSource) / sizeof(encodeB9G9R9E5ComputeShaderSource[0]))) !=
+			Result::Success)
+		{
+			return res;
+		}
+
+		DescriptorSetInfo setLayout0;
+		setLayout0.addCombinedImageSampler(sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0u, VK_SHADER_STAGE_COMPUTE_BIT);
+		setLayout0.addStorageBuffer(VK_NULL_HANDLE, 0u, VK_WHOLE_SIZE, 1u, VK_SHADER_STAGE_COMPUTE_BIT);
+
+		if (vulkan.createDecriptorSetLayout(encoder.setLayout, setLayout0.getLayoutCreateInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 
+		std::vector<VkPushConstantRange> ranges(1u);
+		VkPushConstantRange& range = ranges.front();
+
+		range.offset = 0u;
+		range.size = sizeof(EncodePushConstant);
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		if (vulkan.createPipelineLayout(encoder.pipelineLayout, encoder.setLayout, ranges) != VK_SUCCESS)
 		{
-			VkImageSubresourceRange subresourceRange{};
-			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			subresourceRange.layerCount = 1u;
-			subresourceRange.levelCount = 1u;
+			return Result::VulkanError;
+		}
 
-			if (vulkan.createImageView(outputLUTView, outputLUT, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D) != VK_SUCCESS)
-			{
-				return Result::VulkanError;
-			}
+		VkComputePipelineCreateInfo info{};
+		info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		info.stage.module = encoder.shader;
+		info.stage.pName = "main";
+		info.layout = encoder.pipelineLayout;
+
+		if (vulkan.createPipeline(encoder.pipeline, &info) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
 		}
+
+		encoder.sampler = sampler;
 	}
 
-	VkRenderPass renderPass = VK_NULL_HANDLE;
+	if (_backend == Backend::VulkanCompute)
 	{
-		RenderPassDesc renderPassDesc;
+		if ((res = compileShader(
+			vulkan,
+			filterCubeMapComputeShader,
+			filterCubeMapComputeShaderSource,
+			sizeof(filterCubeMapComputeShaderSource) / sizeof(filterCubeMapComputeShaderSource[0]))) !=
+			Result::Success)
+		{
+			return res;
+		}
 
-		// add rendertargets (cubemap faces)
-		for (int face = 0; face < 6; ++face)
+		DescriptorSetInfo setLayout0;
+		setLayout0.addCombinedImageSampler(sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1u, VK_SHADER_STAGE_COMPUTE_BIT);
+		setLayout0.addStorageImage(VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, 2u);
+		setLayout0.addStorageImage(VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, 3u);
+		setLayout0.addStorageBuffer(VK_NULL_HANDLE, 0u, VK_WHOLE_SIZE, 4u, VK_SHADER_STAGE_COMPUTE_BIT);
+
+		if (vulkan.createDecriptorSetLayout(filterComputeSetLayout, setLayout0.getLayoutCreateInfo()) != VK_SUCCESS)
 		{
-			renderPassDesc.addAttachment(cubeMapFormat);
+			return Result::VulkanError;
 		}
 
-		renderPassDesc.addAttachment(LUTFormat);		
+		std::vector<VkPushConstantRange> ranges(1u);
+		VkPushConstantRange& range = ranges.front();
+
+		range.offset = 0u;
+		range.size = sizeof(FilterPushConstant);
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
-		if (vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
+		if (vulkan.createPipelineLayout(filterComputePipelineLayout, filterComputeSetLayout, ranges) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
 
-	//Push Constants for specular and diffuse filter passes
-	struct PushConstant
-	{
-		float roughness = 0.f;
-		uint32_t sampleCount = 1u;
-		uint32_t mipLevel = 1u;
-		uint32_t width = 1024u;
-		float lodBias = 0.f;
-		Distribution distribution = Distribution::Lambertian;
-	};
+	return Result::Success;
+}
 
-	std::vector<VkPushConstantRange> ranges(1u);
-	VkPushConstantRange& range = ranges.front();
+Result Context::getPanoramaToCubeMapPipeline(VkFormat _cubeMapFormat, VkRenderPass& _outRenderPass, VkPipeline& _outPipeline)
+{
+	for (const Pipeline& entry : m_panoramaToCubeMapPipelines)
+	{
+		if (entry.cubeMapFormat == _cubeMapFormat)
+		{
+			_outRenderPass = entry.renderPass;
+			_outPipeline = entry.pipeline;
+			return Result::Success;
+		}
+	}
 
-	range.offset = 0u;
-	range.size = sizeof(PushConstant);
-	range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	Pipeline entry;
+	entry.cubeMapFormat = _cubeMapFormat;
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	// Filter CubeMap Pipeline
-	VkDescriptorSet filterDescriptorSet = VK_NULL_HANDLE;
-	VkPipelineLayout filterPipelineLayout = VK_NULL_HANDLE;
-	VkPipeline filterPipeline = VK_NULL_HANDLE;
-	if (_distribution != IBLLib::Distribution::None)
 	{
-		DescriptorSetInfo setLayout0;
-		uint32_t binding = 1u;
-		setLayout0.addCombinedImageSampler(cubeMipMapSampler, inputCubeMapCompleteView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, binding, VK_SHADER_STAGE_FRAGMENT_BIT); // change sampler ?
+		RenderPassDesc renderPassDesc;
 
-		VkDescriptorSetLayout filterSetLayout = VK_NULL_HANDLE;
-		if (setLayout0.create(vulkan, filterSetLayout, filterDescriptorSet) != VK_SUCCESS)
+		// add rendertargets (cubemap faces)
+		for (int face = 0; face < 6; ++face)
 		{
-			return Result::VulkanError;
+			renderPassDesc.addAttachment(_cubeMapFormat);
 		}
-
-		vulkan.updateDescriptorSets(setLayout0.getWrites());
-
-		if (vulkan.createPipelineLayout(filterPipelineLayout, filterSetLayout, ranges) != VK_SUCCESS)
+		if (vulkan.createRenderPass(entry.renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
+	}
+
+	GraphicsPipelineDesc panoramaToCubePipeline;
 
-		GraphicsPipelineDesc filterCubeMapPipelineDesc;
+	panoramaToCubePipeline.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+	panoramaToCubePipeline.addShaderStage(panoramaToCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "main");
 
-		filterCubeMapPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
-		filterCubeMapPipelineDesc.addShaderStage(filterCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "main");
+	panoramaToCubePipeline.setRenderPass(entry.renderPass);
+	panoramaToCubePipeline.setPipelineLayout(panoramaPipelineLayout);
 
-		filterCubeMapPipelineDesc.setRenderPass(renderPass);
-		filterCubeMapPipelineDesc.setPipelineLayout(filterPipelineLayout);
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
 
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT; // TODO: rgb only
-		colorBlendAttachment.blendEnable = VK_FALSE;
+	panoramaToCubePipeline.addColorBlendAttachment(colorBlendAttachment, 6);
+
+	if (vulkan.createPipeline(entry.pipeline, panoramaToCubePipeline.getInfo()) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
 
-		filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 6u);
+	m_panoramaToCubeMapPipelines.push_back(entry);
 
-		//colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT;
-		filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
+	_outRenderPass = entry.renderPass;
+	_outPipeline = entry.pipeline;
 
-		filterCubeMapPipelineDesc.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
+	return Result::Success;
+}
 
-		if (vulkan.createPipeline(filterPipeline, filterCubeMapPipelineDesc.getInfo()) != VK_SUCCESS)
+Result Context::getFilterRenderPass(VkFormat _cubeMapFormat, VkFormat _LUTFormat, VkAttachmentLoadOp _loadOp, VkRenderPass& _outRenderPass)
+{
+	for (const RenderPass& entry : m_filterRenderPasses)
+	{
+		if (entry.cubeMapFormat == _cubeMapFormat && entry.LUTFormat == _LUTFormat && entry.loadOp == _loadOp)
 		{
-			return Result::VulkanError;
+			_outRenderPass = entry.renderPass;
+			return Result::Success;
 		}
 	}
 
-	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+	RenderPass entry;
+	entry.cubeMapFormat = _cubeMapFormat;
+	entry.LUTFormat = _LUTFormat;
+	entry.loadOp = _loadOp;
 
-	VkCommandBuffer cubeMapCmd;
-	if (vulkan.createCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	// The attachments are transitioned before the first pass of a level, tiles and sample slices of a level
+	// render into the same images and must not discard the results of each other.
+	// Only accumulating passes load the LUT, all other passes rewrite it or leave it alone with a zero write mask.
+	const VkAttachmentLoadOp LUTLoadOp = _loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+	RenderPassDesc renderPassDesc;
+
+	// add rendertargets (cubemap faces)
+	for (int face = 0; face < 6; ++face)
 	{
-		return Result::VulkanError;
+		renderPassDesc.addAttachment(_cubeMapFormat, _loadOp, VK_ATTACHMENT_STORE_OP_STORE, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 	}
 
-	if (vulkan.beginCommandBuffer(cubeMapCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	renderPassDesc.addAttachment(_LUTFormat, LUTLoadOp, VK_ATTACHMENT_STORE_OP_STORE, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+	if (vulkan.createRenderPass(entry.renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	// Transform panorama image to cube map
+	m_filterRenderPasses.push_back(entry);
 
-	if (!inputIsCubemap)
-	{
-		printf("Transform panorama image to cube map\n");
+	_outRenderPass = entry.renderPass;
 
-		res = panoramaToCubemap(vulkan, cubeMapCmd, fullscreenVertexShader, panoramaImage, inputCubeMap);
-		if (res != VK_SUCCESS)
+	return Result::Success;
+}
+
+Result Context::getFilterPipeline(VkFormat _cubeMapFormat, VkFormat _LUTFormat, const FilterVariant& _variant, VkPipeline& _outPipeline)
+{
+	IBLLib::Result res = Result::Success;
+
+	for (const Pipeline& existing : m_filterPipelines)
+	{
+		if (existing.cubeMapFormat == _cubeMapFormat && existing.LUTFormat == _LUTFormat && existing.variant == _variant)
 		{
-			printf("Failed to transform panorama image to cube map\n");
-			return res;
+			_outPipeline = existing.pipeline;
+			return Result::Success;
 		}
-
-		currentInputCubeMapLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	}
-	else
+
+	Pipeline entry;
+	entry.cubeMapFormat = _cubeMapFormat;
+	entry.LUTFormat = _LUTFormat;
+	entry.variant = _variant;
+
+	if ((res = getFilterRenderPass(_cubeMapFormat, _LUTFormat, VK_ATTACHMENT_LOAD_OP_DONT_CARE, entry.renderPass)) != Result::Success)
 	{
-		currentInputCubeMapLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		return res;
 	}
 
+	SpecConstantFactory specConstants;
+	addSpecConstants(specConstants, _variant);
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	//Generate MipLevels
-	printf("Generating mipmap levels\n");
-	generateMipmapLevels(vulkan, cubeMapCmd, inputCubeMap, maxMipLevels, cubeMapSideLength, currentInputCubeMapLayout);
-	currentInputCubeMapLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	GraphicsPipelineDesc filterCubeMapPipelineDesc;
 
-	// Filter
+	filterCubeMapPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+	filterCubeMapPipelineDesc.addShaderStage(filterCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "main", specConstants.getInfo());
 
-	if (_distribution != IBLLib::Distribution::None)
-	{
-		switch (_distribution)
-		{
-			case IBLLib::Distribution::Lambertian:
-				printf("Filtering lambertian\n");
-				break;
-			case IBLLib::Distribution::GGX:
-				printf("Filtering GGX\n");
-				break;
-			case IBLLib::Distribution::Charlie:
-				printf("Filtering Charlie\n");
-				break;
-			default:
-				break;
-		}
+	filterCubeMapPipelineDesc.setRenderPass(entry.renderPass);
+	filterCubeMapPipelineDesc.setPipelineLayout(filterPipelineLayout);
 
-		vulkan.bindDescriptorSet(cubeMapCmd, filterPipelineLayout, filterDescriptorSet);
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT; // TODO: rgb only
+	colorBlendAttachment.blendEnable = VK_FALSE;
 
-		vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, filterPipeline);
+	VkPipelineColorBlendAttachmentState faceBlendAttachment = colorBlendAttachment;
+	if (_variant.accumulate)
+	{
+		// color += slice color * slice weight, alpha stays 1
+		faceBlendAttachment.blendEnable = VK_TRUE;
+		faceBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_CONSTANT_COLOR;
+		faceBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		faceBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		faceBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		faceBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		faceBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	}
 
-		// Filter every mip level: from inputCubeMap->currentMipLevel
-		// The mip levels are filtered from the smallest mipmap to the largest mipmap,
-		// i.e. the last mipmap is filtered last.
-		// This has the desirable side effect that the framebuffer size of the last filter pass
-		// matches with the LUT size, allowing the LUT to only be written in the last pass
-		// without worrying to preserve the LUT's image contents between the previous render passes.
-		for (uint32_t currentMipLevel = maxMipLevels - 1; currentMipLevel != -1; currentMipLevel--)
-		{
-			unsigned int currentFramebufferSideLength = cubeMapSideLength >> currentMipLevel;
-			std::vector<VkImageView> renderTargetViews(outputCubeMapViews[currentMipLevel]);
+	filterCubeMapPipelineDesc.addColorBlendAttachment(faceBlendAttachment, 6u);
 
-			renderTargetViews.emplace_back(outputLUTView);
+	// fragments of variants that skip the LUT would write undefined values
+	if (_variant.writeLUT == false)
+	{
+		colorBlendAttachment.colorWriteMask = 0u;
+	}
 
-			//Framebuffer will be destroyed automatically at shutdown
-			VkFramebuffer filterOutputFramebuffer = VK_NULL_HANDLE;
-			if (vulkan.createFramebuffer(filterOutputFramebuffer, renderPass, currentFramebufferSideLength, currentFramebufferSideLength, renderTargetViews, 1u) != VK_SUCCESS)
-			{
-				return Result::VulkanError;
-			}
+	//colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT;
+	filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
 
-			VkImageSubresourceRange  subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, currentMipLevel, 1u, 0u, 6u };
+	if (vulkan.createPipeline(entry.pipeline, filterCubeMapPipelineDesc.getInfo()) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
 
-			vulkan.imageBarrier(cubeMapCmd, outputCubeMap,
-													VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-													VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//src stage, access
-													VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // dst stage, access
-													subresourceRange);
+	m_filterPipelines.push_back(entry);
 
-			PushConstant values{};
-			values.roughness = static_cast<float>(currentMipLevel) / static_cast<float>(maxMipLevels - 1);
-			values.sampleCount = _sampleCount;
-			values.mipLevel = currentMipLevel;
-			values.width = cubeMapSideLength;
-			values.lodBias = _lodBias;
-			values.distribution = _distribution;
+	_outPipeline = entry.pipeline;
 
-			vkCmdPushConstants(cubeMapCmd, filterPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
+	return Result::Success;
+}
 
-			vulkan.beginRenderPass(cubeMapCmd, renderPass, filterOutputFramebuffer, VkRect2D{ 0u, 0u, currentFramebufferSideLength, currentFramebufferSideLength }, clearValues);
-			vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
-			vulkan.endRenderPass(cubeMapCmd);
+Result Context::getFilterComputePipeline(const FilterVariant& _variant, VkPipeline& _outPipeline)
+{
+	for (const Pipeline& entry : m_filterComputePipelines)
+	{
+		if (entry.variant == _variant)
+		{
+			_outPipeline = entry.pipeline;
+			return Result::Success;
 		}
 	}
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	//Output
+	Pipeline entry;
+	entry.variant = _variant;
 
-	VkFormat vulkanTargetFormat;
-	switch (_targetFormat) {
-	case IBLLib::OutputFormat::R8G8B8A8_UNORM:
-		vulkanTargetFormat = VK_FORMAT_R8G8B8A8_UNORM;
-		break;
-	case IBLLib::OutputFormat::R32G32B32A32_SFLOAT:
-	case IBLLib::OutputFormat::B9G9R9E5_UFLOAT:
-		// The GPU can't write to B9G9R9E5_UFLOAT textures, so convert on the CPU.
-		// TODO: Use compute shader?
-		vulkanTargetFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
-		break;
-	case IBLLib::OutputFormat::R16G16B16A16_SFLOAT:
-		vulkanTargetFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-		break;
-	}
+	SpecConstantFactory specConstants;
+	addSpecConstants(specConstants, _variant);
 
-	VkImageLayout currentCubeMapImageLayout;
-	VkImage convertedCubeMap = VK_NULL_HANDLE;
+	VkComputePipelineCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	info.stage.module = filterCubeMapComputeShader;
+	info.stage.pName = "main";
+	info.stage.pSpecializationInfo = specConstants.getInfo();
+	info.layout = filterComputePipelineLayout;
 
-	if(_distribution == IBLLib::Distribution::None)
+	if (vulkan.createPipeline(entry.pipeline, &info) != VK_SUCCESS)
 	{
-		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		return Result::VulkanError;
 	}
-	else
+
+	m_filterComputePipelines.push_back(entry);
+
+	_outPipeline = entry.pipeline;
+
+	return Result::Success;
+}
+
+Result Context::recreateLostDevice()
+{
+	if (backend != Backend::Vulkan || largestTileSize / 2u < MinRetryTileSize)
 	{
-		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		printf("Error: Device lost, the job is not restarted with tiles smaller than %u texels\n", MinRetryTileSize);
+		return Result::DeviceLost;
 	}
 
-	if(vulkanTargetFormat != cubeMapFormat)
+	submitOptions.tileSize = largestTileSize / 2u;
+	if (submitOptions.timeBudgetMs == 0u)
 	{
-		if ((res = convertVkFormat(vulkan, cubeMapCmd, outputCubeMap, convertedCubeMap, vulkanTargetFormat, currentCubeMapImageLayout)) != Success)
-		{
-			printf("Failed to convert Image \n");
-			return res;
-		}
-		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		submitOptions.timeBudgetMs = RetryTimeBudgetMs;
 	}
-	else
+
+	printf("Device lost, restarting the job with %u texel tiles and a time budget of %u ms per submission\n", submitOptions.tileSize, submitOptions.timeBudgetMs);
+
+	m_panoramaToCubeMapPipelines.clear();
+	m_filterRenderPasses.clear();
+	m_filterPipelines.clear();
+	m_filterComputePipelines.clear();
+
+	vulkan.shutdown();
+
+	Result res = initialize(debugOutput, backend);
+	if (res != Result::Success)
 	{
-		convertedCubeMap = outputCubeMap;
+		return res;
 	}
 
-	if (vulkan.endCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	if (profiling && vulkan.enableProfiling(true) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	if (vulkan.executeCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	return Result::Success;
+}
+
+Result panoramaToCubemap(Context& _context, const VkCommandBuffer _commandBuffer, const VkImage _panoramaImage, const VkImage _cubeMapImage)
+{
+	IBLLib::Result res = Result::Success;
+	vkHelper& _vulkan = _context.vulkan;
+
+	const VkImageCreateInfo* textureInfo = _vulkan.getCreateInfo(_cubeMapImage);
+
+	if (textureInfo == nullptr)
 	{
-		return Result::VulkanError;
+		return Result::InvalidArgument;
+	}
+
+	const uint32_t cubeMapSideLength = textureInfo->extent.width;
+	const uint32_t maxMipLevels = textureInfo->mipLevels;
+	const VkFormat format = textureInfo->format;
+
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkPipeline panoramaToCubeMapPipeline = VK_NULL_HANDLE;
+	if ((res = _context.getPanoramaToCubeMapPipeline(format, renderPass, panoramaToCubeMapPipeline)) != Result::Success)
+	{
+		return res;
 	}
 
-	if (downloadCubemap(vulkan, convertedCubeMap, _outputPathCubeMap, static_cast<VkFormat>(_targetFormat), currentCubeMapImageLayout) != VK_SUCCESS)
+	VkImageView panoramaImageView = VK_NULL_HANDLE;
+	if (_vulkan.createImageView(panoramaImageView, _panoramaImage) != VK_SUCCESS)
 	{
-		printf("Failed to download Image \n");
 		return Result::VulkanError;
 	}
 
-	if (_outputPathLUT != nullptr)
+	VkDescriptorSet panoramaSet = VK_NULL_HANDLE;
 	{
-		if (download2DImage(vulkan, outputLUT, _outputPathLUT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) != VK_SUCCESS)
+		DescriptorSetInfo setLayout0;
+		setLayout0.addCombinedImageSampler(_context.sampler, panoramaImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		if (setLayout0.allocate(_vulkan, _context.panoramaSetLayout, panoramaSet) != VK_SUCCESS)
 		{
-			printf("Failed to download Image \n");
 			return Result::VulkanError;
 		}
+
+		_vulkan.updateDescriptorSets(setLayout0.getWrites());
 	}
 
-	return Result::Success;
-}
+	/// Render Pass
+	std::vector<VkImageView> inputCubeMapViews(6u, VK_NULL_HANDLE);
+	for (size_t i = 0; i < inputCubeMapViews.size(); i++)
+	{
+		if (_vulkan.createImageView(inputCubeMapViews[i], _cubeMapImage, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, static_cast<uint32_t>(i), 1u }) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
 
-extern "C"
+	VkFramebuffer cubeMapInputFramebuffer = VK_NULL_HANDLE;
+	if (_vulkan.createFramebuffer(cubeMapInputFramebuffer, renderPass, cubeMapSideLength, cubeMapSideLength, inputCubeMapViews, 1u) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	{
+		VkImageSubresourceRange  subresourceRangeBaseMiplevel = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u };
+
+		_vulkan.imageBarrier(_commandBuffer, _cubeMapImage,
+												 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+												 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,// src stage, access
+												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, //dst stage, access
+												 subresourceRangeBaseMiplevel);
+	}
+
+	_vulkan.bindDescriptorSet(_commandBuffer, _context.panoramaPipelineLayout, panoramaSet);
+
+	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, panoramaToCubeMapPipeline);
+
+	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+	const VkRect2D renderArea{ 0u, 0u, cubeMapSideLength, cubeMapSideLength };
+
+	_vulkan.beginRenderPass(_commandBuffer, renderPass, cubeMapInputFramebuffer, renderArea, clearValues);
+	_vulkan.setViewport(_commandBuffer, renderArea.extent, renderArea);
+	vkCmdDraw(_commandBuffer, 3, 1u, 0, 0);
+	_vulkan.endRenderPass(_commandBuffer);
+
+	return res;
+}
+
+// Applies the defaults to the resolution and mip count of an output and checks that they are compatible
+Result resolveOutput(const OutputDesc& _output, uint32_t _defaultCubemapResolution, OutputDesc& _outResolved, uint32_t& _outMaxMipLevels)
+{
+	_outResolved = _output;
+
+	if (_outResolved.cubemapResolution == 0)
+	{
+		_outResolved.cubemapResolution = _defaultCubemapResolution;
+	}
+
+	if (_outResolved.mipmapCount == 0)
+	{
+		_outResolved.mipmapCount = static_cast<uint32_t>(floor(log2(_outResolved.cubemapResolution)));
+	}
+
+	const bool diffuse = _output.distribution == Distribution::Lambertian || _output.distribution == Distribution::LambertianSH;
+	_outMaxMipLevels = diffuse ? 1u : _outResolved.mipmapCount;
+
+	if (_outMaxMipLevels == 0u || (_outResolved.cubemapResolution >> (_outMaxMipLevels - 1)) < 1)
+	{
+		printf("Error: CubemapResolution incompatible with MipmapCount\n");
+		return Result::InvalidArgument;
+	}
+
+	return Result::Success;
+}
+
+// Transforms the uploaded panorama to a cube map (unless the input already is one) and generates its mip levels.
+// The result is shared by all outputs of a job and left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+// _inputLevelCount levels of a cube map input hold data, the remaining ones are generated
+Result createInputCubeMap(Context& _context, const VkImage _panoramaImage, bool _inputIsCubemap, uint32_t _inputLevelCount, uint32_t _sideLength, uint32_t _mipLevels, VkImage& _outCubeMap)
+{
+	const VkFormat cubeMapFormat = _context.intermediateFormat;
+
+	IBLLib::Result res = Result::Success;
+
+	vkHelper& vulkan = _context.vulkan;
+
+	VkImageLayout currentInputCubeMapLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	//VK_IMAGE_USAGE_TRANSFER_SRC_BIT needed for transfer to staging buffer
+	if (!_inputIsCubemap)
+	{
+		if (vulkan.createImage2DAndAllocate(_outCubeMap, _sideLength, _sideLength, cubeMapFormat,
+																				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+																				_mipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+	else
+	{
+		_outCubeMap = _panoramaImage;
+	}
+
+	VkCommandBuffer cubeMapCmd;
+	if (vulkan.createCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (vulkan.beginCommandBuffer(cubeMapCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////
+	// Transform panorama image to cube map
+
+	if (!_inputIsCubemap)
+	{
+		printf("Transform panorama image to cube map\n");
+
+		const uint32_t profileStage = vulkan.beginGpuStage(cubeMapCmd, "panoramaToCubemap");
+		vulkan.beginStatistics(cubeMapCmd, profileStage);
+
+		res = panoramaToCubemap(_context, cubeMapCmd, _panoramaImage, _outCubeMap);
+		if (res != Result::Success)
+		{
+			printf("Failed to transform panorama image to cube map\n");
+			return res;
+		}
+
+		vulkan.endStatistics(cubeMapCmd, profileStage);
+		vulkan.endGpuStage(cubeMapCmd, profileStage);
+
+		currentInputCubeMapLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+	else
+	{
+		currentInputCubeMapLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////
+	//Generate MipLevels
+	const uint32_t firstLevel = _inputIsCubemap ? std::max(_inputLevelCount, 1u) : 1u;
+
+	// a cube map input that brings all levels is already in the layout of the filter passes
+	if (!_inputIsCubemap || firstLevel < _mipLevels)
+	{
+		printf("Generating mipmap levels\n");
+		const uint32_t profileStage = vulkan.beginGpuStage(cubeMapCmd, "generateMipmapLevels");
+		generateMipmapLevels(vulkan, cubeMapCmd, _outCubeMap, _mipLevels, _sideLength, currentInputCubeMapLayout, std::min(firstLevel, _mipLevels));
+		vulkan.endGpuStage(cubeMapCmd, profileStage);
+	}
+
+	if (vulkan.endCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (vulkan.executeCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	vulkan.destroyCommandBuffer(cubeMapCmd);
+
+	return Result::Success;
+}
+
+// Splits the filter passes of an output into submissions of about SubmitOptions::timeBudgetMs. The duration of a pass is
+// estimated from its cost (texels times samples) and the throughput measured on the previous submissions,
+// the first submission only holds one pass. Without a budget all passes go into the command buffer of the output.
+class PassSubmitter
+{
+public:
+	PassSubmitter(vkHelper& _vulkan, VkCommandBuffer& _commandBuffer, uint32_t _timeBudgetMs) :
+		m_vulkan(_vulkan), m_commandBuffer(_commandBuffer), m_timeBudgetMs(static_cast<double>(_timeBudgetMs)) {}
+
+	// Call before recording a pass, the recorded passes are submitted first if the pass would exceed the budget.
+	// The command buffer is replaced in that case, the pass has to bind its pipeline and descriptor set again.
+	Result beginPass(double _cost);
+
+private:
+	vkHelper& m_vulkan;
+	VkCommandBuffer& m_commandBuffer;
+	double m_timeBudgetMs;
+
+	uint32_t m_pendingPasses = 0u;
+	double m_pendingCost = 0.0;
+	double m_submittedCost = 0.0;
+	double m_submittedMs = 0.0;
+};
+
+Result PassSubmitter::beginPass(double _cost)
+{
+	if (m_timeBudgetMs > 0.0 && m_pendingPasses > 0u &&
+		(m_submittedMs <= 0.0 || (m_pendingCost + _cost) * m_submittedMs / m_submittedCost > m_timeBudgetMs))
+	{
+		if (m_vulkan.endCommandBuffer(m_commandBuffer) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+
+		const VkResult res = m_vulkan.executeCommandBuffer(m_commandBuffer);
+		if (res != VK_SUCCESS)
+		{
+			return res == VK_ERROR_DEVICE_LOST ? Result::DeviceLost : Result::VulkanError;
+		}
+
+		m_submittedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		m_submittedCost += m_pendingCost;
+		m_pendingCost = 0.0;
+		m_pendingPasses = 0u;
+
+		m_vulkan.destroyCommandBuffer(m_commandBuffer);
+
+		if (m_vulkan.createCommandBuffer(m_commandBuffer) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		if (m_vulkan.beginCommandBuffer(m_commandBuffer, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	m_pendingCost += _cost;
+	++m_pendingPasses;
+
+	return Result::Success;
+}
+
+// Filters all mip levels of _outputCubeMap with one dispatch per level instead of the fullscreen render passes.
+// Every dispatch is a pass of _submitter, _levelSamples holds one slice per level.
+// The cube map and the LUT are left in VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL like after the graphics path.
+Result filterCubeMapCompute(Context& _context, VkCommandBuffer& _commandBuffer, PassSubmitter& _submitter, const VkImageView _inputCubeMapView, uint32_t _inputSideLength,
+	const VkBuffer _sampleTable, const std::vector<SampleSlice>& _levelSamples, const OutputDesc& _output, const VkImage _outputCubeMap, uint32_t _maxMipLevels,
+	const VkImage _outputLUT, const VkImageView _outputLUTView)
+{
+	IBLLib::Result res = Result::Success;
+	vkHelper& vulkan = _context.vulkan;
+
+	const uint32_t cubeMapSideLength = _output.cubemapResolution;
+
+	FilterVariant variant;
+	variant.distribution = _output.distribution;
+	variant.sampleCount = _output.sampleCount;
+
+	const VkImageSubresourceRange cubeMapRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, _maxMipLevels, 0u, 6u };
+	const VkImageSubresourceRange LUTRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
+
+	vulkan.imageBarrier(_commandBuffer, _outputCubeMap,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		cubeMapRange);
+
+	vulkan.imageBarrier(_commandBuffer, _outputLUT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		LUTRange);
+
+	for (uint32_t currentMipLevel = 0u; currentMipLevel < _maxMipLevels; ++currentMipLevel)
+	{
+		const uint32_t currentSideLength = cubeMapSideLength >> currentMipLevel;
+
+		variant.writeLUT = currentMipLevel == 0u;
+
+		const double texelCount = static_cast<double>(currentSideLength) * currentSideLength;
+		if ((res = _submitter.beginPass(texelCount * (6.0 * _levelSamples[currentMipLevel].sampleCount + (variant.writeLUT ? _output.sampleCount : 0u)))) != Result::Success)
+		{
+			return res;
+		}
+
+		const uint32_t profileStage = vulkan.beginGpuStage(_commandBuffer, "filter level " + std::to_string(currentMipLevel));
+
+		VkPipeline filterPipeline = VK_NULL_HANDLE;
+		if ((res = _context.getFilterComputePipeline(variant, filterPipeline)) != Result::Success)
+		{
+			return res;
+		}
+
+		vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, filterPipeline);
+
+		VkImageView outputFacesView = VK_NULL_HANDLE;
+		if (vulkan.createImageView(outputFacesView, _outputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, currentMipLevel, 1u, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D_ARRAY) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		// the views differ per mip level, so every level gets its own set
+		VkDescriptorSet filterDescriptorSet = VK_NULL_HANDLE;
+		{
+			DescriptorSetInfo setLayout0;
+			setLayout0.addCombinedImageSampler(_context.sampler, _inputCubeMapView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1u, VK_SHADER_STAGE_COMPUTE_BIT);
+			setLayout0.addStorageImage(outputFacesView, VK_IMAGE_LAYOUT_GENERAL, 2u);
+			setLayout0.addStorageImage(_outputLUTView, VK_IMAGE_LAYOUT_GENERAL, 3u);
+			setLayout0.addStorageBuffer(_sampleTable, 0u, VK_WHOLE_SIZE, 4u, VK_SHADER_STAGE_COMPUTE_BIT);
+
+			if (setLayout0.allocate(vulkan, _context.filterComputeSetLayout, filterDescriptorSet) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+
+			vulkan.updateDescriptorSets(setLayout0.getWrites());
+		}
+
+		vulkan.bindDescriptorSet(_commandBuffer, _context.filterComputePipelineLayout, filterDescriptorSet, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+		FilterPushConstant values{};
+		values.roughness = static_cast<float>(currentMipLevel) / static_cast<float>(_maxMipLevels - 1);
+		values.mipLevel = currentMipLevel;
+		values.width = _inputSideLength;
+		values.lodBias = _output.lodBias;
+
+		vkCmdPushConstants(_commandBuffer, _context.filterComputePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FilterPushConstant), &values);
+
+		// 8x8 work groups, one layer per cube face
+		const uint32_t groupCount = (currentSideLength + 7u) / 8u;
+		vulkan.beginStatistics(_commandBuffer, profileStage);
+		vkCmdDispatch(_commandBuffer, groupCount, groupCount, 6u);
+		vulkan.endStatistics(_commandBuffer, profileStage);
+
+		vulkan.endGpuStage(_commandBuffer, profileStage);
+	}
+
+	vulkan.imageBarrier(_commandBuffer, _outputCubeMap,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		cubeMapRange);
+
+	vulkan.imageBarrier(_commandBuffer, _outputLUT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		LUTRange);
+
+	return Result::Success;
+}
+
+// Copies one level of the shared input cube map to the host as RGBA32F, the cube map is returned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+Result downloadCubeMapLevel(vkHelper& _vulkan, ThreadPool* _pool, const VkImage _cubeMap, uint32_t _level, CpuCubeMap& _outCubeMap)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_cubeMap);
+	if (pInfo == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	const uint32_t sideLength = std::max(pInfo->extent.width >> _level, 1u);
+	const size_t faceByteSize = static_cast<size_t>(sideLength) * sideLength * getFormatSize(pInfo->format);
+
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	if (_vulkan.createBufferAndAllocate(stagingBuffer, faceByteSize * 6u, VK_BUFFER_USAGE_TRANSFER_DST_BIT, _vulkan.getReadbackMemoryFlags()) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
+	if (_vulkan.createCommandBuffer(downloadCmds) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, _level, 1u, 0u, 6u };
+
+	_vulkan.imageBarrier(downloadCmds, _cubeMap,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+		subresourceRange);
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0u;
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, _level, 0u, 6u };
+	region.imageExtent = { sideLength, sideLength, 1u };
+	_vulkan.copyImage2DToBuffer(downloadCmds, _cubeMap, stagingBuffer, region);
+
+	_vulkan.imageBarrier(downloadCmds, _cubeMap,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		subresourceRange);
+
+	if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (_vulkan.executeCommandBuffer(downloadCmds) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	_vulkan.destroyCommandBuffer(downloadCmds);
+
+	// the level is converted straight from the mapped memory
+	uint8_t* levelData = nullptr;
+	if (_vulkan.getMappedData(stagingBuffer, levelData) != VK_SUCCESS || _vulkan.invalidateBuffer(stagingBuffer) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	const size_t texelCount = static_cast<size_t>(sideLength) * sideLength * 6u;
+
+	_outCubeMap.sideLength = sideLength;
+	_outCubeMap.levels.resize(1u);
+	_outCubeMap.levels[0].resize(texelCount * 4u);
+
+	const bool converted = convertTexels(reinterpret_cast<uint8_t*>(_outCubeMap.levels[0].data()), VK_FORMAT_R32G32B32A32_SFLOAT, levelData, pInfo->format, texelCount, _pool);
+
+	_vulkan.destroyBuffer(stagingBuffer);
+
+	return converted ? Result::Success : Result::InvalidArgument;
+}
+
+// Distribution::LambertianSH: projects a small level of the input onto the SH basis on the host instead of sampling it.
+// The evaluated irradiance is copied to _outputCubeMap, which is left in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+Result irradianceFromSH(Context& _context, const VkCommandBuffer _commandBuffer, const VkImage _inputCubeMap, const OutputDesc& _output, const VkImage _outputCubeMap,
+	std::vector<float>& _outSHCoefficients)
+{
+	IBLLib::Result res = Result::Success;
+	vkHelper& vulkan = _context.vulkan;
+
+	const VkImageCreateInfo* inputInfo = vulkan.getCreateInfo(_inputCubeMap);
+	if (inputInfo == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	printf("Projecting lambertian onto spherical harmonics\n");
+
+	CpuCubeMap input;
+	if ((res = downloadCubeMapLevel(vulkan, _context.threadPool.get(), _inputCubeMap, getSHProjectionLevel(inputInfo->extent.width, inputInfo->mipLevels), input)) != Result::Success)
+	{
+		return res;
+	}
+
+	const uint32_t profileStage = vulkan.beginHostStage("SH9 projection");
+
+	float coefficients[SH9CoefficientCount];
+	projectSH9OnCPU(input, 0u, coefficients);
+
+	CpuCubeMap irradiance;
+	evaluateSH9IrradianceOnCPU(coefficients, _output.cubemapResolution, irradiance);
+
+	vulkan.endHostStage(profileStage);
+
+	printSHError(input, coefficients, _output);
+
+	const std::vector<float>& irradianceData = irradiance.levels[0];
+	const size_t texelCount = irradianceData.size() / 4u;
+
+	// the irradiance is uploaded in the format of _outputCubeMap
+	const VkFormat outputFormat = vulkan.getCreateInfo(_outputCubeMap)->format;
+	std::vector<uint8_t> outputData(texelCount * getFormatSize(outputFormat));
+
+	if (convertTexels(outputData.data(), outputFormat, reinterpret_cast<const uint8_t*>(irradianceData.data()), VK_FORMAT_R32G32B32A32_SFLOAT, texelCount, _context.threadPool.get()) == false)
+	{
+		return Result::InvalidArgument;
+	}
+
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	if (vulkan.createBufferAndAllocate(stagingBuffer, outputData.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (vulkan.writeBufferData(stagingBuffer, outputData.data(), outputData.size()) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	vulkan.transitionImageToTransferWrite(_commandBuffer, _outputCubeMap);
+	vulkan.copyBufferToBasicImage2D(_commandBuffer, stagingBuffer, _outputCubeMap);
+
+	_outSHCoefficients.assign(coefficients, coefficients + SH9CoefficientCount);
+
+	return Result::Success;
+}
+
+// Filters one output from the shared input cube map, the results are left on the device in _outCubeMap (target format) and _outLUT
+Result filterCubeMap(Context& _context, const VkImage _inputCubeMap, const OutputDesc& _output, uint32_t _maxMipLevels,
+	VkImage& _outCubeMap, VkImageLayout& _outCubeMapLayout, VkImage& _outLUT, std::vector<float>& _outSHCoefficients)
+{
+	const VkFormat LUTFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+	IBLLib::Result res = Result::Success;
+
+	vkHelper& vulkan = _context.vulkan;
+
+	const Distribution distribution = _output.distribution;
+	const uint32_t cubeMapSideLength = _output.cubemapResolution;
+	const uint32_t maxMipLevels = _maxMipLevels;
+
+	const VkImageCreateInfo* inputInfo = vulkan.getCreateInfo(_inputCubeMap);
+	if (inputInfo == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	const uint32_t inputSideLength = inputInfo->extent.width;
+
+	const bool useCompute = _context.backend == Backend::VulkanCompute;
+	const VkImageUsageFlags storageUsage = useCompute ? static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_STORAGE_BIT) : 0u;
+	const VkImageUsageFlags SHUsage = distribution == IBLLib::Distribution::LambertianSH ? static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_TRANSFER_DST_BIT) : 0u;
+
+	// sample slices are accumulated by blending, the compute path takes all samples of a level at once
+	const uint32_t sliceCount = useCompute ? 1u : std::max(_context.submitOptions.sampleSlices, 1u);
+
+	VkFormat vulkanTargetFormat;
+	switch (_output.targetFormat) {
+	case IBLLib::OutputFormat::R8G8B8A8_UNORM:
+		vulkanTargetFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		break;
+	case IBLLib::OutputFormat::R32G32B32A32_SFLOAT:
+	case IBLLib::OutputFormat::B9G9R9E5_UFLOAT:
+		// The GPU can't render to B9G9R9E5_UFLOAT textures, downloadCubemap packs the RGBA32F result with a compute shader.
+		vulkanTargetFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+		break;
+	case IBLLib::OutputFormat::R16G16B16A16_SFLOAT:
+		vulkanTargetFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+		break;
+	default:
+		return Result::InvalidArgument;
+	}
+
+	// The filter writes the target format directly, the RGBA32F intermediate and its conversion are only needed
+	// for the input cube map of distribution None, the rgba32f storage images of the compute shader,
+	// sample slices that must not be blended at the target precision and formats that can't be rendered to.
+	VkFormat cubeMapFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+	if (distribution == IBLLib::Distribution::LambertianSH ||
+		(distribution != IBLLib::Distribution::None && useCompute == false && sliceCount == 1u &&
+		(vulkan.getOptimalTilingFeatures(vulkanTargetFormat) & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) != 0u))
+	{
+		cubeMapFormat = vulkanTargetFormat;
+	}
+
+	VkImage outputCubeMap = VK_NULL_HANDLE;
+	if (distribution == IBLLib::Distribution::None)
+	{
+		if (cubeMapSideLength != inputSideLength || maxMipLevels != inputInfo->mipLevels)
+		{
+			printf("Error: Distribution None requires the resolution and mip count of the input cube map\n");
+			return Result::InvalidArgument;
+		}
+
+		outputCubeMap = _inputCubeMap;
+	}
+	else if (vulkan.createImage2DAndAllocate(outputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
+																					 VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | storageUsage | SHUsage,
+																					 maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	VkCommandBuffer cubeMapCmd;
+	if (vulkan.createCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (vulkan.beginCommandBuffer(cubeMapCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	VkImage outputLUT = VK_NULL_HANDLE;
+
+	// Filter
+
+	if (distribution == IBLLib::Distribution::LambertianSH)
+	{
+		if ((res = irradianceFromSH(_context, cubeMapCmd, _inputCubeMap, _output, outputCubeMap, _outSHCoefficients)) != Result::Success)
+		{
+			return res;
+		}
+	}
+	else if (distribution != IBLLib::Distribution::None)
+	{
+		// Sample at most as many input mip levels as the output has, this keeps an output
+		// independent from the other outputs of the job that determine the size of the input pyramid.
+		const uint32_t inputMipLevels = std::min(maxMipLevels, inputInfo->mipLevels);
+
+		VkImageView inputCubeMapCompleteView = VK_NULL_HANDLE;
+		if (vulkan.createImageView(inputCubeMapCompleteView, _inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, inputMipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		if (vulkan.createImage2DAndAllocate(outputLUT, cubeMapSideLength, cubeMapSideLength, LUTFormat,
+																				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | storageUsage /*| VK_IMAGE_USAGE_SAMPLED_BIT*/,
+																				1u, 1u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		VkImageView outputLUTView = VK_NULL_HANDLE;
+		{
+			VkImageSubresourceRange subresourceRange{};
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.layerCount = 1u;
+			subresourceRange.levelCount = 1u;
+
+			if (vulkan.createImageView(outputLUTView, outputLUT, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+		}
+
+		const SubmitOptions& submitOptions = _context.submitOptions;
+
+		// the importance samples only depend on the mip level, they are computed once instead of per texel
+		VkBuffer sampleTable = VK_NULL_HANDLE;
+		std::vector<SampleSlice> slices;
+		if ((res = createSampleTable(vulkan, _output, maxMipLevels, inputSideLength, sliceCount, sampleTable, slices)) != Result::Success)
+		{
+			return res;
+		}
+
+		switch (distribution)
+		{
+			case IBLLib::Distribution::Lambertian:
+				printf("Filtering lambertian\n");
+				break;
+			case IBLLib::Distribution::GGX:
+				printf("Filtering GGX\n");
+				break;
+			case IBLLib::Distribution::Charlie:
+				printf("Filtering Charlie\n");
+				break;
+			default:
+				break;
+		}
+
+		PassSubmitter submitter(vulkan, cubeMapCmd, submitOptions.timeBudgetMs);
+
+		if (useCompute)
+		{
+			if ((res = filterCubeMapCompute(_context, cubeMapCmd, submitter, inputCubeMapCompleteView, inputSideLength, sampleTable, slices, _output, outputCubeMap, maxMipLevels, outputLUT, outputLUTView)) != Result::Success)
+			{
+				return res;
+			}
+		}
+		else
+		{
+			std::vector< std::vector<VkImageView> > outputCubeMapViews(maxMipLevels);
+			for (uint32_t i = 0; i < maxMipLevels; ++i)
+			{
+				outputCubeMapViews[i].resize(6, VK_NULL_HANDLE); //sides of the cube
+
+				for (uint32_t j = 0; j < 6; j++)
+				{
+					VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
+					subresourceRange.baseMipLevel = i;
+					subresourceRange.baseArrayLayer = j;
+					if (vulkan.createImageView(outputCubeMapViews[i][j], outputCubeMap, subresourceRange) != VK_SUCCESS)
+					{
+						return Result::VulkanError;
+					}
+				}
+			}
+
+			////////////////////////////////////////////////////////////////////////////////////////
+			// Filter CubeMap Pipeline
+			FilterVariant variant;
+			variant.distribution = distribution;
+			variant.sampleCount = _output.sampleCount;
+			variant.accumulate = sliceCount > 1u;
+
+			VkDescriptorSet filterDescriptorSet = VK_NULL_HANDLE;
+			{
+				// slice s is bound at the dynamic offset s * SampleTableHeaderByteSize, the range leaves room for the last one
+				const VkDeviceSize sampleTableRange = vulkan.getBufferCreateInfo(sampleTable)->size - (sliceCount - 1u) * SampleTableHeaderByteSize;
+
+				DescriptorSetInfo setLayout0;
+				uint32_t binding = 1u;
+				setLayout0.addCombinedImageSampler(_context.sampler, inputCubeMapCompleteView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, binding, VK_SHADER_STAGE_FRAGMENT_BIT); // change sampler ?
+				setLayout0.addStorageBufferDynamic(sampleTable, 0u, sampleTableRange, 4u, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+				if (setLayout0.allocate(vulkan, _context.filterSetLayout, filterDescriptorSet) != VK_SUCCESS)
+				{
+					return Result::VulkanError;
+				}
+
+				vulkan.updateDescriptorSets(setLayout0.getWrites());
+			}
+
+			// Passes that don't accumulate overwrite their tile, the first slice of an accumulating tile clears it and the others add to it
+			VkRenderPass overwriteRenderPass = VK_NULL_HANDLE;
+			VkRenderPass clearRenderPass = VK_NULL_HANDLE;
+			VkRenderPass loadRenderPass = VK_NULL_HANDLE;
+			if ((res = _context.getFilterRenderPass(cubeMapFormat, LUTFormat, VK_ATTACHMENT_LOAD_OP_DONT_CARE, overwriteRenderPass)) != Result::Success ||
+				(variant.accumulate && (res = _context.getFilterRenderPass(cubeMapFormat, LUTFormat, VK_ATTACHMENT_LOAD_OP_CLEAR, clearRenderPass)) != Result::Success) ||
+				(variant.accumulate && (res = _context.getFilterRenderPass(cubeMapFormat, LUTFormat, VK_ATTACHMENT_LOAD_OP_LOAD, loadRenderPass)) != Result::Success))
+			{
+				return res;
+			}
+
+			const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 0.0f, 0.0f });
+
+			// the render passes expect the attachments in this layout
+			vulkan.imageBarrier(cubeMapCmd, outputLUT,
+													VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+													VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,
+													VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+													{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u });
+
+			bool firstPass = true;
+
+			// Filter every mip level: from inputCubeMap->currentMipLevel
+			// The mip levels are filtered from the smallest mipmap to the largest mipmap,
+			// i.e. the last mipmap is filtered last.
+			// This has the desirable side effect that the framebuffer size of the last filter pass
+			// matches with the LUT size, allowing the LUT to only be written in the last pass
+			// without worrying to preserve the LUT's image contents between the previous render passes.
+			for (uint32_t currentMipLevel = maxMipLevels - 1; currentMipLevel != -1; currentMipLevel--)
+			{
+				unsigned int currentFramebufferSideLength = cubeMapSideLength >> currentMipLevel;
+
+				const uint32_t tileSize = submitOptions.tileSize > 0u ? std::min(submitOptions.tileSize, currentFramebufferSideLength) : currentFramebufferSideLength;
+				_context.largestTileSize = std::max(_context.largestTileSize, tileSize);
+
+				std::vector<VkImageView> renderTargetViews(outputCubeMapViews[currentMipLevel]);
+
+				renderTargetViews.emplace_back(outputLUTView);
+
+				//Framebuffer will be destroyed automatically at the end of the job
+				VkFramebuffer filterOutputFramebuffer = VK_NULL_HANDLE;
+				if (vulkan.createFramebuffer(filterOutputFramebuffer, overwriteRenderPass, currentFramebufferSideLength, currentFramebufferSideLength, renderTargetViews, 1u) != VK_SUCCESS)
+				{
+					return Result::VulkanError;
+				}
+
+				VkImageSubresourceRange  subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, currentMipLevel, 1u, 0u, 6u };
+
+				// spans the submissions of the level when a time budget splits it
+				const uint32_t profileStage = vulkan.beginGpuStage(cubeMapCmd, "filter level " + std::to_string(currentMipLevel));
+
+				vulkan.imageBarrier(cubeMapCmd, outputCubeMap,
+														VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+														VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//src stage, access
+														VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // dst stage, access
+														subresourceRange);
+
+				FilterPushConstant values{};
+				values.roughness = static_cast<float>(currentMipLevel) / static_cast<float>(maxMipLevels - 1);
+				values.mipLevel = currentMipLevel;
+				values.width = inputSideLength;
+				values.lodBias = _output.lodBias;
+
+				for (uint32_t tileY = 0u; tileY < currentFramebufferSideLength; tileY += tileSize)
+				{
+					for (uint32_t tileX = 0u; tileX < currentFramebufferSideLength; tileX += tileSize)
+					{
+						const VkRect2D renderArea{ { static_cast<int32_t>(tileX), static_cast<int32_t>(tileY) },
+							{ std::min(tileSize, currentFramebufferSideLength - tileX), std::min(tileSize, currentFramebufferSideLength - tileY) } };
+
+						for (uint32_t slice = 0u; slice < sliceCount; ++slice)
+						{
+							const SampleSlice& sampleSlice = slices[currentMipLevel * sliceCount + slice];
+
+							// the first slice clears the tile even without samples
+							if (slice > 0u && sampleSlice.sampleCount == 0u)
+							{
+								continue;
+							}
+
+							variant.writeLUT = currentMipLevel == 0u && slice == 0u;
+
+							const double texelCount = static_cast<double>(renderArea.extent.width) * renderArea.extent.height;
+							if ((res = submitter.beginPass(texelCount * (6.0 * sampleSlice.sampleCount + (variant.writeLUT ? _output.sampleCount : 0u)))) != Result::Success)
+							{
+								return res;
+							}
+
+							VkPipeline filterPipeline = VK_NULL_HANDLE;
+							if ((res = _context.getFilterPipeline(cubeMapFormat, LUTFormat, variant, filterPipeline)) != Result::Success)
+							{
+								return res;
+							}
+
+							// slices blend into the results of the previous ones, the levels share the LUT attachment
+							if (firstPass == false)
+							{
+								VkMemoryBarrier barrier{};
+								barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+								barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+								barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+								vkCmdPipelineBarrier(cubeMapCmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0u, 1u, &barrier, 0u, nullptr, 0u, nullptr);
+							}
+							firstPass = false;
+
+							vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, filterPipeline);
+							vulkan.bindDescriptorSet(cubeMapCmd, _context.filterPipelineLayout, filterDescriptorSet, VK_PIPELINE_BIND_POINT_GRAPHICS, 0u, { slice * SampleTableHeaderByteSize });
+							vkCmdPushConstants(cubeMapCmd, _context.filterPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(FilterPushConstant), &values);
+
+							if (variant.accumulate)
+							{
+								const float blendConstants[4] = { sampleSlice.weight, sampleSlice.weight, sampleSlice.weight, sampleSlice.weight };
+								vkCmdSetBlendConstants(cubeMapCmd, blendConstants);
+							}
+
+							const VkRenderPass renderPass = variant.accumulate == false ? overwriteRenderPass : (slice == 0u ? clearRenderPass : loadRenderPass);
+
+							vulkan.beginStatistics(cubeMapCmd, profileStage);
+
+							// The viewport always covers the base level, the shader scales the UVs by the current mip level.
+							vulkan.beginRenderPass(cubeMapCmd, renderPass, filterOutputFramebuffer, renderArea, clearValues);
+							vulkan.setViewport(cubeMapCmd, VkExtent2D{ cubeMapSideLength, cubeMapSideLength }, renderArea);
+							vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
+							vulkan.endRenderPass(cubeMapCmd);
+
+							vulkan.endStatistics(cubeMapCmd, profileStage);
+						}
+					}
+				}
+
+				vulkan.endGpuStage(cubeMapCmd, profileStage);
+			}
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////
+	//Output
+
+	VkImageLayout currentCubeMapImageLayout;
+	VkImage convertedCubeMap = VK_NULL_HANDLE;
+
+	if(distribution == IBLLib::Distribution::None)
+	{
+		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	else if (distribution == IBLLib::Distribution::LambertianSH)
+	{
+		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	}
+	else
+	{
+		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	if(vulkanTargetFormat != vulkan.getCreateInfo(outputCubeMap)->format)
+	{
+		if ((res = convertVkFormat(vulkan, cubeMapCmd, outputCubeMap, convertedCubeMap, vulkanTargetFormat, currentCubeMapImageLayout)) != Success)
+		{
+			printf("Failed to convert Image \n");
+			return res;
+		}
+		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+		// the shared input cube map is sampled by the later outputs of the job
+		if (distribution == IBLLib::Distribution::None)
+		{
+			vulkan.imageBarrier(cubeMapCmd, outputCubeMap,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		}
+	}
+	else
+	{
+		convertedCubeMap = outputCubeMap;
+	}
+
+	if (vulkan.endCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	const VkResult submitResult = vulkan.executeCommandBuffer(cubeMapCmd);
+	if (submitResult != VK_SUCCESS)
+	{
+		return submitResult == VK_ERROR_DEVICE_LOST ? Result::DeviceLost : Result::VulkanError;
+	}
+
+	vulkan.destroyCommandBuffer(cubeMapCmd);
+
+	_outCubeMap = convertedCubeMap;
+	_outCubeMapLayout = currentCubeMapImageLayout;
+	_outLUT = outputLUT;
+
+	return Result::Success;
+}
+
+// Called after the submission of each output, the images are valid until the end of the job.
+// _LUT is VK_NULL_HANDLE and _SHCoefficients is empty unless the distribution produces them.
+using OutputWriter = std::function<Result(uint32_t _index, const OutputDesc& _output, VkImage _cubeMap, VkImageLayout _cubeMapLayout, VkImage _LUT,
+	const std::vector<float>& _SHCoefficients)>;
+
+// Shares the input cube map and its mip levels between all outputs of a job
+Result sampleCubeMaps(Context& _context, const VkImage _panoramaImage, bool _inputIsCubemap, uint32_t _inputLevelCount, uint32_t _defaultCubemapResolution, const OutputDesc* _outputs, uint32_t _outputCount, const OutputWriter& _writeOutput)
+{
+	IBLLib::Result res = Result::Success;
+
+	std::vector<OutputDesc> outputs(_outputCount);
+	std::vector<uint32_t> maxMipLevels(_outputCount);
+
+	uint32_t inputSideLength = 0u;
+	uint32_t inputMipLevels = 1u;
+
+	for (uint32_t i = 0; i < _outputCount; ++i)
+	{
+		if ((res = resolveOutput(_outputs[i], _defaultCubemapResolution, outputs[i], maxMipLevels[i])) != Result::Success)
+		{
+			return res;
+		}
+
+		inputSideLength = std::max(inputSideLength, outputs[i].cubemapResolution);
+		inputMipLevels = std::max(inputMipLevels, maxMipLevels[i]);
+	}
+
+	if (_inputIsCubemap)
+	{
+		const VkImageCreateInfo* pInfo = _context.vulkan.getCreateInfo(_panoramaImage);
+		inputSideLength = pInfo->extent.width;
+	}
+
+	// the SH projection reads a small level of the input, generate the levels down to it
+	for (uint32_t i = 0; i < _outputCount; ++i)
+	{
+		if (outputs[i].distribution == Distribution::LambertianSH)
+		{
+			inputMipLevels = std::max(inputMipLevels, getSHProjectionLevel(inputSideLength, UINT32_MAX) + 1u);
+		}
+	}
+
+	if (_inputIsCubemap)
+	{
+		inputMipLevels = std::min(inputMipLevels, _context.vulkan.getCreateInfo(_panoramaImage)->mipLevels);
+	}
+
+	if ((inputSideLength >> (inputMipLevels - 1)) < 1)
+	{
+		printf("Error: CubemapResolution incompatible with MipmapCount\n");
+		return Result::InvalidArgument;
+	}
+
+	VkImage inputCubeMap = VK_NULL_HANDLE;
+	if ((res = createInputCubeMap(_context, _panoramaImage, _inputIsCubemap, _inputLevelCount, inputSideLength, inputMipLevels, inputCubeMap)) != Result::Success)
+	{
+		return res;
+	}
+
+	for (uint32_t i = 0; i < _outputCount; ++i)
+	{
+		VkImage outputCubeMap = VK_NULL_HANDLE;
+		VkImageLayout outputCubeMapLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImage outputLUT = VK_NULL_HANDLE;
+		std::vector<float> SHCoefficients;
+
+		_context.vulkan.setProfileOutput(static_cast<int32_t>(i));
+
+		if ((res = filterCubeMap(_context, inputCubeMap, outputs[i], maxMipLevels[i], outputCubeMap, outputCubeMapLayout, outputLUT, SHCoefficients)) != Result::Success)
+		{
+			return res;
+		}
+
+		if ((res = _writeOutput(i, outputs[i], outputCubeMap, outputCubeMapLayout, outputLUT, SHCoefficients)) != Result::Success)
+		{
+			return res;
+		}
+	}
+
+	return Result::Success;
+}
+
+Result sampleCubeMaps(Context& _context, const char* _inputPath, const OutputDesc* _outputs, uint32_t _outputCount)
+{
+	IBLLib::Result res = Result::Success;
+
+	vkHelper& vulkan = _context.vulkan;
+
+	if (_outputCount == 0u || _outputs == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	// explicit values only affect the mip levels allocated for cube map inputs
+	uint32_t explicitCubemapResolution = 0u;
+	uint32_t explicitMipCount = 0u;
+	for (uint32_t i = 0; i < _outputCount; ++i)
+	{
+		explicitCubemapResolution = std::max(explicitCubemapResolution, _outputs[i].cubemapResolution);
+		explicitMipCount = std::max(explicitMipCount, _outputs[i].mipmapCount);
+	}
+
+	VkImage panoramaImage;
+	bool inputIsCubemap;
+	uint32_t inputLevelCount = 0u;
+
+	uint32_t defaultCubemapResolution = 0;
+	if ((res = uploadImage(vulkan, _context.threadPool.get(), _inputPath, _context.intermediateFormat, panoramaImage, defaultCubemapResolution, explicitCubemapResolution, explicitMipCount, inputIsCubemap, inputLevelCount)) != Result::Success)
+	{
+		return res;
+	}
+
+	return sampleCubeMaps(_context, panoramaImage, inputIsCubemap, inputLevelCount, defaultCubemapResolution, _outputs, _outputCount,
+		[&vulkan, &_context](uint32_t, const OutputDesc& _output, VkImage _cubeMap, VkImageLayout _cubeMapLayout, VkImage _LUT, const std::vector<float>& _SHCoefficients)
+	{
+		if (_output.outputPathCubeMap != nullptr)
+		{
+			if (downloadCubemap(vulkan, _context.threadPool.get(), &_context.sharedExponentEncoder, _cubeMap, _output.outputPathCubeMap, static_cast<VkFormat>(_output.targetFormat), _cubeMapLayout, createSHKeyValues(_SHCoefficients)) != Result::Success)
+			{
+				printf("Failed to download Image \n");
+				return Result::VulkanError;
+			}
+		}
+
+		if (_output.outputPathLUT != nullptr && _LUT != VK_NULL_HANDLE)
+		{
+			if (download2DImage(vulkan, _LUT, _output.outputPathLUT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) != Result::Success)
+			{
+				printf("Failed to download Image \n");
+				return Result::VulkanError;
+			}
+		}
+
+		return Result::Success;
+	});
+}
+
+Result sampleCubeMap(Context& _context, const InputImage& _input, const OutputBuffers& _output, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias)
+{
+	IBLLib::Result res = Result::Success;
+
+	vkHelper& vulkan = _context.vulkan;
+
+	// the faces of a cube map are square like the sides of a cube compatible image
+	if (_input.data == nullptr || _input.width == 0u || _input.height == 0u || (_input.faceCount != 1u && _input.faceCount != 6u) ||
+		(_input.faceCount == 6u && _input.width != _input.height) ||
+		(_input.format != InputFormat::R32G32B32A32_SFLOAT && _input.format != InputFormat::R16G16B16A16_SFLOAT))
+	{
+		return Result::InvalidArgument;
+	}
+
+	VkImage panoramaImage = VK_NULL_HANDLE;
+	const bool inputIsCubemap = _input.faceCount == 6u;
+
+	uint32_t defaultCubemapResolution = 0;
+	uint32_t inputLevelCount = 0u;
+	if ((res = uploadImage(vulkan, _context.threadPool.get(), _input.width, _input.height, _input.faceCount, static_cast<VkFormat>(_input.format), { static_cast<const uint8_t*>(_input.data) },
+		getUploadFormat(_context.intermediateFormat, static_cast<VkFormat>(_input.format)), defaultCubemapResolution, _cubemapResolution, _mipmapCount, panoramaImage, inputLevelCount)) != Result::Success)
+	{
+		return res;
+	}
+
+	OutputDesc output{};
+	output.distribution = _distribution;
+	output.cubemapResolution = _cubemapResolution;
+	output.mipmapCount = _mipmapCount;
+	output.sampleCount = _sampleCount;
+	output.targetFormat = _targetFormat;
+	output.lodBias = _lodBias;
+
+	return sampleCubeMaps(_context, panoramaImage, inputIsCubemap, inputLevelCount, defaultCubemapResolution, &output, 1u,
+		[&vulkan, &_context, &_output](uint32_t, const OutputDesc& _resolvedOutput, VkImage _cubeMap, VkImageLayout _cubeMapLayout, VkImage _LUT, const std::vector<float>&)
+	{
+		Result res = downloadCubemap(vulkan, _context.threadPool.get(), &_context.sharedExponentEncoder, _cubeMap, _output, static_cast<VkFormat>(_resolvedOutput.targetFormat), _cubeMapLayout);
+		if (res != Result::Success)
+		{
+			printf("Failed to download Image \n");
+			return res;
+		}
+
+		if (_output.LUTData != nullptr && _LUT != VK_NULL_HANDLE)
+		{
+			std::vector<uint8_t> LUTData;
+			if ((res = download2DImage(vulkan, _LUT, LUTData, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)) != Result::Success)
+			{
+				printf("Failed to download Image \n");
+				return res;
+			}
+
+			return copyLUT(_output, LUTData);
+		}
+
+		return Result::Success;
+	});
+}
+
+// Converts the levels of a host cube map to the target format and passes them on level by level
+Result writeCubeMapOnCPU(ThreadPool& _pool, const CpuCubeMap& _cubeMap, uint32_t _mipLevels, const VkFormat _targetFormat, const LevelWriter& _writeLevel)
+{
+	const size_t targetFormatByteSize = getFormatSize(_targetFormat);
+	std::vector<uint8_t> targetData;
+
+	for (uint32_t level = 0; level < _mipLevels; level++)
+	{
+		const uint32_t sideLength = std::max(_cubeMap.sideLength >> level, 1u);
+		const size_t texelCount = static_cast<size_t>(sideLength) * sideLength * 6u;
+
+		targetData.resize(texelCount * targetFormatByteSize);
+
+		if (convertTexels(targetData.data(), _targetFormat, reinterpret_cast<const uint8_t*>(_cubeMap.levels[level].data()), VK_FORMAT_R32G32B32A32_SFLOAT, texelCount, &_pool) == false)
+		{
+			return Result::InvalidArgument;
+		}
+
+		Result res = _writeLevel(level, sideLength, targetData.data(), targetData.size());
+		if (res != Result::Success)
+		{
+			return res;
+		}
+	}
+
+	return Result::Success;
+}
+
+// Called after each output of a CPU job, _LUT is empty for Distribution::None and LambertianSH, _SHCoefficients unless LambertianSH
+using CpuOutputWriter = std::function<Result(uint32_t _index, const OutputDesc& _output, const CpuCubeMap& _cubeMap, uint32_t _mipLevels, const std::vector<uint8_t>& _LUT,
+	const std::vector<float>& _SHCoefficients)>;
+
+// Host counterpart of sampleCubeMaps, _inputLevels holds the panorama or the first mip levels of the cube map in _inputFormat
+Result sampleCubeMapsOnCPU(Context& _context, VkFormat _inputFormat, const std::vector<const uint8_t*>& _inputLevels, uint32_t _width, uint32_t _height, bool _inputIsCubemap, uint32_t _defaultCubemapResolution, const OutputDesc* _outputs, uint32_t _outputCount, const CpuOutputWriter& _writeOutput)
+{
+	IBLLib::Result res = Result::Success;
+
+	ThreadPool& pool = *_context.threadPool;
+
+	std::vector<OutputDesc> outputs(_outputCount);
+	std::vector<uint32_t> maxMipLevels(_outputCount);
+
+	uint32_t inputSideLength = 0u;
+	uint32_t inputMipLevels = 1u;
+
+	for (uint32_t i = 0; i < _outputCount; ++i)
+	{
+		if ((res = resolveOutput(_outputs[i], _defaultCubemapResolution, outputs[i], maxMipLevels[i])) != Result::Success)
+		{
+			return res;
+		}
+
+		inputSideLength = std::max(inputSideLength, outputs[i].cubemapResolution);
+		inputMipLevels = std::max(inputMipLevels, maxMipLevels[i]);
+	}
+
+	if (_inputIsCubemap)
+	{
+		uint32_t fullMipLevels = 0u;
+		for (uint32_t m = _width; m > 0; m = m >> 1, ++fullMipLevels) {}
+
+		inputSideLength = _width;
+		inputMipLevels = std::min(inputMipLevels, fullMipLevels);
+	}
+
+	// the SH projection reads a small level of the input, generate the levels down to it
+	for (uint32_t i = 0; i < _outputCount; ++i)
+	{
+		if (outputs[i].distribution == Distribution::LambertianSH)
+		{
+			inputMipLevels = std::max(inputMipLevels, getSHProjectionLevel(inputSideLength, UINT32_MAX) + 1u);
+		}
+	}
+
+	if ((inputSideLength >> (inputMipLevels - 1)) < 1)
+	{
+		printf("Error: CubemapResolution incompatible with MipmapCount\n");
+		return Result::InvalidArgument;
+	}
+
+	CpuCubeMap inputCubeMap;
+	if (_inputIsCubemap)
+	{
+		// the levels of the input are converted straight into the cube map, only the missing ones are generated
+		const uint32_t levelCount = std::min(static_cast<uint32_t>(_inputLevels.size()), inputMipLevels);
+
+		std::vector<ConversionJob> jobs(levelCount);
+		inputCubeMap.sideLength = _width;
+		inputCubeMap.levels.resize(levelCount);
+
+		for (uint32_t level = 0; level < levelCount; ++level)
+		{
+			const size_t sideLength = std::max(_width >> level, 1u);
+			inputCubeMap.levels[level].resize(sideLength * sideLength * 6u * 4u);
+			jobs[level] = { _inputLevels[level], reinterpret_cast<uint8_t*>(inputCubeMap.levels[level].data()), sideLength * sideLength * 6u };
+		}
+
+		if (!convertTexels(jobs.data(), jobs.size(), VK_FORMAT_R32G32B32A32_SFLOAT, _inputFormat, &pool))
+		{
+			return Result::InvalidArgument;
+		}
+	}
+	else
+	{
+		std::vector<float> convertedPanorama;
+		const float* panorama = reinterpret_cast<const float*>(_inputLevels[0]);
+
+		if (_inputFormat != VK_FORMAT_R32G32B32A32_SFLOAT || reinterpret_cast<uintptr_t>(panorama) % alignof(float) != 0u)
+		{
+			const size_t texelCount = static_cast<size_t>(_width) * _height;
+			convertedPanorama.resize(texelCount * 4u);
+
+			if (!convertTexels(reinterpret_cast<uint8_t*>(convertedPanorama.data()), VK_FORMAT_R32G32B32A32_SFLOAT, _inputLevels[0], _inputFormat, texelCount, &pool))
+			{
+				return Result::InvalidArgument;
+			}
+			panorama = convertedPanorama.data();
+		}
+
+		panoramaToCubeMapOnCPU(pool, panorama, _width, _height, inputSideLength, inputCubeMap);
+	}
+
+	generateMipmapLevelsOnCPU(pool, inputCubeMap, inputMipLevels);
+
+	for (uint32_t i = 0; i < _outputCount; ++i)
+	{
+		const OutputDesc& output = outputs[i];
+
+		CpuCubeMap filteredCubeMap;
+		std::vector<uint8_t> LUT;
+		std::vector<float> SHCoefficients;
+
+		if (output.distribution == Distribution::None)
+		{
+			if (output.cubemapResolution != inputSideLength || maxMipLevels[i] != inputMipLevels)
+			{
+				printf("Error: Distribution None requires the resolution and mip count of the input cube map\n");
+				return Result::InvalidArgument;
+			}
+		}
+		else if (output.distribution == Distribution::LambertianSH)
+		{
+			printf("Projecting lambertian onto spherical harmonics\n");
+
+			float coefficients[SH9CoefficientCount];
+			projectSH9OnCPU(inputCubeMap, getSHProjectionLevel(inputSideLength, inputMipLevels), coefficients);
+			printSHError(inputCubeMap, coefficients, output);
+
+			evaluateSH9IrradianceOnCPU(coefficients, output.cubemapResolution, filteredCubeMap);
+			SHCoefficients.assign(coefficients, coefficients + SH9CoefficientCount);
+		}
+		else
+		{
+			filterCubeMapOnCPU(pool, inputCubeMap, std::min(maxMipLevels[i], inputMipLevels), output.distribution,
+				output.cubemapResolution, maxMipLevels[i], output.sampleCount, output.lodBias, filteredCubeMap);
+			computeLUTOnCPU(pool, output.distribution, output.cubemapResolution, output.sampleCount, LUT);
+		}
+
+		const CpuCubeMap& outputCubeMap = output.distribution == Distribution::None ? inputCubeMap : filteredCubeMap;
+
+		if ((res = _writeOutput(i, output, outputCubeMap, maxMipLevels[i], LUT, SHCoefficients)) != Result::Success)
+		{
+			return res;
+		}
+	}
+
+	return Result::Success;
+}
+
+Result sampleCubeMapsOnCPU(Context& _context, const char* _inputPath, const OutputDesc* _outputs, uint32_t _outputCount)
+{
+	IBLLib::Result res = Result::Success;
+
+	if (_outputCount == 0u || _outputs == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	bool isKtx = false;
+	KTXHeader ktxHeader;
+	MappedFile ktxFile;
+	std::vector<const uint8_t*> inputLevels;
+
+	if ((res = loadKtxImage(_inputPath, ktxFile, isKtx, ktxHeader, inputLevels)) != Result::Success)
+	{
+		return res;
+	}
+
+	VkFormat inputFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+	uint32_t width = 0u, height = 0u;
+	bool inputIsCubemap = false;
+
+	HdrImage hdrImage;
+	std::vector<float> decodedPanorama;
+	STBImage panorama;
+	if (isKtx)
+	{
+		inputFormat = static_cast<VkFormat>(ktxHeader.vkFormat);
+		width = ktxHeader.pixelWidth;
+		height = ktxHeader.pixelHeight;
+		inputIsCubemap = ktxHeader.faceCount == 6u;
+	}
+	else if (hdrImage.open(_inputPath))
+	{
+		width = hdrImage.getWidth();
+		height = hdrImage.getHeight();
+
+		decodedPanorama.resize(static_cast<size_t>(width) * height * 4u);
+		if (hdrImage.decode(reinterpret_cast<uint8_t*>(decodedPanorama.data()), VK_FORMAT_R32G32B32A32_SFLOAT, _context.threadPool.get()) == false)
+		{
+			return Result::InputPanoramaFileNotFound;
+		}
+
+		inputLevels.push_back(reinterpret_cast<const uint8_t*>(decodedPanorama.data()));
+	}
+	else
+	{
+		if (panorama.loadHdr(_inputPath) != Result::Success)
+		{
+			return Result::InputPanoramaFileNotFound;
+		}
+
+		inputLevels.push_back(reinterpret_cast<const uint8_t*>(panorama.getHdrData()));
+		width = panorama.getWidth();
+		height = panorama.getHeight();
+	}
+
+	const uint32_t defaultCubemapResolution = inputIsCubemap ? height : height / 2;
+
+	return sampleCubeMapsOnCPU(_context, inputFormat, inputLevels, width, height, inputIsCubemap, defaultCubemapResolution, _outputs, _outputCount,
+		[&_context](uint32_t, const OutputDesc& _output, const CpuCubeMap& _cubeMap, uint32_t _mipLevels, const std::vector<uint8_t>& _LUT, const std::vector<float>& _SHCoefficients)
+	{
+		Result res = Result::Success;
+
+		if (_output.outputPathCubeMap != nullptr)
+		{
+			const VkFormat targetFormat = static_cast<VkFormat>(_output.targetFormat);
+			KtxImage ktxImage(_cubeMap.sideLength, _cubeMap.sideLength, targetFormat, _mipLevels, true, createSHKeyValues(_SHCoefficients));
+
+			if ((res = ktxImage.open(_output.outputPathCubeMap)) != Result::Success)
+			{
+				printf("Could not save to path %s \n", _output.outputPathCubeMap);
+				return res;
+			}
+
+			res = writeCubeMapOnCPU(*_context.threadPool, _cubeMap, _mipLevels, targetFormat, [&ktxImage](uint32_t _level, uint32_t, const uint8_t* _data, size_t _byteSize)
+			{
+				return ktxImage.writeLevel(_data, _byteSize, _level);
+			});
+
+			if (res != Result::Success)
+			{
+				return res;
+			}
+
+			if ((res = ktxImage.close()) != Result::Success)
+			{
+				printf("Could not save to path %s \n", _output.outputPathCubeMap);
+				return res;
+			}
+		}
+
+		if (_output.outputPathLUT != nullptr && !_LUT.empty())
+		{
+			if ((res = saveLUT(_output.outputPathLUT, _LUT, _cubeMap.sideLength, _cubeMap.sideLength, VK_FORMAT_R8G8B8A8_UNORM)) != Result::Success)
+			{
+				return res;
+			}
+		}
+
+		return Result::Success;
+	});
+}
+
+Result sampleCubeMapOnCPU(Context& _context, const InputImage& _input, const OutputBuffers& _output, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias)
+{
+	// the faces of a cube map are square like the sides of a cube compatible image
+	if (_input.data == nullptr || _input.width == 0u || _input.height == 0u || (_input.faceCount != 1u && _input.faceCount != 6u) ||
+		(_input.faceCount == 6u && _input.width != _input.height) ||
+		(_input.format != InputFormat::R32G32B32A32_SFLOAT && _input.format != InputFormat::R16G16B16A16_SFLOAT))
+	{
+		return Result::InvalidArgument;
+	}
+
+	const bool inputIsCubemap = _input.faceCount == 6u;
+
+	OutputDesc output{};
+	output.distribution = _distribution;
+	output.cubemapResolution = _cubemapResolution;
+	output.mipmapCount = _mipmapCount;
+	output.sampleCount = _sampleCount;
+	output.targetFormat = _targetFormat;
+	output.lodBias = _lodBias;
+
+	const uint32_t defaultCubemapResolution = inputIsCubemap ? _input.height : _input.height / 2;
+
+	return sampleCubeMapsOnCPU(_context, static_cast<VkFormat>(_input.format), { static_cast<const uint8_t*>(_input.data) }, _input.width, _input.height, inputIsCubemap,
+		defaultCubemapResolution, &output, 1u,
+		[&_context, &_output](uint32_t, const OutputDesc& _resolvedOutput, const CpuCubeMap& _cubeMap, uint32_t _mipLevels, const std::vector<uint8_t>& _LUT, const std::vector<float>&)
+	{
+		const VkFormat targetFormat = static_cast<VkFormat>(_resolvedOutput.targetFormat);
+
+		LevelWriter writeLevel;
+		Result res = createLevelWriter(_output, _cubeMap.sideLength, _mipLevels, targetFormat, writeLevel);
+		if (res != Result::Success)
+		{
+			return res;
+		}
+
+		if ((res = writeCubeMapOnCPU(*_context.threadPool, _cubeMap, _mipLevels, targetFormat, writeLevel)) != Result::Success)
+		{
+			return res;
+		}
+
+		if (_output.LUTData != nullptr && !_LUT.empty())
+		{
+			return copyLUT(_output, _LUT);
+		}
+
+		return Result::Success;
+	});
+}
+
+// Copies the stages of the finished job into the context for getProfile()
+Result resolveProfile(Context& _context)
+{
+	std::vector<vkHelper::ProfileStage> stages;
+	if (_context.vulkan.resolveProfile(stages) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	_context.profile.resize(stages.size());
+
+	for (size_t i = 0; i < stages.size(); ++i)
+	{
+		ProfileStage& stage = _context.profile[i];
+		snprintf(stage.name, sizeof(stage.name), "%s", stages[i].name.c_str());
+		stage.output = stages[i].output;
+		stage.gpuMs = stages[i].gpuMs;
+		stage.hostMs = stages[i].hostMs;
+		stage.fragmentInvocations = stages[i].fragmentInvocations;
+		stage.computeInvocations = stages[i].computeInvocations;
+	}
+
+	return Result::Success;
+}
+
+// Runs a job of the Vulkan backends, it is restarted on a new device while recreateLostDevice() allows it
+Result runVulkanJob(Context& _context, const std::function<Result()>& _job)
+{
+	for (;;)
+	{
+		_context.largestTileSize = 0u;
+
+		_context.profile.clear();
+		_context.vulkan.resetProfile();
+
+		// everything but the context state is released at the end of the job, also on failure
+		_context.vulkan.beginTransientResources();
+		Result res = _job();
+		_context.vulkan.releaseTransientResources();
+
+		if (res == Result::Success && _context.profiling)
+		{
+			return resolveProfile(_context);
+		}
+
+		if (res != Result::DeviceLost)
+		{
+			return res;
+		}
+
+		if ((res = _context.recreateLostDevice()) != Result::Success)
+		{
+			return res;
+		}
+	}
+}
+} // !IBLLib
+
+IBLLib::Result IBLLib::createContext(Context*& _outContext, bool _debugOutput, Backend _backend)
+{
+	_outContext = new Context();
+
+	Result res = _outContext->initialize(_debugOutput, _backend);
+	if (res != Result::Success)
+	{
+		delete _outContext;
+		_outContext = nullptr;
+	}
+
+	return res;
+}
+
+void IBLLib::destroyContext(Context* _context)
+{
+	delete _context;
+}
+
+IBLLib::Result IBLLib::setSubmitOptions(Context* _context, const SubmitOptions& _options)
+{
+	if (_context == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	_context->submitOptions = _options;
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::setIntermediateFormat(Context* _context, IntermediateFormat _format)
+{
+	if (_context == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	VkFormat format = static_cast<VkFormat>(_format);
+	if (format != VK_FORMAT_R32G32B32A32_SFLOAT && format != VK_FORMAT_R16G16B16A16_SFLOAT && format != VK_FORMAT_B10G11R11_UFLOAT_PACK32)
+	{
+		return Result::InvalidArgument;
+	}
+
+	// the panorama is rendered into the cube map, the mip levels are blitted and the filter samples them linearly
+	const VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	if (_context->backend != Backend::CPU && (_context->vulkan.getOptimalTilingFeatures(format) & requiredFeatures) != requiredFeatures)
+	{
+		printf("Intermediate format %u is not supported by the device, using R16G16B16A16_SFLOAT\n", static_cast<uint32_t>(format));
+		format = VK_FORMAT_R16G16B16A16_SFLOAT;
+	}
+
+	_context->intermediateFormat = format;
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::startTrace(const char* _outputPath)
+{
+	return Trace::start(_outputPath) ? Result::Success : Result::InvalidArgument;
+}
+
+IBLLib::Result IBLLib::stopTrace()
+{
+	return Trace::stop() ? Result::Success : Result::FileNotFound;
+}
+
+IBLLib::Result IBLLib::setProfiling(Context* _context, bool _enable)
+{
+	if (_context == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (_context->backend == Backend::CPU)
+	{
+		printf("Error: Profiling requires a Vulkan backend\n");
+		return Result::InvalidArgument;
+	}
+
+	if (_context->vulkan.enableProfiling(_enable) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	_context->profiling = _enable;
+	_context->profile.clear();
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::getProfile(Context* _context, const ProfileStage*& _outStages, unsigned int& _outStageCount)
+{
+	if (_context == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	_outStages = _context->profile.data();
+	_outStageCount = static_cast<unsigned int>(_context->profile.size());
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::sample(Context* _context, const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias)
+{
+	if (_context == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	OutputDesc output{};
+	output.distribution = _distribution;
+	output.cubemapResolution = _cubemapResolution;
+	output.mipmapCount = _mipmapCount;
+	output.sampleCount = _sampleCount;
+	output.targetFormat = _targetFormat;
+	output.lodBias = _lodBias;
+	output.outputPathCubeMap = _outputPathCubeMap;
+	output.outputPathLUT = _outputPathLUT;
+
+	return sample(_context, _inputPath, &output, 1u);
+}
+
+IBLLib::Result IBLLib::sample(Context* _context, const char* _inputPath, const OutputDesc* _outputs, unsigned int _outputCount)
+{
+	if (_context == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (_context->backend == Backend::CPU)
+	{
+		return sampleCubeMapsOnCPU(*_context, _inputPath, _outputs, _outputCount);
+	}
+
+	return runVulkanJob(*_context, [&]()
+	{
+		return sampleCubeMaps(*_context, _inputPath, _outputs, _outputCount);
+	});
+}
+
+IBLLib::Result IBLLib::sample(Context* _context, const InputImage& _input, const OutputBuffers& _output, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias)
+{
+	if (_context == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (_context->backend == Backend::CPU)
+	{
+		return sampleCubeMapOnCPU(*_context, _input, _output, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias);
+	}
+
+	return runVulkanJob(*_context, [&]()
+	{
+		return sampleCubeMap(*_context, _input, _output, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias);
+	});
+}
+
+IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput)
+{
+	Context context;
+
+	Result res = context.initialize(_debugOutput);
+	if (res != Result::Success)
+	{
+		return res;
+	}
+
+	return sample(&context, _inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias);
+}
+
+extern "C"
 {
 
 IBLLib::Result IBLSample(
@@ -1267,4 +3574,102 @@ IBLLib::Result IBLSample(
 	return IBLLib::sample(_inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias, _debugOutput);
 }
 
+IBLLib::Result IBLCreateContext(IBLLib::Context** _outContext, bool _debugOutput, IBLLib::Backend _backend)
+{
+	if (_outContext == nullptr)
+	{
+		return IBLLib::Result::InvalidArgument;
+	}
+
+	return IBLLib::createContext(*_outContext, _debugOutput, _backend);
+}
+
+void IBLDestroyContext(IBLLib::Context* _context)
+{
+	IBLLib::destroyContext(_context);
+}
+
+IBLLib::Result IBLSetSubmitOptions(IBLLib::Context* _context, const IBLLib::SubmitOptions* _options)
+{
+	if (_options == nullptr)
+	{
+		return IBLLib::Result::InvalidArgument;
+	}
+
+	return IBLLib::setSubmitOptions(_context, *_options);
+}
+
+IBLLib::Result IBLSetIntermediateFormat(IBLLib::Context* _context, IBLLib::IntermediateFormat _format)
+{
+	return IBLLib::setIntermediateFormat(_context, _format);
+}
+
+IBLLib::Result IBLStartTrace(const char* _outputPath)
+{
+	return IBLLib::startTrace(_outputPath);
+}
+
+IBLLib::Result IBLStopTrace()
+{
+	return IBLLib::stopTrace();
+}
+
+IBLLib::Result IBLSetProfiling(IBLLib::Context* _context, bool _enable)
+{
+	return IBLLib::setProfiling(_context, _enable);
+}
+
+IBLLib::Result IBLGetProfile(IBLLib::Context* _context, const IBLLib::ProfileStage** _outStages, unsigned int* _outStageCount)
+{
+	if (_outStages == nullptr || _outStageCount == nullptr)
+	{
+		return IBLLib::Result::InvalidArgument;
+	}
+
+	return IBLLib::getProfile(_context, *_outStages, *_outStageCount);
+}
+
+IBLLib::Result IBLSampleWithContext(
+	IBLLib::Context* _context,
+	const char* _inputPath,
+	const char* _outputPathCubeMap,
+	const char* _outputPathLUT,
+	IBLLib::Distribution _distribution,
+	unsigned int  _cubemapResolution,
+	unsigned int _mipmapCount,
+	unsigned int _sampleCount,
+	IBLLib::OutputFormat _targetFormat,
+	float _lodBias)
+{
+	return IBLLib::sample(_context, _inputPath, _outputPathCubeMap, _outputPathLUT, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias);
+}
+
+IBLLib::Result IBLSampleMemory(
+	IBLLib::Context* _context,
+	const IBLLib::InputImage* _input,
+	const IBLLib::OutputBuffers* _output,
+	IBLLib::Distribution _distribution,
+	unsigned int  _cubemapResolution,
+	unsigned int _mipmapCount,
+	unsigned int _sampleCount,
+	IBLLib::OutputFormat _targetFormat,
+	float _lodBias)
+{
+	if (_input == nullptr || _output == nullptr)
+	{
+		return IBLLib::Result::InvalidArgument;
+	}
+
+	return IBLLib::sample(_context, *_input, *_output, _distribution, _cubemapResolution, _mipmapCount, _sampleCount, _targetFormat, _lodBias);
+}
+
+IBLLib::Result IBLSampleMultiple(
+	IBLLib::Context* _context,
+	const char* _inputPath,
+	const IBLLib::OutputDesc* _outputs,
+	unsigned int _outputCount)
+{
+	return IBLLib::sample(_context, _inputPath, _outputs, _outputCount);
+}
+
 }
@@ -13,15 +13,35 @@ const uint cLambertian = 1;
 const uint cGGX = 2;
 const uint cCharlie = 3;
 
+// a filter pipeline is created per combination, see Context::getFilterPipeline()
+layout(constant_id = 0) const uint cDistribution = 1u; // enum
+layout(constant_id = 1) const uint cSampleCount = 1024u;
+layout(constant_id = 2) const bool cWriteLUT = true; // only the pass of mip level 0 writes the LUT
+
 layout(push_constant) uniform FilterParameters {
   float roughness;
-  uint sampleCount;
   uint currentMipLevel;
   uint width;
   float lodBias;
-  uint distribution; // enum
 } pFilterParameters;
 
+// importance samples of every mip level in tangent space, see computeSampleTable() in cpuFilter.h
+layout(std430, set = 0, binding = 4) readonly buffer SampleTable {
+  uvec2 levels[32]; // first sample and sample count
+  vec4 samples[]; // xyz: direction, w: lod
+} sSampleTable;
+
+#ifdef COMPUTE_SHADER
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// output cubemap mip level, one layer per face
+layout(set = 0, binding = 2, rgba32f) uniform writeonly image2DArray uOutputFaces;
+
+layout(set = 0, binding = 3, rgba8) uniform writeonly image2D uOutputLUT;
+
+#else
+
 layout (location = 0) in vec2 inUV;
 
 // output cubemap faces
@@ -52,6 +72,8 @@ void writeFace(int face, vec3 colorIn)
 		outFace5 = color;
 }
 
+#endif
+
 vec3 uvToXYZ(int face, vec2 uv)
 {
     if(face == 0)
@@ -238,23 +260,23 @@ MicrofacetDistributionSample Lambertian(vec2 xi, float roughness)
 vec4 getImportanceSample(int sampleIndex, vec3 N, float roughness)
 {
     // generate a quasi monte carlo point in the unit square [0.1)^2
-    vec2 xi = hammersley2d(sampleIndex, int(pFilterParameters.sampleCount));
+    vec2 xi = hammersley2d(sampleIndex, int(cSampleCount));
 
     MicrofacetDistributionSample importanceSample;
 
     // generate the points on the hemisphere with a fitting mapping for
     // the distribution (e.g. lambertian uses a cosine importance)
-    if(pFilterParameters.distribution == cLambertian)
+    if(cDistribution == cLambertian)
     {
         importanceSample = Lambertian(xi, roughness);
     }
-    else if(pFilterParameters.distribution == cGGX)
+    else if(cDistribution == cGGX)
     {
         // Trowbridge-Reitz / GGX microfacet model (Walter et al)
         // https://www.cs.cornell.edu/~srm/publications/EGSR07-btdf.html
         importanceSample = GGX(xi, roughness);
     }
-    else if(pFilterParameters.distribution == cCharlie)
+    else if(cDistribution == cCharlie)
     {
         importanceSample = Charlie(xi, roughness);
     }
@@ -272,84 +294,32 @@ vec4 getImportanceSample(int sampleIndex, vec3 N, float roughness)
     return vec4(direction, importanceSample.pdf);
 }
 
-// Mipmap Filtered Samples (GPU Gems 3, 20.4)
-// https://developer.nvidia.com/gpugems/gpugems3/part-iii-rendering/chapter-20-gpu-based-importance-sampling
-// https://cgg.mff.cuni.cz/~jaroslav/papers/2007-sketch-fis/Final_sap_0073.pdf
-float computeLod(float pdf)
-{
-    // // Solid angle of current sample -- bigger for less likely samples
-    // float omegaS = 1.0 / (float(FilterParameters.sampleCoun) * pdf);
-    // // Solid angle of texel
-    // // note: the factor of 4.0 * UX3D_MATH_PI 
-    // float omegaP = 4.0 * UX3D_MATH_PI / (6.0 * float(pFilterParameters.width) * float(pFilterParameters.width));
-    // // Mip level is determined by the ratio of our sample's solid angle to a texel's solid angle 
-    // // note that 0.5 * log2 is equivalent to log4
-    // float lod = 0.5 * log2(omegaS / omegaP);
-
-    // babylon introduces a factor of K (=4) to the solid angle ratio
-    // this helps to avoid undersampling the environment map
-    // this does not appear in the original formulation by Jaroslav Krivanek and Mark Colbert
-    // log4(4) == 1
-    // lod += 1.0;
-
-    // We achieved good results by using the original formulation from Krivanek & Colbert adapted to cubemaps
-
-    // https://cgg.mff.cuni.cz/~jaroslav/papers/2007-sketch-fis/Final_sap_0073.pdf
-    float lod = 0.5 * log2( 6.0 * float(pFilterParameters.width) * float(pFilterParameters.width) / (float(pFilterParameters.sampleCount) * pdf));
-
-
-    return lod;
-}
-
 vec3 filterColor(vec3 N)
 {
-    //return  textureLod(uCubeMap, N, 3.0).rgb;
     vec3 color = vec3(0.f);
     float weight = 0.0f;
 
-    for(int i = 0; i < int(pFilterParameters.sampleCount); ++i)
-    {
-        vec4 importanceSample = getImportanceSample(i, N, pFilterParameters.roughness);
+    // Lambertian samples hold H, GGX and Charlie samples L = reflect(-N, H) with NdotL in z,
+    // samples with NdotL <= 0 are not in the table
+    uint firstSample = sSampleTable.levels[pFilterParameters.currentMipLevel].x;
+    uint sampleCount = sSampleTable.levels[pFilterParameters.currentMipLevel].y;
 
-        vec3 H = vec3(importanceSample.xyz);
-        float pdf = importanceSample.w;
+    mat3 TBN = generateTBN(N);
 
-        // mipmap filtered samples (GPU Gems 3, 20.4)
-        float lod = computeLod(pdf);
+    for(uint i = 0u; i < sampleCount; ++i)
+    {
+        vec4 tableSample = sSampleTable.samples[firstSample + i];
 
-        // apply the bias to the lod
-        lod += pFilterParameters.lodBias;
+        vec3 sampleColor = textureLod(uCubeMap, TBN * tableSample.xyz, tableSample.w).rgb;
 
-        if(pFilterParameters.distribution == cLambertian)
+        if(cDistribution == cLambertian)
         {
-            // sample lambertian at a lower resolution to avoid fireflies
-            vec3 lambertian = textureLod(uCubeMap, H, lod).rgb;
-
-            //// the below operations cancel each other out
-            // lambertian *= NdotH; // lamberts law
-            // lambertian /= pdf; // invert bias from importance sampling
-            // lambertian /= UX3D_MATH_PI; // convert irradiance to radiance https://seblagarde.wordpress.com/2012/01/08/pi-or-not-to-pi-in-game-lighting-equation/
-
-            color += lambertian;
+            color += sampleColor;
         }
-        else if(pFilterParameters.distribution == cGGX || pFilterParameters.distribution == cCharlie)
+        else
         {
-            // Note: reflect takes incident vector.
-            vec3 V = N;
-            vec3 L = normalize(reflect(-V, H));
-            float NdotL = dot(N, L);
-
-            if (NdotL > 0.0)
-            {
-                if(pFilterParameters.roughness == 0.0)
-                {
-                    // without this the roughness=0 lod is too high
-                    lod = pFilterParameters.lodBias;
-                }
-                vec3 sampleColor = textureLod(uCubeMap, L, lod).rgb;
-                color += sampleColor * NdotL;
-                weight += NdotL;
-            }
+            color += sampleColor * tableSample.z;
+            weight += tableSample.z;
         }
     }
 
@@ -359,7 +329,7 @@ vec3 filterColor(vec3 N)
     }
     else
     {
-        color /= float(pFilterParameters.sampleCount);
+        color /= float(cSampleCount);
     }
 
     return color.rgb ;
@@ -399,7 +369,7 @@ vec3 LUT(float NdotV, float roughness)
     float B = 0.0;
     float C = 0.0;
 
-    for(int i = 0; i < int(pFilterParameters.sampleCount); ++i)
+    for(int i = 0; i < int(cSampleCount); ++i)
     {
         // Importance sampling, depending on the distribution.
         vec4 importanceSample = getImportanceSample(i, N, roughness);
@@ -412,7 +382,7 @@ vec3 LUT(float NdotV, float roughness)
         float VdotH = saturate(dot(V, H));
         if (NdotL > 0.0)
         {
-            if (pFilterParameters.distribution == cGGX)
+            if (cDistribution == cGGX)
             {
                 // LUT for GGX distribution.
 
@@ -426,7 +396,7 @@ vec3 LUT(float NdotV, float roughness)
                 C += 0.0;
             }
 
-            if (pFilterParameters.distribution == cCharlie)
+            if (cDistribution == cCharlie)
             {
                 // LUT for Charlie distribution.
                 float sheenDistribution = D_Charlie(roughness, NdotH);
@@ -442,10 +412,12 @@ vec3 LUT(float NdotV, float roughness)
     // The PDF is simply pdf(v, h) -> NDF * <nh>.
     // To parametrize the PDF over l, use the Jacobian transform, yielding to: pdf(v, l) -> NDF * <nh> / 4<vh>
     // Since the BRDF divide through the PDF to be normalized, the 4 can be pulled out of the integral.
-    return vec3(4.0 * A, 4.0 * B, 4.0 * 2.0 * UX3D_MATH_PI * C) / float(pFilterParameters.sampleCount);
+    return vec3(4.0 * A, 4.0 * B, 4.0 * 2.0 * UX3D_MATH_PI * C) / float(cSampleCount);
 }
 
 
+#ifndef COMPUTE_SHADER
+
 // entry point
 void panoramaToCubeMap() 
 {
@@ -485,10 +457,42 @@ void filterCubeMap()
 	// Write LUT:
 	// x-coordinate: NdotV
 	// y-coordinate: roughness
-	if (pFilterParameters.currentMipLevel == 0)
+	if (cWriteLUT)
 	{
 		
 		outLUT = LUT(inUV.x, inUV.y);
 	
 	}
 }
+
+#else
+
+// entry point
+void filterCubeMapCompute()
+{
+	ivec2 size = imageSize(uOutputFaces).xy;
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+
+	if (texel.x >= size.x || texel.y >= size.y)
+	{
+		return;
+	}
+
+	vec2 uv = (vec2(texel) + 0.5) / vec2(size);
+	int face = int(gl_GlobalInvocationID.z);
+
+	vec3 direction = normalize(uvToXYZ(face, uv*2.0-1.0));
+	direction.y = -direction.y;
+
+	imageStore(uOutputFaces, ivec3(texel, face), vec4(filterColor(direction), 1.0));
+
+	// Write LUT:
+	// x-coordinate: NdotV
+	// y-coordinate: roughness
+	if (cWriteLUT && face == 0)
+	{
+		imageStore(uOutputLUT, texel, vec4(LUT(uv.x, uv.y), 1.0));
+	}
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "threadPool.h"
+
+#include <algorithm>
+
+IBLLib::ThreadPool::ThreadPool(uint32_t _threadCount)
+{
+	if (_threadCount == 0u)
+	{
+		_threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// the thread calling parallelFor is the last worker
+	for (uint32_t i = 1u; i < _threadCount; ++i)
+	{
+		m_threads.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+IBLLib::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (std::thread& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void IBLLib::ThreadPool::parallelFor(uint32_t _count, const std::function<void(uint32_t)>& _func)
+{
+	if (_count == 0u)
+	{
+		return;
+	}
+
+	if (m_threads.empty() || _count == 1u)
+	{
+		for (uint32_t i = 0u; i < _count; ++i)
+		{
+			_func(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_func = &_func;
+		m_count = _count;
+		m_next = 0u;
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	runJobs(_func);
+
+	// workers that did not pick up the job before this point will not see it anymore
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_activeWorkers == 0u; });
+	m_func = nullptr;
+}
+
+void IBLLib::ThreadPool::workerLoop()
+{
+	uint64_t seenGeneration = 0u;
+
+	for (;;)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wake.wait(lock, [&] { return m_stop || (m_func != nullptr && m_generation != seenGeneration); });
+
+		if (m_stop)
+		{
+			return;
+		}
+
+		seenGeneration = m_generation;
+		const std::function<void(uint32_t)>* func = m_func;
+		++m_activeWorkers;
+		lock.unlock();
+
+		runJobs(*func);
+
+		lock.lock();
+		if (--m_activeWorkers == 0u)
+		{
+			m_done.notify_all();
+		}
+	}
+}
+
+void IBLLib::ThreadPool::runJobs(const std::function<void(uint32_t)>& _func)
+{
+	for (uint32_t i = m_next++; i < m_count; i = m_next++)
+	{
+		_func(i);
+	}
+}
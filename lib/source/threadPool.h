@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace IBLLib
+{
+	class ThreadPool
+	{
+	public:
+		// _threadCount == 0 starts one thread per hardware thread
+		explicit ThreadPool(uint32_t _threadCount = 0u);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// calls _func for every index in [0, _count) and returns when all calls are done.
+		// The calling thread takes part in the work, calls must not be nested.
+		void parallelFor(uint32_t _count, const std::function<void(uint32_t)>& _func);
+
+		// worker threads plus the calling thread
+		uint32_t getConcurrency() const { return static_cast<uint32_t>(m_threads.size()) + 1u; }
+
+	private:
+		void workerLoop();
+		void runJobs(const std::function<void(uint32_t)>& _func);
+
+		std::vector<std::thread> m_threads;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+
+		const std::function<void(uint32_t)>* m_func = nullptr;
+		uint32_t m_count = 0u;
+		std::atomic<uint32_t> m_next{ 0u };
+		uint32_t m_activeWorkers = 0u;
+		uint64_t m_generation = 0u;
+		bool m_stop = false;
+	};
+} // !IBLLib
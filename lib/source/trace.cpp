@@ -0,0 +1,113 @@
+#include "trace.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+std::atomic<bool> IBLLib::Trace::s_enabled{ false };
+
+namespace
+{
+	struct TraceEvent
+	{
+		const char* name;
+		uint32_t threadId;
+		int64_t startUs;
+		int64_t durationUs;
+		uint64_t bytes;
+	};
+
+	std::mutex g_traceMutex;
+	std::vector<TraceEvent> g_traceEvents;
+	std::string g_tracePath;
+	std::chrono::steady_clock::time_point g_traceStart;
+
+	std::atomic<uint32_t> g_nextThreadId{ 1u };
+
+	// small ids read better in the trace viewers than hashed std::thread::ids
+	uint32_t getThreadId()
+	{
+		thread_local const uint32_t id = g_nextThreadId.fetch_add(1u);
+		return id;
+	}
+
+	int64_t toMicroseconds(std::chrono::steady_clock::duration _duration)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(_duration).count();
+	}
+} // !anonymous namespace
+
+bool IBLLib::Trace::start(const char* _outputPath)
+{
+	if (_outputPath == nullptr)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(g_traceMutex);
+
+	g_traceEvents.clear();
+	g_tracePath = _outputPath;
+	g_traceStart = std::chrono::steady_clock::now();
+	s_enabled.store(true);
+
+	return true;
+}
+
+bool IBLLib::Trace::stop()
+{
+	std::lock_guard<std::mutex> lock(g_traceMutex);
+
+	if (s_enabled.exchange(false) == false)
+	{
+		return false;
+	}
+
+	FILE* file = fopen(g_tracePath.c_str(), "w");
+	if (file == nullptr)
+	{
+		printf("Could not open %s\n", g_tracePath.c_str());
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GltfIblSampler\"}}");
+
+	for (const TraceEvent& event : g_traceEvents)
+	{
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"host\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld",
+			event.name, event.threadId, static_cast<long long>(event.startUs), static_cast<long long>(event.durationUs));
+
+		if (event.bytes != 0u)
+		{
+			fprintf(file, ",\"args\":{\"bytes\":%llu}", static_cast<unsigned long long>(event.bytes));
+		}
+
+		fprintf(file, "}");
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Trace with %zu events written to %s\n", g_traceEvents.size(), g_tracePath.c_str());
+
+	g_traceEvents.clear();
+
+	return true;
+}
+
+void IBLLib::Trace::addEvent(const char* _name, std::chrono::steady_clock::time_point _start, std::chrono::steady_clock::time_point _end, uint64_t _bytes)
+{
+	const uint32_t threadId = getThreadId();
+
+	std::lock_guard<std::mutex> lock(g_traceMutex);
+
+	// the scope may have started before the trace or ended after it
+	if (s_enabled.load() == false)
+	{
+		return;
+	}
+
+	g_traceEvents.push_back({ _name, threadId, toMicroseconds(_start - g_traceStart), toMicroseconds(_end - _start), _bytes });
+}
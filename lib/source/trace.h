@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace IBLLib
+{
+	// Collects scoped host events of all threads and writes them as Chrome trace-event JSON (chrome://tracing, Perfetto).
+	// Tracing is off until start() is called, a TraceScope then only checks a flag.
+	class Trace
+	{
+	public:
+		// discards the events of a previous trace that was not stopped
+		static bool start(const char* _outputPath);
+
+		// writes the events to the path given to start()
+		static bool stop();
+
+		static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+		// _name must outlive the trace, e.g. a string literal
+		static void addEvent(const char* _name, std::chrono::steady_clock::time_point _start, std::chrono::steady_clock::time_point _end, uint64_t _bytes);
+
+	private:
+		static std::atomic<bool> s_enabled;
+	};
+
+	// Records the lifetime of the scope as a complete event, _bytes is attached to it unless it is 0
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char* _name, uint64_t _bytes = 0u) :
+			m_name(Trace::isEnabled() ? _name : nullptr), m_bytes(_bytes)
+		{
+			if (m_name != nullptr)
+			{
+				m_start = std::chrono::steady_clock::now();
+			}
+		}
+
+		~TraceScope()
+		{
+			if (m_name != nullptr)
+			{
+				Trace::addEvent(m_name, m_start, std::chrono::steady_clock::now(), m_bytes);
+			}
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+		// for scopes that only know their size at the end
+		void setBytes(uint64_t _bytes) { m_bytes = _bytes; }
+
+	private:
+		const char* m_name;
+		uint64_t m_bytes;
+		std::chrono::steady_clock::time_point m_start;
+	};
+} // !IBLLib
@@ -1,10 +1,22 @@
 #include "vkHelper.h"
+#include "trace.h"
 #include "FileHelper.h"
+#include <algorithm>
 #include <cstring>
 #include "stdio.h"
 
 constexpr auto g_PipelineCachePath = "pipeline.cache";
 
+// queries per job, stages beyond are not measured
+constexpr uint32_t g_MaxTimestampQueries = 1024u;
+constexpr uint32_t g_MaxStatisticsQueries = 4096u;
+
+// resources up to half of this size share blocks of device memory, smaller heaps get blocks of an eighth of their size
+constexpr VkDeviceSize g_MemoryBlockSize = 64u << 20;
+
+// fragment shader invocations followed by compute shader invocations
+constexpr VkQueryPipelineStatisticFlags g_PipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
 IBLLib::vkHelper::vkHelper()
 {
 }
@@ -72,16 +84,35 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 			}
 		}
 
+		// needed to query and enable VK_EXT_external_memory_host on a Vulkan 1.0 instance
+		std::vector<const char*> extensions = { VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME };
+
+		uint32_t extensionCount = 0u;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+		for (const char* extension : extensions)
+		{
+			if (std::none_of(availableExtensions.begin(), availableExtensions.end(), [extension](const VkExtensionProperties& _prop) { return strcmp(_prop.extensionName, extension) == 0; }))
+			{
+				extensions.clear();
+				break;
+			}
+		}
+
 		VkInstanceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 		createInfo.pApplicationInfo = &appInfo;
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		createInfo.ppEnabledExtensionNames = extensions.data();
 
 		if (_debugOutput)
 		{
 			createInfo.enabledLayerCount = static_cast<uint32_t>(layers.size());
 			createInfo.ppEnabledLayerNames = layers.data();
 		}
-		// TODO: extensions and layers if needed
 
 		if ((res = vkCreateInstance(&createInfo, nullptr, &m_instance)) != VK_SUCCESS)
 		{
@@ -128,8 +159,17 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		printf("APIVersion: %u.%u.%u\n", VK_VERSION_MAJOR(deviceProperties.apiVersion), VK_VERSION_MINOR(deviceProperties.apiVersion), VK_VERSION_PATCH(deviceProperties.apiVersion));
 		printf("DriverVersion: %u\n", deviceProperties.driverVersion);
 
+		m_timestampPeriod = deviceProperties.limits.timestampPeriod;
+		m_limits = deviceProperties.limits;
+
 		vkGetPhysicalDeviceFeatures(m_physicalDevice, &m_deviceFeatures); // TODO: check needed features
 		vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);		
+
+		// no allocation can be larger than its heap, VK_KHR_maintenance3 may lower the limit further
+		for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+		{
+			m_maxAllocationSize = std::max(m_maxAllocationSize, m_memoryProperties.memoryHeaps[i].size);
+		}
 	}
 
 	//
@@ -155,6 +195,7 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 				)
 			{
 				m_queueFamilyIndex = i;
+				m_timestampValidBits = family.timestampValidBits;
 			}
 		}
 
@@ -177,13 +218,61 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		queueCreateInfo.pQueuePriorities = &queuePriority;
 
 		VkPhysicalDeviceFeatures deviceFeatures{}; // TODO: fill required device features
+		deviceFeatures.pipelineStatisticsQuery = m_deviceFeatures.pipelineStatisticsQuery; // only used for profiling
+
+		// optional, lets inputs be uploaded straight from the pages of a mapped file
+		std::vector<const char*> extensions;
+
+		if (vkGetPhysicalDeviceProperties2KHR != nullptr)
+		{
+			uint32_t extensionCount = 0u;
+			vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+
+			std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+			vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+			const auto isAvailable = [&availableExtensions](const char* _extension)
+			{
+				return std::any_of(availableExtensions.begin(), availableExtensions.end(), [_extension](const VkExtensionProperties& _prop) { return strcmp(_prop.extensionName, _extension) == 0; });
+			};
+
+			if (isAvailable(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME) && isAvailable(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+			{
+				extensions.push_back(VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME);
+				extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+
+				VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties{};
+				hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+
+				VkPhysicalDeviceProperties2KHR properties{};
+				properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+				properties.pNext = &hostProperties;
+				vkGetPhysicalDeviceProperties2KHR(m_physicalDevice, &properties);
+
+				m_hostPointerAlignment = hostProperties.minImportedHostPointerAlignment;
+			}
+
+			if (isAvailable(VK_KHR_MAINTENANCE3_EXTENSION_NAME))
+			{
+				VkPhysicalDeviceMaintenance3PropertiesKHR maintenanceProperties{};
+				maintenanceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES_KHR;
+
+				VkPhysicalDeviceProperties2KHR properties{};
+				properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+				properties.pNext = &maintenanceProperties;
+				vkGetPhysicalDeviceProperties2KHR(m_physicalDevice, &properties);
+
+				m_maxAllocationSize = std::min(m_maxAllocationSize, maintenanceProperties.maxMemoryAllocationSize);
+			}
+		}
 
 		VkDeviceCreateInfo deviceCreateInfo{};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
 		deviceCreateInfo.queueCreateInfoCount = 1u;
 		deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
-		deviceCreateInfo.enabledExtensionCount = 0u;
+		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 
 		if ((res = vkCreateDevice(m_physicalDevice, &deviceCreateInfo, nullptr, &m_logicalDevice)) != VK_SUCCESS)
 		{
@@ -225,36 +314,18 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 	//
 
 	{
-		constexpr uint32_t descCount = 8u;
-		constexpr uint32_t setCount = 8u;
-
-		// TODO: remove unneeded descriptor types
-		VkDescriptorPoolSize sizes[] = {
-			{VK_DESCRIPTOR_TYPE_SAMPLER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, descCount * _descriptorPoolSizeFactor},
-			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, descCount * _descriptorPoolSizeFactor}
-		};
-
-		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
-		descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		descriptorPoolCreateInfo.pNext = nullptr;
-		descriptorPoolCreateInfo.pPoolSizes = sizes;
-		descriptorPoolCreateInfo.poolSizeCount = sizeof(sizes) / sizeof(VkDescriptorPoolSize);
-		descriptorPoolCreateInfo.maxSets = setCount * _descriptorPoolSizeFactor;
-
-		if ((res = vkCreateDescriptorPool(m_logicalDevice, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool)) != VK_SUCCESS)
+		m_descriptorPoolSizeFactor = _descriptorPoolSizeFactor;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		if ((res = createDescriptorPool(descriptorPool)) != VK_SUCCESS)
 		{
 			printf("Failed to create descriptor pool [%u]\n", res);
 			return res;
 		}
 
+		m_descriptorPools.push_back(descriptorPool);
+		m_currentDescriptorPool = 0u;
+
 		if (m_debugOutputEnabled)
 		{
 			printf("Descriptor pool created\n");
@@ -306,18 +377,26 @@ void IBLLib::vkHelper::shutdown()
 		m_samplers.clear();
 
 		// clear images
-		for (Image& img : m_images)
+		for (auto& img : m_images)
 		{
-			img.destroy(m_logicalDevice);
+			img.second.destroy(m_logicalDevice);
 		}
 		m_images.clear();
+		m_transientImages.clear();
 
 		// clear buffers
-		for (Buffer& buf : m_buffers)
+		for (auto& buf : m_buffers)
 		{
-			buf.destroy(m_logicalDevice);
+			buf.second.destroy(m_logicalDevice);
 		}
 		m_buffers.clear();
+		m_transientBuffers.clear();
+
+		for (MemoryBlock& block : m_memoryBlocks)
+		{
+			freeMemoryBlock(block);
+		}
+		m_memoryBlocks.clear();
 
 		// clear pipelines
 		for (const VkPipeline& pipeline : m_pipelines)
@@ -340,14 +419,18 @@ void IBLLib::vkHelper::shutdown()
 		}
 		m_descriptorSetLayouts.clear();
 
-		if (m_descriptorPool != VK_NULL_HANDLE)
+		if (m_descriptorPools.empty() == false)
 		{
-			vkDestroyDescriptorPool(m_logicalDevice, m_descriptorPool, nullptr);
+			for (const VkDescriptorPool& pool : m_descriptorPools)
+			{
+				vkDestroyDescriptorPool(m_logicalDevice, pool, nullptr);
+			}
 			if (m_debugOutputEnabled)
 			{
 				printf("Vulkan descriptor pool destroyed\n");
 			}
-			m_descriptorPool = VK_NULL_HANDLE;
+			m_descriptorPools.clear();
+			m_currentDescriptorPool = 0u;
 		}
 
 		if (m_pipelineCache != VK_NULL_HANDLE)
@@ -398,6 +481,8 @@ void IBLLib::vkHelper::shutdown()
 			m_commandPool = VK_NULL_HANDLE;
 		}
 
+		enableProfiling(false);
+
 		vkDestroyDevice(m_logicalDevice, nullptr);
 		if (m_debugOutputEnabled)
 		{
@@ -417,6 +502,82 @@ void IBLLib::vkHelper::shutdown()
 	}
 }
 
+void IBLLib::vkHelper::beginTransientResources()
+{
+	m_transientResources = true;
+	m_transientFramebufferMark = m_frameBuffers.size();
+}
+
+void IBLLib::vkHelper::releaseTransientResources()
+{
+	if (m_logicalDevice == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// transient resources might still be referenced by a failed submission
+	vkDeviceWaitIdle(m_logicalDevice);
+
+	if (m_transientFramebufferMark < m_frameBuffers.size())
+	{
+		for (size_t i = m_transientFramebufferMark; i < m_frameBuffers.size(); ++i)
+		{
+			vkDestroyFramebuffer(m_logicalDevice, m_frameBuffers[i], nullptr);
+		}
+		m_frameBuffers.resize(m_transientFramebufferMark);
+	}
+
+	// handles of resources destroyed during the job are no longer found, or belong to a later transient resource
+	for (VkImage image : m_transientImages)
+	{
+		auto it = m_images.find(image);
+		if (it != m_images.end())
+		{
+			it->second.destroy(m_logicalDevice);
+			m_images.erase(it);
+		}
+	}
+	m_transientImages.clear();
+
+	for (VkBuffer buffer : m_transientBuffers)
+	{
+		auto it = m_buffers.find(buffer);
+		if (it != m_buffers.end())
+		{
+			it->second.destroy(m_logicalDevice);
+			m_buffers.erase(it);
+		}
+	}
+	m_transientBuffers.clear();
+
+	// the arena is reset in one step, blocks the job did not need are returned to the driver
+	for (MemoryBlock& block : m_memoryBlocks)
+	{
+		if (block.memory != VK_NULL_HANDLE && block.transient)
+		{
+			if (block.dedicated || block.top == 0u)
+			{
+				freeMemoryBlock(block);
+			}
+			else
+			{
+				block.top = 0u;
+				block.allocationCount = 0u;
+			}
+		}
+	}
+
+	// the pools created for a large job are kept for the next one
+	for (const VkDescriptorPool& pool : m_descriptorPools)
+	{
+		vkResetDescriptorPool(m_logicalDevice, pool, 0u);
+	}
+	m_currentDescriptorPool = 0u;
+
+	m_transientResources = false;
+	m_transientFramebufferMark = SIZE_MAX;
+}
+
 VkResult IBLLib::vkHelper::createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level) const
 {
 	if (m_commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
@@ -580,7 +741,7 @@ VkResult IBLLib::vkHelper::executeCommandBuffers(const std::vector<VkCommandBuff
 		{
 			if (res == VK_ERROR_DEVICE_LOST)
 			{
-				printf("Failed to submit queue [VK_ERROR_DEVICE_LOST]. Prefiltering likely exceeded the TDRDelay. Consider reducing the quality of sample, outputResolution, or mipLevels.\n");
+				printf("Failed to submit queue [VK_ERROR_DEVICE_LOST]. Prefiltering likely exceeded the TDRDelay. Consider smaller tiles, sample slices or a time budget per submission.\n");
 			}
 			else
 			{
@@ -595,15 +756,25 @@ VkResult IBLLib::vkHelper::executeCommandBuffers(const std::vector<VkCommandBuff
 		}
 	}
 
-	// wait / block for execution to be complete
-	if ((res = vkWaitForFences(m_logicalDevice, 1u, &fence, VK_TRUE, UINT64_MAX)) != VK_SUCCESS)
+	// wait / block for execution to be complete, a device lost during execution is reported here
 	{
-		printf("Failed to wait for fence [%u]\n", res);
-	}
+		TraceScope trace("wait for GPU");
 
-	if ((res = vkQueueWaitIdle(m_queue)) != VK_SUCCESS)
-	{
-		printf("Failed to wait for queue [%u]\n", res);
+		if ((res = vkWaitForFences(m_logicalDevice, 1u, &fence, VK_TRUE, UINT64_MAX)) != VK_SUCCESS)
+		{
+			if (res == VK_ERROR_DEVICE_LOST)
+			{
+				printf("Failed to wait for fence [VK_ERROR_DEVICE_LOST]. Prefiltering likely exceeded the TDRDelay.\n");
+			}
+			else
+			{
+				printf("Failed to wait for fence [%u]\n", res);
+			}
+		}
+		else if ((res = vkQueueWaitIdle(m_queue)) != VK_SUCCESS)
+		{
+			printf("Failed to wait for queue [%u]\n", res);
+		}
 	}
 
 	vkDestroyFence(m_logicalDevice, fence, nullptr);
@@ -685,9 +856,9 @@ VkResult IBLLib::vkHelper::addDecriptorSetLayout(std::vector<VkDescriptorSetLayo
 	return res;
 }
 
-VkResult IBLLib::vkHelper::createDescriptorSet(VkDescriptorSet& _outDescriptorSet, VkDescriptorSetLayout _layout) const
+VkResult IBLLib::vkHelper::createDescriptorSet(VkDescriptorSet& _outDescriptorSet, VkDescriptorSetLayout _layout)
 {
-	if (m_logicalDevice == VK_NULL_HANDLE || m_descriptorPool == VK_NULL_HANDLE)
+	if (m_logicalDevice == VK_NULL_HANDLE || m_descriptorPools.empty())
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
@@ -699,9 +870,8 @@ VkResult IBLLib::vkHelper::createDescriptorSet(VkDescriptorSet& _outDescriptorSe
 	info.pNext = nullptr;
 	info.pSetLayouts = &_layout;
 	info.descriptorSetCount = 1u;
-	info.descriptorPool = m_descriptorPool;
 
-	if ((res = vkAllocateDescriptorSets(m_logicalDevice, &info, &_outDescriptorSet)) != VK_SUCCESS)
+	if ((res = allocateDescriptorSets(info, &_outDescriptorSet)) != VK_SUCCESS)
 	{
 		printf("Failed to allocate descriptor set [%u]\n", res);
 	}
@@ -709,9 +879,9 @@ VkResult IBLLib::vkHelper::createDescriptorSet(VkDescriptorSet& _outDescriptorSe
 	return res;
 }
 
-VkResult IBLLib::vkHelper::createDescriptorSets(std::vector<VkDescriptorSet>& _outDescriptorSets, const std::vector<VkDescriptorSetLayout>& _layouts) const
+VkResult IBLLib::vkHelper::createDescriptorSets(std::vector<VkDescriptorSet>& _outDescriptorSets, const std::vector<VkDescriptorSetLayout>& _layouts)
 {
-	if (m_logicalDevice == VK_NULL_HANDLE || m_descriptorPool == VK_NULL_HANDLE)
+	if (m_logicalDevice == VK_NULL_HANDLE || m_descriptorPools.empty())
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
@@ -725,9 +895,8 @@ VkResult IBLLib::vkHelper::createDescriptorSets(std::vector<VkDescriptorSet>& _o
 	info.pNext = nullptr;
 	info.pSetLayouts = _layouts.data();
 	info.descriptorSetCount = static_cast<uint32_t>(_layouts.size());
-	info.descriptorPool = m_descriptorPool;
 
-	if ((res = vkAllocateDescriptorSets(m_logicalDevice, &info, _outDescriptorSets.data())) != VK_SUCCESS)
+	if ((res = allocateDescriptorSets(info, _outDescriptorSets.data())) != VK_SUCCESS)
 	{
 		printf("Failed to allocate descriptor sets [%u]\n", res);
 	}
@@ -735,6 +904,67 @@ VkResult IBLLib::vkHelper::createDescriptorSets(std::vector<VkDescriptorSet>& _o
 	return res;
 }
 
+VkResult IBLLib::vkHelper::createDescriptorPool(VkDescriptorPool& _outPool) const
+{
+	constexpr uint32_t descCount = 8u;
+	constexpr uint32_t setCount = 8u;
+
+	// TODO: remove unneeded descriptor types
+	VkDescriptorPoolSize sizes[] = {
+		{VK_DESCRIPTOR_TYPE_SAMPLER, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, descCount * m_descriptorPoolSizeFactor},
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, descCount * m_descriptorPoolSizeFactor}
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo{};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.pNext = nullptr;
+	descriptorPoolCreateInfo.pPoolSizes = sizes;
+	descriptorPoolCreateInfo.poolSizeCount = sizeof(sizes) / sizeof(VkDescriptorPoolSize);
+	descriptorPoolCreateInfo.maxSets = setCount * m_descriptorPoolSizeFactor;
+
+	return vkCreateDescriptorPool(m_logicalDevice, &descriptorPoolCreateInfo, nullptr, &_outPool);
+}
+
+VkResult IBLLib::vkHelper::allocateDescriptorSets(const VkDescriptorSetAllocateInfo& _info, VkDescriptorSet* _pOutDescriptorSets)
+{
+	VkDescriptorSetAllocateInfo info = _info;
+	info.descriptorPool = m_descriptorPools[m_currentDescriptorPool];
+
+	VkResult res = vkAllocateDescriptorSets(m_logicalDevice, &info, _pOutDescriptorSets);
+
+	// An exhausted pool reports VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL, drivers before Vulkan 1.1 may report it as out of memory.
+	// The sets are taken from the next pool then, sets that don't fit into a new pool are an error.
+	bool createdPool = false;
+	while (res != VK_SUCCESS && res != VK_ERROR_DEVICE_LOST && createdPool == false)
+	{
+		if (++m_currentDescriptorPool == m_descriptorPools.size())
+		{
+			VkDescriptorPool pool = VK_NULL_HANDLE;
+			if ((res = createDescriptorPool(pool)) != VK_SUCCESS)
+			{
+				--m_currentDescriptorPool;
+				return res;
+			}
+
+			m_descriptorPools.push_back(pool);
+			createdPool = true;
+		}
+
+		info.descriptorPool = m_descriptorPools[m_currentDescriptorPool];
+		res = vkAllocateDescriptorSets(m_logicalDevice, &info, _pOutDescriptorSets);
+	}
+
+	return res;
+}
+
 void IBLLib::vkHelper::bindDescriptorSets(VkCommandBuffer _cmdBuffer, VkPipelineLayout _layout, const std::vector<VkDescriptorSet>& _descriptorSets, VkPipelineBindPoint _bindPoint, uint32_t _firstSet, const std::vector<uint32_t>& _dynamicOffsets) const
 {
 	vkCmdBindDescriptorSets(_cmdBuffer, _bindPoint, _layout, _firstSet, static_cast<uint32_t>(_descriptorSets.size()), _descriptorSets.data(),  static_cast<uint32_t>(_dynamicOffsets.size()), _dynamicOffsets.data());
@@ -827,6 +1057,27 @@ VkResult IBLLib::vkHelper::createPipeline(VkPipeline& _outPipeline, const VkGrap
 	return res;
 }
 
+VkResult IBLLib::vkHelper::createPipeline(VkPipeline& _outPipeline, const VkComputePipelineCreateInfo* _pCreateInfo)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkResult res = VK_SUCCESS;
+
+	if ((res = vkCreateComputePipelines(m_logicalDevice, m_pipelineCache, 1u, _pCreateInfo, nullptr, &_outPipeline)) != VK_SUCCESS)
+	{
+		_outPipeline = VK_NULL_HANDLE;
+		printf("Failed to create compute pipeline [%u]\n", res);
+		return res;
+	}
+
+	m_pipelines.emplace_back(_outPipeline);
+
+	return res;
+}
+
 VkResult IBLLib::vkHelper::createRenderPass(VkRenderPass& _outRenderPass, const VkRenderPassCreateInfo* _pCreateInfo)
 {
 	if (m_logicalDevice == VK_NULL_HANDLE)
@@ -858,7 +1109,7 @@ bool IBLLib::vkHelper::getMemoryTypeIndex(const VkMemoryRequirements& _requireme
 	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
 	{
 		if ((_requirements.memoryTypeBits & (1 << i)) &&
-			(m_memoryProperties.memoryTypes[i].propertyFlags & _properties))
+			(m_memoryProperties.memoryTypes[i].propertyFlags & _properties) == _properties)
 		{
 			_outIndex = i;
 			return true;
@@ -868,170 +1119,498 @@ bool IBLLib::vkHelper::getMemoryTypeIndex(const VkMemoryRequirements& _requireme
 	return false;
 }
 
-VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_t _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkBufferCreateFlags _flags)
+bool IBLLib::vkHelper::hasMemoryType(VkMemoryPropertyFlags _properties) const
 {
-	if (m_logicalDevice == VK_NULL_HANDLE)
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
 	{
-		return VK_RESULT_MAX_ENUM;
+		if ((m_memoryProperties.memoryTypes[i].propertyFlags & _properties) == _properties)
+		{
+			return true;
+		}
 	}
 
-	VkBufferCreateInfo bufferInfo{};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.pNext = nullptr;
-	bufferInfo.size = _byteSize;
-	bufferInfo.usage = _usage;
-	bufferInfo.sharingMode = _sharingMode;
-	bufferInfo.pQueueFamilyIndices = &m_queueFamilyIndex;
-	bufferInfo.queueFamilyIndexCount = 1u;
-	bufferInfo.flags = _flags;
+	return false;
+}
+
+VkResult IBLLib::vkHelper::allocateMemory(const VkMemoryRequirements& _requirements, VkMemoryPropertyFlags _properties, uint32_t& _outBlock, VkDeviceSize& _outOffset)
+{
+	uint32_t memoryTypeIndex = 0u;
+	if (getMemoryTypeIndex(_requirements, _properties, memoryTypeIndex) == false)
+	{
+		printf("Unsupported memory requirements\n");
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	const bool transient = m_transientResources;
+	const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+	const VkDeviceSize blockSize = std::min(g_MemoryBlockSize, heapSize / 8u);
 
 	VkResult res = VK_SUCCESS;
 
-	if ((res = vkCreateBuffer(m_logicalDevice, &bufferInfo, nullptr, &_outBuffer)) != VK_SUCCESS)
+	if (_requirements.size > blockSize / 2u)
 	{
-		_outBuffer = VK_NULL_HANDLE;
-		printf("Failed to create buffer [%u]\n", res);
+		if ((res = createMemoryBlock(memoryTypeIndex, _requirements.size, true, _outBlock)) != VK_SUCCESS)
+		{
+			return res;
+		}
+
+		m_memoryBlocks[_outBlock].transient = transient;
+		m_memoryBlocks[_outBlock].allocationCount = 1u;
+		_outOffset = 0u;
 		return res;
 	}
 
-	m_buffers.emplace_back();
-	Buffer& buffer = m_buffers.back();
+	// buffers and optimal images share blocks, placing everything on granularity boundaries keeps them off each others pages.
+	// Flushes and invalidates of non-coherent memory cover whole atoms, which must not reach into a neighbouring buffer.
+	const VkMemoryPropertyFlags propertyFlags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+	const bool isNonCoherent = (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0u && (propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0u;
+	const VkDeviceSize alignment = std::max({ _requirements.alignment, m_limits.bufferImageGranularity, isNonCoherent ? m_limits.nonCoherentAtomSize : VkDeviceSize(1u) });
 
-	buffer.buffer = _outBuffer;
-	buffer.info = bufferInfo;
+	uint32_t blockIndex = UINT32_MAX;
+	VkDeviceSize offset = 0u;
 
-	VkMemoryRequirements requirements{};
-	vkGetBufferMemoryRequirements(m_logicalDevice, _outBuffer, &requirements);
+	for (uint32_t i = 0; i < static_cast<uint32_t>(m_memoryBlocks.size()) && blockIndex == UINT32_MAX; ++i)
+	{
+		const MemoryBlock& block = m_memoryBlocks[i];
+		offset = (block.top + alignment - 1u) / alignment * alignment;
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.allocationSize = requirements.size;
+		if (block.memory != VK_NULL_HANDLE && block.dedicated == false && block.transient == transient &&
+			block.memoryTypeIndex == memoryTypeIndex && offset + _requirements.size <= block.size)
+		{
+			blockIndex = i;
+		}
+	}
 
-	if (getMemoryTypeIndex(requirements, _memoryFlags, allocInfo.memoryTypeIndex) == false)
+	if (blockIndex == UINT32_MAX)
 	{
-		printf("Unsupported memory requirements [%u]\n", res);
-		return res;
+		if ((res = createMemoryBlock(memoryTypeIndex, blockSize, false, blockIndex)) != VK_SUCCESS)
+		{
+			return res;
+		}
+
+		m_memoryBlocks[blockIndex].transient = transient;
+		offset = 0u;
 	}
 
-	if ((res = vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &buffer.memory)) != VK_SUCCESS)
+	MemoryBlock& block = m_memoryBlocks[blockIndex];
+	block.top = offset + _requirements.size;
+	++block.allocationCount;
+
+	_outBlock = blockIndex;
+	_outOffset = offset;
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::createMemoryBlock(uint32_t _memoryTypeIndex, VkDeviceSize _size, bool _dedicated, uint32_t& _outBlock, const void* _pNext)
+{
+	TraceScope trace("createMemoryBlock", static_cast<size_t>(_size));
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = _pNext;
+	allocInfo.allocationSize = _size;
+	allocInfo.memoryTypeIndex = _memoryTypeIndex;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+
+	VkResult res = VK_SUCCESS;
+	if ((res = vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &memory)) != VK_SUCCESS)
 	{
-		printf("Failed to allocate buffer [%u]\n", res);
 		return res;
 	}
 
-	if ((res = vkBindBufferMemory(m_logicalDevice, _outBuffer, buffer.memory, 0u)) != VK_SUCCESS)
+	// slots of freed blocks are reused, resources refer to their block by index
+	auto it = std::find_if(m_memoryBlocks.begin(), m_memoryBlocks.end(), [](const MemoryBlock& _block) { return _block.memory == VK_NULL_HANDLE; });
+	if (it == m_memoryBlocks.end())
 	{
-		printf("Failed to bind buffer memory [%u]\n", res);
+		it = m_memoryBlocks.emplace(it);
 	}
 
+	*it = MemoryBlock{};
+	it->memory = memory;
+	it->size = _size;
+	it->memoryTypeIndex = _memoryTypeIndex;
+	it->dedicated = _dedicated;
+
+	_outBlock = static_cast<uint32_t>(it - m_memoryBlocks.begin());
+
 	return res;
 }
 
-void IBLLib::vkHelper::destroyBuffer(VkBuffer _buffer)
+void IBLLib::vkHelper::freeMemory(uint32_t _block)
 {
-	if (m_logicalDevice != VK_NULL_HANDLE)
+	if (_block >= m_memoryBlocks.size())
 	{
-		for (auto it = m_buffers.begin(), end = m_buffers.end(); it != end; ++it)
+		return;
+	}
+
+	MemoryBlock& block = m_memoryBlocks[_block];
+	if (block.allocationCount > 0u && --block.allocationCount == 0u)
+	{
+		if (block.dedicated)
 		{
-			if (it->buffer == _buffer)
-			{
-				it->destroy(m_logicalDevice);
-				m_buffers.erase(it);
-				break;
-			}
+			freeMemoryBlock(block);
+		}
+		else if (block.transient == false)
+		{
+			// the arena is reset by releaseTransientResources
+			block.top = 0u;
 		}
 	}
 }
 
-VkResult IBLLib::vkHelper::writeBufferData(VkBuffer _buffer, const void* _pData, size_t _bytes)
+void IBLLib::vkHelper::freeMemoryBlock(MemoryBlock& _block)
 {
-	VkResult res = VK_RESULT_MAX_ENUM;
-
-	if (m_logicalDevice == VK_NULL_HANDLE)
+	if (_block.memory != VK_NULL_HANDLE)
 	{
-		return res;
+		vkFreeMemory(m_logicalDevice, _block.memory, nullptr);
 	}
 
-	for (const Buffer& buf : m_buffers)
+	_block = MemoryBlock{};
+}
+
+VkResult IBLLib::vkHelper::mapMemory(uint32_t _block, uint8_t*& _outData)
+{
+	MemoryBlock& block = m_memoryBlocks[_block];
+
+	if (block.mapped == nullptr)
 	{
-		if (buf.buffer == _buffer && buf.memory != VK_NULL_HANDLE)
+		if ((m_memoryProperties.memoryTypes[block.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0u)
 		{
-			void* data = nullptr;
-			if ((res = vkMapMemory(m_logicalDevice, buf.memory, 0u, _bytes, 0, &data)) != VK_SUCCESS)
-			{
-				printf("Failed to map buffer memory [%u]\n", res);
-				return res;
-			}
+			return VK_ERROR_MEMORY_MAP_FAILED;
+		}
+
+		// freeing the block unmaps it
+		void* data = nullptr;
 
-			// write data
-			memcpy(data, _pData, _bytes);
-			vkUnmapMemory(m_logicalDevice, buf.memory);
+		VkResult res = VK_SUCCESS;
+		if ((res = vkMapMemory(m_logicalDevice, block.memory, 0u, VK_WHOLE_SIZE, 0, &data)) != VK_SUCCESS)
+		{
 			return res;
 		}
+
+		block.mapped = static_cast<uint8_t*>(data);
 	}
 
-	printf("Not a valid buffer\n");
+	_outData = block.mapped;
 
-	return res;
+	return VK_SUCCESS;
 }
 
-VkResult IBLLib::vkHelper::readBufferData(VkBuffer _buffer, void* _pData, size_t _bytes, size_t _offset)
+VkResult IBLLib::vkHelper::syncMappedMemory(const Buffer& _buffer, bool _flush)
 {
-	VkResult res = VK_RESULT_MAX_ENUM;
+	const MemoryBlock& block = m_memoryBlocks[_buffer.block];
 
-	if (m_logicalDevice == VK_NULL_HANDLE)
-	{
-		return res;
-	}
-
-	for (const Buffer& buf : m_buffers)
+	if ((_buffer.memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0u || block.mapped == nullptr)
 	{
-		if (buf.buffer == _buffer && buf.memory != VK_NULL_HANDLE)
-		{
-			void* data = nullptr;
-			if ((res = vkMapMemory(m_logicalDevice, buf.memory, _offset, _bytes, 0, &data)) != VK_SUCCESS)
-			{
-				printf("Failed to map buffer memory [%u]\n", res);
-				return res;
-			}
-
-			// read data
-			memcpy(_pData, data, _bytes);			
-
-			vkUnmapMemory(m_logicalDevice, buf.memory);
-			return res;
-		}
+		return VK_SUCCESS;
 	}
+	const VkDeviceSize atomSize = std::max<VkDeviceSize>(m_limits.nonCoherentAtomSize, 1u);
 
-	printf("Not a valid buffer\n");
+	VkMappedMemoryRange range{};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = block.memory;
+	range.offset = _buffer.offset / atomSize * atomSize;
+	range.size = std::min((_buffer.offset + _buffer.info.size - range.offset + atomSize - 1u) / atomSize * atomSize, block.size - range.offset);
 
-	return res;
+	return _flush ? vkFlushMappedMemoryRanges(m_logicalDevice, 1u, &range) : vkInvalidateMappedMemoryRanges(m_logicalDevice, 1u, &range);
 }
 
-VkResult IBLLib::vkHelper::createImage2DAndAllocate(
-	VkImage& _outImage, uint32_t _width, uint32_t _height,
-	VkFormat _format, VkImageUsageFlags _usage, 
-	uint32_t _mipLevels, uint32_t _arrayLayers,
-	VkImageTiling _tiling, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkImageCreateFlags _flags)
+VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkBufferCreateFlags _flags)
 {
 	if (m_logicalDevice == VK_NULL_HANDLE)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
 
-	VkImageCreateInfo imageInfo{};
-	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageInfo.extent.width = _width;
-	imageInfo.extent.height = _height;
-	imageInfo.extent.depth = 1u;
-	imageInfo.mipLevels = _mipLevels;
-	imageInfo.arrayLayers = _arrayLayers;
-	imageInfo.format = _format;
-	imageInfo.tiling = _tiling;
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageInfo.usage = _usage;
+	if (_byteSize > m_maxAllocationSize)
+	{
+		printf("Buffer size %llu exceeds the largest allocation of the device\n", static_cast<unsigned long long>(_byteSize));
+		return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+	}
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.pNext = nullptr;
+	bufferInfo.size = _byteSize;
+	bufferInfo.usage = _usage;
+	bufferInfo.sharingMode = _sharingMode;
+	bufferInfo.pQueueFamilyIndices = &m_queueFamilyIndex;
+	bufferInfo.queueFamilyIndexCount = 1u;
+	bufferInfo.flags = _flags;
+
+	VkResult res = VK_SUCCESS;
+
+	if ((res = vkCreateBuffer(m_logicalDevice, &bufferInfo, nullptr, &_outBuffer)) != VK_SUCCESS)
+	{
+		_outBuffer = VK_NULL_HANDLE;
+		printf("Failed to create buffer [%u]\n", res);
+		return res;
+	}
+
+	Buffer& buffer = m_buffers[_outBuffer];
+
+	buffer.buffer = _outBuffer;
+	buffer.info = bufferInfo;
+
+	if (m_transientResources)
+	{
+		m_transientBuffers.push_back(_outBuffer);
+	}
+
+	VkMemoryRequirements requirements{};
+	vkGetBufferMemoryRequirements(m_logicalDevice, _outBuffer, &requirements);
+
+	if ((res = allocateMemory(requirements, _memoryFlags, buffer.block, buffer.offset)) != VK_SUCCESS)
+	{
+		printf("Failed to allocate buffer [%u]\n", res);
+		return res;
+	}
+
+	const MemoryBlock& block = m_memoryBlocks[buffer.block];
+	buffer.memoryFlags = m_memoryProperties.memoryTypes[block.memoryTypeIndex].propertyFlags;
+
+	if ((res = vkBindBufferMemory(m_logicalDevice, _outBuffer, block.memory, buffer.offset)) != VK_SUCCESS)
+	{
+		printf("Failed to bind buffer memory [%u]\n", res);
+	}
+
+	return res;
+}
+
+void IBLLib::vkHelper::destroyBuffer(VkBuffer _buffer)
+{
+	if (m_logicalDevice != VK_NULL_HANDLE)
+	{
+		auto it = m_buffers.find(_buffer);
+		if (it != m_buffers.end())
+		{
+			it->second.destroy(m_logicalDevice);
+			freeMemory(it->second.block);
+			m_buffers.erase(it);
+		}
+	}
+}
+
+VkResult IBLLib::vkHelper::writeBufferData(VkBuffer _buffer, const void* _pData, size_t _bytes)
+{
+	TraceScope trace("writeBufferData", _bytes);
+
+	VkResult res = VK_RESULT_MAX_ENUM;
+
+	uint8_t* data = nullptr;
+	if ((res = getMappedData(_buffer, data)) != VK_SUCCESS)
+	{
+		return res;
+	}
+
+	// write data
+	memcpy(data, _pData, _bytes);
+
+	return flushBuffer(_buffer);
+}
+
+VkResult IBLLib::vkHelper::readBufferData(VkBuffer _buffer, void* _pData, size_t _bytes, size_t _offset)
+{
+	TraceScope trace("readBufferData", _bytes);
+
+	VkResult res = VK_RESULT_MAX_ENUM;
+
+	uint8_t* data = nullptr;
+	if ((res = getMappedData(_buffer, data)) != VK_SUCCESS || (res = invalidateBuffer(_buffer)) != VK_SUCCESS)
+	{
+		return res;
+	}
+
+	// read data
+	memcpy(_pData, data + _offset, _bytes);
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::getMappedData(VkBuffer _buffer, uint8_t*& _outData)
+{
+	VkResult res = VK_RESULT_MAX_ENUM;
+
+	if (m_logicalDevice == VK_NULL_HANDLE)
+	{
+		return res;
+	}
+
+	auto it = m_buffers.find(_buffer);
+	if (it != m_buffers.end() && it->second.block != UINT32_MAX)
+	{
+		const Buffer& buf = it->second;
+
+		uint8_t* data = nullptr;
+		if ((res = mapMemory(buf.block, data)) != VK_SUCCESS)
+		{
+			printf("Failed to map buffer memory [%u]\n", res);
+			return res;
+		}
+
+		_outData = data + buf.offset;
+		return res;
+	}
+
+	printf("Not a valid buffer\n");
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::invalidateBuffer(VkBuffer _buffer)
+{
+	auto it = m_buffers.find(_buffer);
+	if (it == m_buffers.end() || it->second.block == UINT32_MAX)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	// cached memory without coherency still holds stale lines of earlier reads
+	VkResult res = VK_SUCCESS;
+	if ((res = syncMappedMemory(it->second, false)) != VK_SUCCESS)
+	{
+		printf("Failed to invalidate buffer memory [%u]\n", res);
+	}
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::flushBuffer(VkBuffer _buffer)
+{
+	auto it = m_buffers.find(_buffer);
+	if (it == m_buffers.end() || it->second.block == UINT32_MAX)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkResult res = VK_SUCCESS;
+	if ((res = syncMappedMemory(it->second, true)) != VK_SUCCESS)
+	{
+		printf("Failed to flush buffer memory [%u]\n", res);
+	}
+
+	return res;
+}
+
+VkMemoryPropertyFlags IBLLib::vkHelper::getReadbackMemoryFlags() const
+{
+	const VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+	return hasMemoryType(cached) ? cached : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+VkResult IBLLib::vkHelper::importHostBuffer(VkBuffer& _outBuffer, const void* _hostPointer, size_t _byteSize, VkBufferUsageFlags _usage)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE || m_hostPointerAlignment == 0u)
+	{
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkResult res = VK_SUCCESS;
+
+	// memory types the driver can import the pointer into
+	VkMemoryHostPointerPropertiesEXT pointerProperties{};
+	pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+
+	if ((res = vkGetMemoryHostPointerPropertiesEXT(m_logicalDevice, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, _hostPointer, &pointerProperties)) != VK_SUCCESS)
+	{
+		return res;
+	}
+
+	VkExternalMemoryBufferCreateInfoKHR externalInfo{};
+	externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO_KHR;
+	externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.pNext = &externalInfo;
+	bufferInfo.size = _byteSize;
+	bufferInfo.usage = _usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.pQueueFamilyIndices = &m_queueFamilyIndex;
+	bufferInfo.queueFamilyIndexCount = 1u;
+
+	if ((res = vkCreateBuffer(m_logicalDevice, &bufferInfo, nullptr, &_outBuffer)) != VK_SUCCESS)
+	{
+		_outBuffer = VK_NULL_HANDLE;
+		printf("Failed to create buffer [%u]\n", res);
+		return res;
+	}
+
+	VkMemoryRequirements requirements{};
+	vkGetBufferMemoryRequirements(m_logicalDevice, _outBuffer, &requirements);
+	requirements.memoryTypeBits &= pointerProperties.memoryTypeBits;
+
+	VkImportMemoryHostPointerInfoEXT importInfo{};
+	importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	importInfo.pHostPointer = const_cast<void*>(_hostPointer);
+
+	// the imported memory is a dedicated block, it is never mapped by this instance
+	uint32_t memoryTypeIndex = 0u;
+	uint32_t block = UINT32_MAX;
+
+	if (requirements.size > _byteSize || getMemoryTypeIndex(requirements, 0u, memoryTypeIndex) == false)
+	{
+		res = VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+	else if ((res = createMemoryBlock(memoryTypeIndex, _byteSize, true, block, &importInfo)) == VK_SUCCESS)
+	{
+		// freed by releaseTransientResources if an error path skips destroyBuffer, before the imported pages are unmapped
+		m_memoryBlocks[block].transient = m_transientResources;
+		m_memoryBlocks[block].allocationCount = 1u;
+		res = vkBindBufferMemory(m_logicalDevice, _outBuffer, m_memoryBlocks[block].memory, 0u);
+	}
+
+	if (res != VK_SUCCESS)
+	{
+		vkDestroyBuffer(m_logicalDevice, _outBuffer, nullptr);
+		freeMemory(block);
+		_outBuffer = VK_NULL_HANDLE;
+		return res;
+	}
+
+	Buffer& buffer = m_buffers[_outBuffer];
+
+	if (m_transientResources)
+	{
+		m_transientBuffers.push_back(_outBuffer);
+	}
+
+	bufferInfo.pNext = nullptr;
+	buffer.buffer = _outBuffer;
+	buffer.info = bufferInfo;
+	buffer.block = block;
+	buffer.memoryFlags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::createImage2DAndAllocate(
+	VkImage& _outImage, uint32_t _width, uint32_t _height,
+	VkFormat _format, VkImageUsageFlags _usage, 
+	uint32_t _mipLevels, uint32_t _arrayLayers,
+	VkImageTiling _tiling, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkImageCreateFlags _flags)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = _width;
+	imageInfo.extent.height = _height;
+	imageInfo.extent.depth = 1u;
+	imageInfo.mipLevels = _mipLevels;
+	imageInfo.arrayLayers = _arrayLayers;
+	imageInfo.format = _format;
+	imageInfo.tiling = _tiling;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = _usage;
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.sharingMode = _sharingMode;
 	imageInfo.flags = _flags;
@@ -1044,33 +1623,27 @@ VkResult IBLLib::vkHelper::createImage2DAndAllocate(
 		return res;
 	}
 
-	m_images.emplace_back();
-	Image& img = m_images.back();
+	Image& img = m_images[_outImage];
 
 	img.image = _outImage;
 	img.info = imageInfo;
 
-	VkMemoryRequirements requirements{};
-	vkGetImageMemoryRequirements(m_logicalDevice, _outImage, &requirements);
-
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.allocationSize = requirements.size;
-
-	if (getMemoryTypeIndex(requirements, _memoryFlags, allocInfo.memoryTypeIndex) == false)
+	if (m_transientResources)
 	{
-		printf("Unsupported memory requirements [%u]\n", res);
-		return res;
+		m_transientImages.push_back(_outImage);
 	}
 
-	if ((res = vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &img.memory)) != VK_SUCCESS)
+	VkMemoryRequirements requirements{};
+	vkGetImageMemoryRequirements(m_logicalDevice, _outImage, &requirements);
+
+	VkDeviceSize offset = 0u;
+	if ((res = allocateMemory(requirements, _memoryFlags, img.block, offset)) != VK_SUCCESS)
 	{
 		printf("Failed to allocate image [%u]\n", res);
 		return res;
 	}
 
-	if ((res = vkBindImageMemory(m_logicalDevice, _outImage, img.memory, 0u)) != VK_SUCCESS)
+	if ((res = vkBindImageMemory(m_logicalDevice, _outImage, m_memoryBlocks[img.block].memory, offset)) != VK_SUCCESS)
 	{
 		printf("Failed to bind image memory [%u]\n", res);
 	}
@@ -1091,12 +1664,6 @@ void IBLLib::vkHelper::Image::destroy(VkDevice _device)
 		vkDestroyImage(_device, image, nullptr);
 		image = VK_NULL_HANDLE;
 	}
-
-	if (memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(_device, memory, nullptr);
-		memory = VK_NULL_HANDLE;
-	}
 }
 
 void IBLLib::vkHelper::Buffer::destroy(VkDevice _device)
@@ -1106,26 +1673,18 @@ void IBLLib::vkHelper::Buffer::destroy(VkDevice _device)
 		vkDestroyBuffer(_device, buffer, nullptr);
 		buffer = VK_NULL_HANDLE;
 	}
-
-	if (memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(_device, memory, nullptr);
-		memory = VK_NULL_HANDLE;
-	}
 }
 
 void IBLLib::vkHelper::destroyImage(VkImage _image)
 {
 	if (m_logicalDevice != VK_NULL_HANDLE)
 	{
-		for (auto it = m_images.begin(), end = m_images.end(); it != end; ++it)
+		auto it = m_images.find(_image);
+		if (it != m_images.end())
 		{
-			if (it->image == _image)
-			{
-				it->destroy(m_logicalDevice);
-				m_images.erase(it);
-				break;
-			}
+			it->second.destroy(m_logicalDevice);
+			freeMemory(it->second.block);
+			m_images.erase(it);
 		}
 	}
 }
@@ -1137,33 +1696,33 @@ VkResult IBLLib::vkHelper::createImageView(VkImageView& _outView, VkImage _image
 		return VK_RESULT_MAX_ENUM;
 	}
 
-	for (Image& img : m_images)
+	auto it = m_images.find(_image);
+	if (it != m_images.end())
 	{
-		if (img.image == _image)
-		{
-			VkImageViewCreateInfo info{};
-			info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			info.pNext = nullptr;
-			info.format = _format == VK_FORMAT_UNDEFINED ? img.info.format : _format;
-			info.flags = 0u;
-			info.image = _image;
-			info.components = _swizzle;
-			info.viewType = _type;
-			info.subresourceRange = _range;
+		Image& img = it->second;
 
-			VkResult res = vkCreateImageView(m_logicalDevice, &info, nullptr, &_outView);
+		VkImageViewCreateInfo info{};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		info.pNext = nullptr;
+		info.format = _format == VK_FORMAT_UNDEFINED ? img.info.format : _format;
+		info.flags = 0u;
+		info.image = _image;
+		info.components = _swizzle;
+		info.viewType = _type;
+		info.subresourceRange = _range;
 
-			if (res == VK_SUCCESS)
-			{
-				img.views.emplace_back(_outView);			
-			}
-			else
-			{
-				printf("Failed to create image view [%u]\n", res);
-			}
+		VkResult res = vkCreateImageView(m_logicalDevice, &info, nullptr, &_outView);
 
-			return res;
+		if (res == VK_SUCCESS)
+		{
+			img.views.emplace_back(_outView);			
 		}
+		else
+		{
+			printf("Failed to create image view [%u]\n", res);
+		}
+
+		return res;
 	}
 
 	return VK_RESULT_MAX_ENUM;
@@ -1171,53 +1730,60 @@ VkResult IBLLib::vkHelper::createImageView(VkImageView& _outView, VkImage _image
 
 void IBLLib::vkHelper::copyBufferToBasicImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst) const
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_dst);
+	if (it != m_images.end())
 	{
-		if (img.image == _dst)
-		{
-			VkBufferImageCopy region{};
-			region.bufferOffset = 0u;
-			region.bufferRowLength = 0u;
-			region.bufferImageHeight = 0u;
+		const Image& img = it->second;
 
-			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			region.imageSubresource.mipLevel = 0u;
-			region.imageSubresource.baseArrayLayer = 0u;
-			region.imageSubresource.layerCount = img.info.arrayLayers;// 1u;
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0u;
+		region.bufferRowLength = 0u;
+		region.bufferImageHeight = 0u;
 
-			region.imageOffset = { 0, 0, 0 };
-			region.imageExtent = img.info.extent;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0u;
+		region.imageSubresource.baseArrayLayer = 0u;
+		region.imageSubresource.layerCount = img.info.arrayLayers;// 1u;
 
-			vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
-			return;
-		}
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = img.info.extent;
+
+		vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
+		return;
 	}
 }
 
+void IBLLib::vkHelper::copyBufferToImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst, const std::vector<VkBufferImageCopy>& _regions) const
+{
+	vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(_regions.size()),
+		_regions.data());
+}
+
 void IBLLib::vkHelper::copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, VkImageSubresourceLayers _imageSubresource) const
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_src);
+	if (it != m_images.end())
 	{
-		if (img.image == _src)
-		{
-			VkBufferImageCopy region{};
-			region.bufferOffset = 0u;
-			region.bufferRowLength = 0u;
-			region.bufferImageHeight = 0u;
+		const Image& img = it->second;
 
-			region.imageSubresource = _imageSubresource;
+		VkBufferImageCopy region{};
+		region.bufferOffset = 0u;
+		region.bufferRowLength = 0u;
+		region.bufferImageHeight = 0u;
 
-			region.imageOffset = { 0, 0, 0 };
-			region.imageExtent = img.info.extent;
-		
-			vkCmdCopyImageToBuffer(_cmdBuffer, _src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				_dst,	//	VkBuffer
-				1u,		//	uint32_t  regionCount,
-				&region	//	const VkBufferImageCopy* pRegions);
-				);
+		region.imageSubresource = _imageSubresource;
 
-			return;
-		}
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = img.info.extent;
+	
+		vkCmdCopyImageToBuffer(_cmdBuffer, _src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			_dst,	//	VkBuffer
+			1u,		//	uint32_t  regionCount,
+			&region	//	const VkBufferImageCopy* pRegions);
+			);
+
+		return;
 	}
 
 	printf("image not found\n");
@@ -1231,21 +1797,29 @@ void IBLLib::vkHelper::copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _
 		&_region);
 }
 
+void IBLLib::vkHelper::copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, const std::vector<VkBufferImageCopy>& _regions) const
+{
+	vkCmdCopyImageToBuffer(_cmdBuffer, _src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		_dst,
+		static_cast<uint32_t>(_regions.size()),
+		_regions.data());
+}
+
 void IBLLib::vkHelper::imageBarrier(VkCommandBuffer _cmdBuffer, VkImage _image, 
 									VkImageLayout oldLayout, VkImageLayout newLayout, 
 									VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess, 
 									VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess, 
 									VkImageSubresourceRange _subresourceRange) const
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_image);
+	if (it != m_images.end())
 	{
-		if (img.image == _image)
-		{
-			if (_subresourceRange.layerCount == 0)
-				_subresourceRange.layerCount = img.info.arrayLayers;
-			if (_subresourceRange.levelCount == 0)
-				_subresourceRange.levelCount = img.info.mipLevels;
-		}
+		const Image& img = it->second;
+
+		if (_subresourceRange.layerCount == 0)
+			_subresourceRange.layerCount = img.info.arrayLayers;
+		if (_subresourceRange.levelCount == 0)
+			_subresourceRange.levelCount = img.info.mipLevels;
 	}
 
 	VkImageMemoryBarrier barrier{};
@@ -1303,12 +1877,12 @@ VkResult IBLLib::vkHelper::createFramebuffer(VkFramebuffer& _outFramebuffer, VkR
 
 VkResult IBLLib::vkHelper::createFramebuffer(VkFramebuffer& _outFramebuffer, VkRenderPass _renderPass, VkImage _image)
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_image);
+	if (it != m_images.end())
 	{
-		if (img.image == _image)
-		{
-			return createFramebuffer(_outFramebuffer, _renderPass, img.info.extent.width, img.info.extent.height, img.views, img.info.arrayLayers);
-		}
+		const Image& img = it->second;
+
+		return createFramebuffer(_outFramebuffer, _renderPass, img.info.extent.width, img.info.extent.height, img.views, img.info.arrayLayers);
 	}
 
 	return VK_RESULT_MAX_ENUM;
@@ -1328,6 +1902,20 @@ void IBLLib::vkHelper::beginRenderPass(VkCommandBuffer _cmdBuffer, VkRenderPass
 	vkCmdBeginRenderPass(_cmdBuffer, &info, _contents);
 }
 
+void IBLLib::vkHelper::setViewport(VkCommandBuffer _cmdBuffer, const VkExtent2D& _viewportExtent, const VkRect2D& _scissor) const
+{
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)_viewportExtent.width;
+	viewport.height = (float)_viewportExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	vkCmdSetViewport(_cmdBuffer, 0u, 1u, &viewport);
+	vkCmdSetScissor(_cmdBuffer, 0u, 1u, &_scissor);
+}
+
 void IBLLib::vkHelper::fillSamplerCreateInfo(VkSamplerCreateInfo& _samplerInfo)
 {
 	_samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -1377,15 +1965,222 @@ VkResult IBLLib::vkHelper::createSampler(VkSampler& _outSampler, VkSamplerCreate
 
 const VkImageCreateInfo* IBLLib::vkHelper::getCreateInfo(const VkImage _image)
 {
-	for (const Image& img : m_images)
+	auto it = m_images.find(_image);
+	if (it != m_images.end())
+	{
+		return &it->second.info;
+	}
+
+	return nullptr;
+}
+
+const VkBufferCreateInfo* IBLLib::vkHelper::getBufferCreateInfo(const VkBuffer _buffer)
+{
+	auto it = m_buffers.find(_buffer);
+	if (it != m_buffers.end())
+	{
+		return &it->second.info;
+	}
+
+	return nullptr;
+}
+
+VkFormatFeatureFlags IBLLib::vkHelper::getOptimalTilingFeatures(VkFormat _format) const
+{
+	VkFormatProperties properties{};
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, _format, &properties);
+
+	return properties.optimalTilingFeatures;
+}
+
+VkResult IBLLib::vkHelper::enableProfiling(bool _enable)
+{
+	VkResult res = VK_SUCCESS;
+
+	m_profiling = _enable;
+	resetProfile();
+
+	if (_enable == false)
 	{
-		if (img.image == _image)
+		if (m_timestampPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(m_logicalDevice, m_timestampPool, nullptr);
+			m_timestampPool = VK_NULL_HANDLE;
+		}
+
+		if (m_statisticsPool != VK_NULL_HANDLE)
 		{
-			return &img.info;
+			vkDestroyQueryPool(m_logicalDevice, m_statisticsPool, nullptr);
+			m_statisticsPool = VK_NULL_HANDLE;
 		}
+
+		return res;
 	}
 
-	return nullptr;
+	if (m_timestampPool == VK_NULL_HANDLE && m_timestampValidBits > 0u)
+	{
+		VkQueryPoolCreateInfo info{};
+		info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		info.queryCount = g_MaxTimestampQueries;
+
+		if ((res = vkCreateQueryPool(m_logicalDevice, &info, nullptr, &m_timestampPool)) != VK_SUCCESS)
+		{
+			printf("Failed to create timestamp query pool [%u]\n", res);
+			return res;
+		}
+	}
+	else if (m_timestampValidBits == 0u)
+	{
+		printf("The queue does not support timestamps, only host stages are profiled\n");
+	}
+
+	if (m_statisticsPool == VK_NULL_HANDLE && m_deviceFeatures.pipelineStatisticsQuery)
+	{
+		VkQueryPoolCreateInfo info{};
+		info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		info.queryCount = g_MaxStatisticsQueries;
+		info.pipelineStatistics = g_PipelineStatistics;
+
+		if ((res = vkCreateQueryPool(m_logicalDevice, &info, nullptr, &m_statisticsPool)) != VK_SUCCESS)
+		{
+			printf("Failed to create pipeline statistics query pool [%u]\n", res);
+			return res;
+		}
+	}
+
+	return res;
+}
+
+void IBLLib::vkHelper::resetProfile()
+{
+	m_profile.clear();
+	m_profileOutput = -1;
+	m_timestampCount = 0u;
+	m_statisticsCount = 0u;
+}
+
+uint32_t IBLLib::vkHelper::beginGpuStage(VkCommandBuffer _cmdBuffer, const std::string& _name)
+{
+	if (m_profiling == false)
+	{
+		return UINT32_MAX;
+	}
+
+	m_profile.emplace_back();
+	ProfileEntry& entry = m_profile.back();
+	entry.stage.name = _name;
+	entry.stage.output = m_profileOutput;
+
+	if (m_timestampPool != VK_NULL_HANDLE && m_timestampCount + 2u <= g_MaxTimestampQueries)
+	{
+		entry.beginTimestamp = m_timestampCount++;
+		entry.endTimestamp = m_timestampCount++;
+
+		vkCmdResetQueryPool(_cmdBuffer, m_timestampPool, entry.beginTimestamp, 2u);
+		vkCmdWriteTimestamp(_cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, entry.beginTimestamp);
+	}
+
+	return static_cast<uint32_t>(m_profile.size() - 1u);
+}
+
+void IBLLib::vkHelper::endGpuStage(VkCommandBuffer _cmdBuffer, uint32_t _stage)
+{
+	if (_stage < m_profile.size() && m_profile[_stage].endTimestamp != UINT32_MAX)
+	{
+		vkCmdWriteTimestamp(_cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, m_profile[_stage].endTimestamp);
+	}
+}
+
+void IBLLib::vkHelper::beginStatistics(VkCommandBuffer _cmdBuffer, uint32_t _stage)
+{
+	if (_stage < m_profile.size() && m_statisticsPool != VK_NULL_HANDLE && m_statisticsCount < g_MaxStatisticsQueries)
+	{
+		ProfileEntry& entry = m_profile[_stage];
+		entry.activeStatistics = m_statisticsCount++;
+		entry.statistics.push_back(entry.activeStatistics);
+
+		vkCmdResetQueryPool(_cmdBuffer, m_statisticsPool, entry.activeStatistics, 1u);
+		vkCmdBeginQuery(_cmdBuffer, m_statisticsPool, entry.activeStatistics, 0u);
+	}
+}
+
+void IBLLib::vkHelper::endStatistics(VkCommandBuffer _cmdBuffer, uint32_t _stage)
+{
+	if (_stage < m_profile.size() && m_profile[_stage].activeStatistics != UINT32_MAX)
+	{
+		vkCmdEndQuery(_cmdBuffer, m_statisticsPool, m_profile[_stage].activeStatistics);
+		m_profile[_stage].activeStatistics = UINT32_MAX;
+	}
+}
+
+uint32_t IBLLib::vkHelper::beginHostStage(const std::string& _name)
+{
+	if (m_profiling == false)
+	{
+		return UINT32_MAX;
+	}
+
+	m_profile.emplace_back();
+	ProfileEntry& entry = m_profile.back();
+	entry.stage.name = _name;
+	entry.stage.output = m_profileOutput;
+	entry.hostStart = std::chrono::steady_clock::now();
+
+	return static_cast<uint32_t>(m_profile.size() - 1u);
+}
+
+void IBLLib::vkHelper::endHostStage(uint32_t _stage)
+{
+	if (_stage < m_profile.size())
+	{
+		ProfileEntry& entry = m_profile[_stage];
+		entry.stage.hostMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entry.hostStart).count();
+	}
+}
+
+VkResult IBLLib::vkHelper::resolveProfile(std::vector<ProfileStage>& _outStages)
+{
+	VkResult res = VK_SUCCESS;
+
+	_outStages.clear();
+
+	const uint64_t timestampMask = m_timestampValidBits >= 64u ? UINT64_MAX : (uint64_t(1) << m_timestampValidBits) - 1u;
+
+	for (ProfileEntry& entry : m_profile)
+	{
+		if (entry.beginTimestamp != UINT32_MAX)
+		{
+			uint64_t timestamps[2] = {};
+			if ((res = vkGetQueryPoolResults(m_logicalDevice, m_timestampPool, entry.beginTimestamp, 2u, sizeof(timestamps), timestamps, sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)) != VK_SUCCESS)
+			{
+				printf("Failed to read timestamps [%d]\n", res);
+				return res;
+			}
+
+			entry.stage.gpuMs = static_cast<double>((timestamps[1] - timestamps[0]) & timestampMask) * m_timestampPeriod * 1e-6;
+		}
+
+		for (uint32_t query : entry.statistics)
+		{
+			uint64_t invocations[2] = {};
+			if ((res = vkGetQueryPoolResults(m_logicalDevice, m_statisticsPool, query, 1u, sizeof(invocations), invocations, sizeof(invocations),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)) != VK_SUCCESS)
+			{
+				printf("Failed to read pipeline statistics [%d]\n", res);
+				return res;
+			}
+
+			entry.stage.fragmentInvocations += invocations[0];
+			entry.stage.computeInvocations += invocations[1];
+		}
+
+		_outStages.push_back(entry.stage);
+	}
+
+	return res;
 }
 
 const VkSpecializationInfo* IBLLib::SpecConstantFactory::getInfo()
@@ -1428,12 +2223,30 @@ void IBLLib::DescriptorSetInfo::addCombinedImageSampler(VkSampler _sampler, VkIm
 	m_resources.emplace_back(_sampler, _imageView, _imageLayout);
 }
 
+void IBLLib::DescriptorSetInfo::addStorageImage(VkImageView _imageView, VkImageLayout _imageLayout, uint32_t _binding, VkShaderStageFlags _stages)
+{
+	addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1u, _stages, _binding);
+	m_resources.emplace_back(VkSampler(VK_NULL_HANDLE), _imageView, _imageLayout);
+}
+
 void IBLLib::DescriptorSetInfo::addUniform(VkBuffer _uniform, VkDeviceSize _offset, VkDeviceSize _range, uint32_t _binding, VkShaderStageFlags _stages)
 {
 	addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1u, _stages, _binding);
 	m_resources.emplace_back(_uniform, _offset, _range);
 }
 
+void IBLLib::DescriptorSetInfo::addStorageBuffer(VkBuffer _buffer, VkDeviceSize _offset, VkDeviceSize _range, uint32_t _binding, VkShaderStageFlags _stages)
+{
+	addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1u, _stages, _binding);
+	m_resources.emplace_back(_buffer, _offset, _range);
+}
+
+void IBLLib::DescriptorSetInfo::addStorageBufferDynamic(VkBuffer _buffer, VkDeviceSize _offset, VkDeviceSize _range, uint32_t _binding, VkShaderStageFlags _stages)
+{
+	addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1u, _stages, _binding);
+	m_resources.emplace_back(_buffer, _offset, _range);
+}
+
 VkResult IBLLib::DescriptorSetInfo::create(vkHelper& _instance, std::vector<VkDescriptorSetLayout>& _outLayouts, std::vector<VkDescriptorSet>& _outDescriptorSets)
 {
 	_outLayouts.emplace_back();
@@ -1453,6 +2266,15 @@ VkResult IBLLib::DescriptorSetInfo::create(vkHelper& _instance, VkDescriptorSetL
 
 	_outLayout = m_layout;
 
+	return allocate(_instance, m_layout, _outDescriptorSet);
+}
+
+VkResult IBLLib::DescriptorSetInfo::allocate(vkHelper& _instance, VkDescriptorSetLayout _layout, VkDescriptorSet& _outDescriptorSet)
+{
+	m_layout = _layout;
+
+	VkResult res = VK_SUCCESS;
+
 	if ((res = _instance.createDescriptorSet(m_descriptorSet, m_layout)) != VK_SUCCESS)
 	{
 		return res;
@@ -1532,8 +2354,8 @@ IBLLib::GraphicsPipelineDesc::GraphicsPipelineDesc()
 	// enable all dynamic states, dont bake these into pipeline
 	static const VkDynamicState dynamicStates[] =
 	{ 
-	//	VK_DYNAMIC_STATE_VIEWPORT,
-	//	VK_DYNAMIC_STATE_SCISSOR,
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
 		VK_DYNAMIC_STATE_LINE_WIDTH,
 		VK_DYNAMIC_STATE_DEPTH_BIAS,
 		VK_DYNAMIC_STATE_BLEND_CONSTANTS,
@@ -2,6 +2,11 @@
 
 #include <volk.h>
 #include <vector>
+#include <unordered_map>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 
 namespace IBLLib
 {
@@ -17,6 +22,12 @@ namespace IBLLib
 
 		void shutdown();
 
+		// images, buffers and framebuffers created after this call are destroyed by releaseTransientResources(),
+		// which also returns all descriptor sets to the pool. Used to scope per-job resources of a long-lived instance.
+		// Their memory is placed in an arena of blocks that is reset in one step and reused by the next job.
+		void beginTransientResources();
+		void releaseTransientResources();
+
 		VkResult createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
 
 		// command buffers are owned by this vkHelper instance, do not reset or destory manually
@@ -50,11 +61,11 @@ namespace IBLLib
 		// this variant adds the created layout to the end of _outLayouts
 		VkResult addDecriptorSetLayout(std::vector<VkDescriptorSetLayout>& _outLayouts, const VkDescriptorSetLayoutCreateInfo* _pCreateInfo);
 
-		// sets are owned by this vkHelper instance descriptor pool, dont free manually
-		VkResult createDescriptorSet(VkDescriptorSet& _outDescriptorSet, VkDescriptorSetLayout _layout) const;
+		// sets are owned by this vkHelper instance descriptor pools, dont free manually
+		VkResult createDescriptorSet(VkDescriptorSet& _outDescriptorSet, VkDescriptorSetLayout _layout);
 
-		// sets are owned by this vkHelper instance descriptor pool, dont free manually
-		VkResult createDescriptorSets(std::vector<VkDescriptorSet>& _outDescriptorSets, const std::vector<VkDescriptorSetLayout>& _layouts) const;
+		// sets are owned by this vkHelper instance descriptor pools, dont free manually
+		VkResult createDescriptorSets(std::vector<VkDescriptorSet>& _outDescriptorSets, const std::vector<VkDescriptorSetLayout>& _layouts);
 
 		void bindDescriptorSets(VkCommandBuffer _cmdBuffer, VkPipelineLayout _layout, const std::vector<VkDescriptorSet>& _descriptorSets, VkPipelineBindPoint _bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS, uint32_t _firstSet = 0u, const std::vector<uint32_t>& _dynamicOffsets = {}) const;
 		void bindDescriptorSet(VkCommandBuffer _cmdBuffer, VkPipelineLayout _layout, const VkDescriptorSet _descriptorSets, VkPipelineBindPoint _bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS, uint32_t _firstSet = 0u, const std::vector<uint32_t> & _dynamicOffsets = {}) const;
@@ -68,6 +79,7 @@ namespace IBLLib
 
 		// pipelines are owned by this vkHelper instance, do not destory manually
 		VkResult createPipeline(VkPipeline& _outPipeline, const VkGraphicsPipelineCreateInfo* _pCreateInfo);
+		VkResult createPipeline(VkPipeline& _outPipeline, const VkComputePipelineCreateInfo* _pCreateInfo);
 
 		// renderpasses are owned by this vkHelper instance, do not destory manually
 		VkResult createRenderPass(VkRenderPass& _outRenderPass, const VkRenderPassCreateInfo* _pCreateInfo);
@@ -75,13 +87,37 @@ namespace IBLLib
 		// returns true if memory type is supported by the device
 		bool getMemoryTypeIndex(const VkMemoryRequirements& _requirements, VkMemoryPropertyFlags _properties, uint32_t& _outIndex);
 
-		VkResult createBufferAndAllocate(VkBuffer& _outBuffer, uint32_t _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkSharingMode _sharingMode = VK_SHARING_MODE_EXCLUSIVE, VkBufferCreateFlags _flags = 0u);
+		// returns true if one of the memory types has all of _properties
+		bool hasMemoryType(VkMemoryPropertyFlags _properties) const;
+
+		// Buffers and images are placed at aligned offsets in large blocks of device memory per memory type,
+		// resources larger than half a block get a block of their own
+		VkResult createBufferAndAllocate(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkSharingMode _sharingMode = VK_SHARING_MODE_EXCLUSIVE, VkBufferCreateFlags _flags = 0u);
 
 		void destroyBuffer(VkBuffer _buffer);
 
+		// copy through the mapped memory and flush or invalidate it
 		VkResult writeBufferData(VkBuffer _buffer, const void* _pData, size_t _bytes);
 		VkResult readBufferData(VkBuffer _buffer, void* _pData, size_t _bytes, size_t _offset=0u);
 
+		// Host visible memory is mapped once and stays mapped, the pointer is valid until the buffer is destroyed.
+		// Without HOST_COHERENT the host reads after invalidateBuffer and the device sees host writes after flushBuffer,
+		// both do nothing for coherent memory.
+		VkResult getMappedData(VkBuffer _buffer, uint8_t*& _outData);
+		VkResult invalidateBuffer(VkBuffer _buffer);
+		VkResult flushBuffer(VkBuffer _buffer);
+
+		// HOST_VISIBLE | HOST_CACHED if the device has such a memory type, HOST_VISIBLE | HOST_COHERENT otherwise.
+		// Reading write combined memory from the host is many times slower than reading cached memory.
+		VkMemoryPropertyFlags getReadbackMemoryFlags() const;
+
+		// minImportedHostPointerAlignment of VK_EXT_external_memory_host, 0 if the device does not support the extension
+		VkDeviceSize getHostPointerAlignment() const { return m_hostPointerAlignment; }
+
+		// Wraps host memory in a buffer without a copy, _hostPointer and _byteSize must be multiples of getHostPointerAlignment().
+		// The memory must stay valid until the buffer is destroyed.
+		VkResult importHostBuffer(VkBuffer& _outBuffer, const void* _hostPointer, size_t _byteSize, VkBufferUsageFlags _usage);
+
 		VkResult createImage2DAndAllocate(VkImage& _outImage, uint32_t _width, uint32_t _height,
 			VkFormat _format, VkImageUsageFlags _usage,
 			uint32_t _mipLevels = 1u, uint32_t _arrayLayers = 1u,
@@ -95,8 +131,10 @@ namespace IBLLib
 		VkResult createImageView(VkImageView& _outView, VkImage _image, VkImageSubresourceRange _range = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u }, VkFormat _format = VK_FORMAT_UNDEFINED, VkImageViewType _type = VK_IMAGE_VIEW_TYPE_2D, VkComponentMapping  _swizzle = { VK_COMPONENT_SWIZZLE_IDENTITY , VK_COMPONENT_SWIZZLE_IDENTITY ,VK_COMPONENT_SWIZZLE_IDENTITY ,VK_COMPONENT_SWIZZLE_IDENTITY });
 
 		void copyBufferToBasicImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst) const;
+		void copyBufferToImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst, const std::vector<VkBufferImageCopy>& _regions) const;
 		void copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, VkImageSubresourceLayers _imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT ,0u, 0u, 1u}) const;
 		void copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, const VkBufferImageCopy& _region) const;
+		void copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, const std::vector<VkBufferImageCopy>& _regions) const;
 
 		void imageBarrier(VkCommandBuffer _cmdBuffer, VkImage _image,
 			VkImageLayout _oldLayout, VkImageLayout _newLayout,
@@ -133,17 +171,89 @@ namespace IBLLib
 
 		void endRenderPass(VkCommandBuffer _cmdBuffer) const { vkCmdEndRenderPass(_cmdBuffer); };
 
+		// pipelines are created with dynamic viewport and scissor state
+		void setViewport(VkCommandBuffer _cmdBuffer, const VkExtent2D& _viewportExtent, const VkRect2D& _scissor) const;
+
 		void fillSamplerCreateInfo(VkSamplerCreateInfo& _samplerInfo);
 		VkResult createSampler(VkSampler& _outSampler, VkSamplerCreateInfo _info);
 
 		const VkImageCreateInfo* getCreateInfo(const VkImage _image);
+		const VkBufferCreateInfo* getBufferCreateInfo(const VkBuffer _buffer);
+
+		const VkPhysicalDeviceLimits& getLimits() const { return m_limits; }
+
+		// largest single allocation, createBufferAndAllocate fails for larger buffers
+		VkDeviceSize getMaxAllocationSize() const { return m_maxAllocationSize; }
+
+		// features of _format with VK_IMAGE_TILING_OPTIMAL
+		VkFormatFeatureFlags getOptimalTilingFeatures(VkFormat _format) const;
+
+		// Profiling of the stages of a job: GPU stages are bracketed with timestamps, the passes within them can be counted
+		// with pipeline statistics, host stages are measured with the wall clock. All calls do nothing while profiling is disabled.
+		struct ProfileStage
+		{
+			std::string name;
+			int32_t output = -1;
+			double gpuMs = 0.0;
+			double hostMs = 0.0;
+			uint64_t fragmentInvocations = 0u;
+			uint64_t computeInvocations = 0u;
+		};
+
+		VkResult enableProfiling(bool _enable);
+		bool isProfiling() const { return m_profiling; }
+
+		// discards the stages of the previous job
+		void resetProfile();
+
+		// stages begun afterwards are attributed to this output, -1 for the shared input
+		void setProfileOutput(int32_t _output) { m_profileOutput = _output; }
+
+		// timestamps must be written outside of render passes
+		uint32_t beginGpuStage(VkCommandBuffer _cmdBuffer, const std::string& _name);
+		void endGpuStage(VkCommandBuffer _cmdBuffer, uint32_t _stage);
+
+		// counts the shader invocations of the commands in between, both calls go into the same command buffer outside of render passes
+		void beginStatistics(VkCommandBuffer _cmdBuffer, uint32_t _stage);
+		void endStatistics(VkCommandBuffer _cmdBuffer, uint32_t _stage);
+
+		uint32_t beginHostStage(const std::string& _name);
+		void endHostStage(uint32_t _stage);
+
+		// waits for the queries, all command buffers of the job must have been submitted
+		VkResult resolveProfile(std::vector<ProfileStage>& _outStages);
 
 	private:
+		// device memory that resources are placed in linearly, the block is reset once all of them are freed
+		struct MemoryBlock
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0u;
+			VkDeviceSize top = 0u; // end of the last placement
+			uint32_t memoryTypeIndex = 0u;
+			uint32_t allocationCount = 0u;
+			uint8_t* mapped = nullptr; // mapped on first use until the block is freed
+			bool transient = false; // part of the arena of releaseTransientResources
+			bool dedicated = false; // holds a single resource and is freed with it
+		};
+
+		VkResult allocateMemory(const VkMemoryRequirements& _requirements, VkMemoryPropertyFlags _properties, uint32_t& _outBlock, VkDeviceSize& _outOffset);
+		VkResult createMemoryBlock(uint32_t _memoryTypeIndex, VkDeviceSize _size, bool _dedicated, uint32_t& _outBlock, const void* _pNext = nullptr);
+		void freeMemory(uint32_t _block);
+		void freeMemoryBlock(MemoryBlock& _block);
+		VkResult mapMemory(uint32_t _block, uint8_t*& _outData);
+
+		// a job takes sets from the pools in order and creates another pool once all of them are exhausted
+		VkResult createDescriptorPool(VkDescriptorPool& _outPool) const;
+		VkResult allocateDescriptorSets(const VkDescriptorSetAllocateInfo& _info, VkDescriptorSet* _pOutDescriptorSets);
+
 		struct Buffer
 		{
 			VkBufferCreateInfo info{};
 			VkBuffer buffer = VK_NULL_HANDLE;
-			VkDeviceMemory memory = VK_NULL_HANDLE;
+			uint32_t block = UINT32_MAX;
+			VkDeviceSize offset = 0u;
+			VkMemoryPropertyFlags memoryFlags = 0u;
 			void destroy(VkDevice _device);
 		};
 
@@ -151,21 +261,29 @@ namespace IBLLib
 		{
 			VkImageCreateInfo info{};
 			VkImage image = VK_NULL_HANDLE;
-			VkDeviceMemory memory = VK_NULL_HANDLE;
+			uint32_t block = UINT32_MAX;
 			std::vector<VkImageView> views;
 			void destroy(VkDevice _device);
 		};
 
+		// flushes or invalidates the buffer rounded out to whole nonCoherentAtomSize atoms, nothing for host coherent memory
+		VkResult syncMappedMemory(const Buffer& _buffer, bool _flush);
+
 		VkInstance m_instance = VK_NULL_HANDLE;
 		VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
 		VkPhysicalDeviceFeatures m_deviceFeatures{};
 		VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+		VkPhysicalDeviceLimits m_limits{};
+		VkDeviceSize m_hostPointerAlignment = 0u;
+		VkDeviceSize m_maxAllocationSize = 0u;
 
 		VkDevice m_logicalDevice = VK_NULL_HANDLE;
 		VkQueue m_queue = VK_NULL_HANDLE;
 		uint32_t m_queueFamilyIndex = 0u;
 		VkCommandPool m_commandPool = VK_NULL_HANDLE;
-		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorPool> m_descriptorPools;
+		size_t m_currentDescriptorPool = 0u;
+		uint32_t m_descriptorPoolSizeFactor = 1u;
 		VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
 
 		std::vector<VkShaderModule> m_shaderModules;
@@ -174,11 +292,38 @@ namespace IBLLib
 		std::vector<VkPipeline> m_pipelines;
 		std::vector<VkRenderPass> m_renderPasses;
 		std::vector<VkFramebuffer> m_frameBuffers;
-		std::vector<Buffer> m_buffers;
-		std::vector<Image> m_images;
+		// keyed by handle, the helper functions look resources up in constant time however many a process has created
+		std::unordered_map<VkBuffer, Buffer> m_buffers;
+		std::unordered_map<VkImage, Image> m_images;
 		std::vector<VkSampler> m_samplers;
+		std::vector<MemoryBlock> m_memoryBlocks;
+
+		bool m_transientResources = false;
+		std::vector<VkBuffer> m_transientBuffers;
+		std::vector<VkImage> m_transientImages;
+		size_t m_transientFramebufferMark = SIZE_MAX;
 
 		bool m_debugOutputEnabled;
+
+		struct ProfileEntry
+		{
+			ProfileStage stage;
+			uint32_t beginTimestamp = UINT32_MAX;
+			uint32_t endTimestamp = UINT32_MAX;
+			uint32_t activeStatistics = UINT32_MAX;
+			std::vector<uint32_t> statistics;
+			std::chrono::steady_clock::time_point hostStart;
+		};
+
+		bool m_profiling = false;
+		int32_t m_profileOutput = -1;
+		float m_timestampPeriod = 1.f; // nanoseconds per tick
+		uint32_t m_timestampValidBits = 0u;
+		VkQueryPool m_timestampPool = VK_NULL_HANDLE;
+		VkQueryPool m_statisticsPool = VK_NULL_HANDLE;
+		uint32_t m_timestampCount = 0u;
+		uint32_t m_statisticsCount = 0u;
+		std::vector<ProfileEntry> m_profile;
 	};
 
 	class SpecConstantFactory
@@ -215,12 +360,19 @@ namespace IBLLib
 	public:
 
 		void addCombinedImageSampler(VkSampler _sampler, VkImageView _imageView, VkImageLayout _imageLayout, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_FRAGMENT_BIT);
+		void addStorageImage(VkImageView _imageView, VkImageLayout _imageLayout = VK_IMAGE_LAYOUT_GENERAL, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_COMPUTE_BIT);
 		void addUniform(VkBuffer _uniform, VkDeviceSize _offset = 0u, VkDeviceSize _range = VK_WHOLE_SIZE, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_ALL_GRAPHICS);
+		void addStorageBuffer(VkBuffer _buffer, VkDeviceSize _offset = 0u, VkDeviceSize _range = VK_WHOLE_SIZE, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_ALL_GRAPHICS);
+		// the offset passed to bindDescriptorSet() is added to _offset, _range must leave room for it
+		void addStorageBufferDynamic(VkBuffer _buffer, VkDeviceSize _offset = 0u, VkDeviceSize _range = VK_WHOLE_SIZE, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_ALL_GRAPHICS);
 
 		// helper function that creates layout and descriptor set and VkWriteDescriptorSets
 		VkResult create(vkHelper& _instance, std::vector<VkDescriptorSetLayout>& _outLayouts, std::vector<VkDescriptorSet>& _outDescriptorSets);
 		VkResult create(vkHelper& _instance, VkDescriptorSetLayout& _outLayout, VkDescriptorSet& _outDescriptorSet);
 
+		// allocates a descriptor set for a layout that was created earlier from the same bindings and fills the VkWriteDescriptorSets
+		VkResult allocate(vkHelper& _instance, VkDescriptorSetLayout _layout, VkDescriptorSet& _outDescriptorSet);
+
 		const VkDescriptorSetLayoutCreateInfo* getLayoutCreateInfo();
 		const std::vector<VkWriteDescriptorSet>& getWrites() const { return m_writes; }
 
@@ -0,0 +1,351 @@
+#include "GltfIblSampler.h"
+#include "format.h"
+#include "formatConversion.h"
+#include "hdrImage.h"
+#include "ktxImage.h"
+#include "STBImage.h"
+#include "threadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace IBLLib;
+
+// Times the host paths that scale with the output size: the target format conversion of a cube face,
+// the assembly of a KTX2 cube map from its faces and the decode of an .hdr panorama. Reports MB/s.
+
+namespace
+{
+	struct Format
+	{
+		const char* name;
+		VkFormat format;
+	};
+
+	const Format g_formats[] = {
+		{ "R8G8B8A8_UNORM", VK_FORMAT_R8G8B8A8_UNORM },
+		{ "R16G16B16A16_SFLOAT", VK_FORMAT_R16G16B16A16_SFLOAT },
+		{ "R32G32B32A32_SFLOAT", VK_FORMAT_R32G32B32A32_SFLOAT },
+		{ "B9G9R9E5_UFLOAT", VK_FORMAT_E5B9G9R9_UFLOAT_PACK32 },
+	};
+
+	struct Measurement
+	{
+		std::string benchmark;
+		std::string format;
+		unsigned int size;
+		double bytes;
+		double ms;
+	};
+
+	std::vector<std::string> splitList(const char* _list)
+	{
+		std::vector<std::string> items;
+		std::string item;
+
+		for (const char* c = _list; ; ++c)
+		{
+			if (*c == ',' || *c == '\0')
+			{
+				if (!item.empty())
+				{
+					items.push_back(item);
+				}
+				item.clear();
+
+				if (*c == '\0')
+				{
+					break;
+				}
+			}
+			else
+			{
+				item += *c;
+			}
+		}
+
+		return items;
+	}
+
+	// fastest of _repeatCount runs in milliseconds
+	double measure(unsigned int _repeatCount, const std::function<void()>& _run)
+	{
+		double bestMs = 0.0;
+
+		for (unsigned int run = 0; run < _repeatCount; ++run)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			_run();
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			bestMs = run == 0u ? ms : std::min(bestMs, ms);
+		}
+
+		return bestMs;
+	}
+
+	// RGBA32F values spread over several orders of magnitude, so the exponent paths of the conversions are taken
+	void createHdrFace(unsigned int _sideLength, std::vector<uint8_t>& _outData)
+	{
+		const size_t count = static_cast<size_t>(_sideLength) * _sideLength * 4u;
+		_outData.resize(count * sizeof(float));
+
+		uint32_t state = 12345u;
+		for (size_t i = 0; i < count; ++i)
+		{
+			state = state * 1664525u + 1013904223u;
+			const float value = (i & 3u) == 3u ? 1.0f : ldexpf(static_cast<float>(state >> 8) / 16777216.0f, static_cast<int>(state & 15u) - 6);
+			memcpy(&_outData[i * sizeof(float)], &value, sizeof(float));
+		}
+	}
+
+	void printResult(const Measurement& _result)
+	{
+		printf("%-18s %-20s %5u %10.2f ms %10.1f MB/s\n", _result.benchmark.c_str(), _result.format.c_str(), _result.size, _result.ms,
+			_result.bytes / (_result.ms * 1000.0));
+	}
+} // !anonymous namespace
+
+int main(int argc, char* argv[])
+{
+	const char* sizesString = "256,1024,4096";
+	const char* formatsString = "R8G8B8A8_UNORM,R16G16B16A16_SFLOAT,B9G9R9E5_UFLOAT";
+	const char* benchmarksString = "convert,ktx,hdr";
+	const char* hdrPath = "ibl_microbench.hdr";
+	const char* pathCsv = nullptr;
+	unsigned int repeatCount = 3u;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* nextArg = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
+		{
+			printf("ibl_microbench usage:\n");
+			printf("-sizes: cube map side lengths, comma separated (default = 256,1024,4096) \n");
+			printf("-targetFormats: formats of the convert and ktx benchmarks (default = R8G8B8A8_UNORM,R16G16B16A16_SFLOAT,B9G9R9E5_UFLOAT) \n");
+			printf("-benchmarks: convert (RGBA32F cube face to the target format, single threaded and on all hardware threads), ktx (KtxImage of a cube map with all mip levels), hdr (decode of a 4n x 2n .hdr panorama by stb_image and by HdrImage on all hardware threads) (default = convert,ktx,hdr) \n");
+			printf("-hdrPath: temporary file of the hdr benchmark (default = ibl_microbench.hdr) \n");
+			printf("-repeat: runs per measurement, the fastest one is reported (default = 3) \n");
+			printf("-csv: also write the results to this CSV file \n");
+			return 0;
+		}
+		else if (nextArg == nullptr)
+		{
+			printf("Missing value of %s\n", argv[i]);
+			return -1;
+		}
+		else if (strcmp(argv[i], "-sizes") == 0)
+		{
+			sizesString = nextArg;
+		}
+		else if (strcmp(argv[i], "-targetFormats") == 0)
+		{
+			formatsString = nextArg;
+		}
+		else if (strcmp(argv[i], "-benchmarks") == 0)
+		{
+			benchmarksString = nextArg;
+		}
+		else if (strcmp(argv[i], "-hdrPath") == 0)
+		{
+			hdrPath = nextArg;
+		}
+		else if (strcmp(argv[i], "-repeat") == 0)
+		{
+			repeatCount = std::max(1u, static_cast<unsigned int>(strtoul(nextArg, NULL, 0)));
+		}
+		else if (strcmp(argv[i], "-csv") == 0)
+		{
+			pathCsv = nextArg;
+		}
+		++i;
+	}
+
+	std::vector<unsigned int> sizes;
+	for (const std::string& value : splitList(sizesString))
+	{
+		sizes.push_back(strtoul(value.c_str(), NULL, 0));
+	}
+
+	std::vector<const Format*> formats;
+	for (const std::string& value : splitList(formatsString))
+	{
+		const Format* format = std::find_if(std::begin(g_formats), std::end(g_formats), [&value](const Format& _format) { return value == _format.name; });
+		if (format == std::end(g_formats))
+		{
+			printf("Unknown format %s\n", value.c_str());
+			return -1;
+		}
+		formats.push_back(format);
+	}
+
+	const std::vector<std::string> benchmarks = splitList(benchmarksString);
+	const auto isEnabled = [&benchmarks](const char* _name) { return std::find(benchmarks.begin(), benchmarks.end(), _name) != benchmarks.end(); };
+
+	std::vector<Measurement> results;
+	ThreadPool pool;
+
+	for (unsigned int size : sizes)
+	{
+		// one face on the calling thread and on the thread pool, the MB/s refer to the RGBA32F input
+		if (isEnabled("convert"))
+		{
+			std::vector<uint8_t> face, converted;
+			createHdrFace(size, face);
+
+			const size_t texelCount = static_cast<size_t>(size) * size;
+
+			for (const Format* format : formats)
+			{
+				converted.resize(texelCount * getFormatSize(format->format));
+
+				double ms = measure(repeatCount, [&]()
+				{
+					convertTexels(converted.data(), format->format, face.data(), VK_FORMAT_R32G32B32A32_SFLOAT, texelCount);
+				});
+
+				results.push_back({ "convertTexels", format->name, size, static_cast<double>(face.size()), ms });
+				printResult(results.back());
+
+				ms = measure(repeatCount, [&]()
+				{
+					convertTexels(converted.data(), format->format, face.data(), VK_FORMAT_R32G32B32A32_SFLOAT, texelCount, &pool);
+				});
+
+				results.push_back({ "convertTexels/pool", format->name, size, static_cast<double>(face.size()), ms });
+				printResult(results.back());
+			}
+		}
+
+		// constructor plus writeFace of every face and level, the MB/s refer to the size of the file
+		if (isEnabled("ktx"))
+		{
+			unsigned int levelCount = 0u;
+			for (unsigned int m = size; m > 0u; m >>= 1u, ++levelCount) {}
+
+			for (const Format* format : formats)
+			{
+				const size_t texelByteSize = getFormatSize(format->format);
+				std::vector<uint8_t> face(static_cast<size_t>(size) * size * texelByteSize, 0x3C);
+				std::vector<uint8_t> levelFace;
+				double bytes = 0.0;
+
+				const double ms = measure(repeatCount, [&]()
+				{
+					KtxImage ktxImage(size, size, format->format, levelCount, true);
+					bytes = 0.0;
+
+					for (unsigned int level = 0; level < levelCount; ++level)
+					{
+						const size_t sideLength = std::max(size >> level, 1u);
+						levelFace.assign(face.begin(), face.begin() + sideLength * sideLength * texelByteSize);
+
+						for (unsigned int side = 0; side < 6u; ++side)
+						{
+							ktxImage.writeFace(levelFace, side, level);
+							bytes += static_cast<double>(levelFace.size());
+						}
+					}
+				});
+
+				results.push_back({ "KtxImage", format->name, size, bytes, ms });
+				printResult(results.back());
+			}
+		}
+
+		// a cube map of n x n is sampled from a 4n x 2n panorama, the MB/s refer to the RGBA32F result
+		if (isEnabled("hdr"))
+		{
+			const int width = static_cast<int>(size) * 4;
+			const int height = static_cast<int>(size) * 2;
+
+			{
+				std::vector<float> panorama(static_cast<size_t>(width) * height * 3u);
+				for (int y = 0; y < height; ++y)
+				{
+					for (int x = 0; x < width; ++x)
+					{
+						float* texel = &panorama[(static_cast<size_t>(y) * width + x) * 3u];
+						texel[0] = 0.5f + static_cast<float>(x) / width;
+						texel[1] = 0.25f + static_cast<float>(y) / height;
+						texel[2] = (x ^ y) & 64 ? 40.0f : 0.8f;
+					}
+				}
+
+				STBImage writer;
+				if (writer.saveHdr(hdrPath, width, height, 3, panorama.data()) != Success)
+				{
+					printf("Could not write %s\n", hdrPath);
+					return -1;
+				}
+			}
+
+			double bytes = 0.0;
+			bool loaded = true;
+			const double ms = measure(repeatCount, [&]()
+			{
+				STBImage image;
+				loaded = image.loadHdr(hdrPath) == Success;
+				bytes = static_cast<double>(image.getByteSize());
+			});
+
+			// the decoder of the library writes into preallocated memory like the staging buffer, sizes stb_image refuses are skipped as well
+			std::vector<uint8_t> decoded(loaded ? static_cast<size_t>(width) * height * 4u * sizeof(float) : 0u);
+			const double decodeMs = loaded ? measure(repeatCount, [&]()
+			{
+				HdrImage image;
+				if (image.open(hdrPath))
+				{
+					image.decode(decoded.data(), VK_FORMAT_R32G32B32A32_SFLOAT, &pool);
+				}
+			}) : 0.0;
+
+			remove(hdrPath);
+
+			// stb_image refuses results of 2 GB and more, i.e. panoramas for cube maps of 4096 and larger
+			if (loaded)
+			{
+				results.push_back({ "STBImage::loadHdr", "R32G32B32A32_SFLOAT", size, bytes, ms });
+				printResult(results.back());
+			}
+			else
+			{
+				printf("STBImage::loadHdr of %d x %d skipped\n", width, height);
+			}
+
+			if (loaded)
+			{
+				results.push_back({ "HdrImage/pool", "R32G32B32A32_SFLOAT", size, static_cast<double>(decoded.size()), decodeMs });
+				printResult(results.back());
+			}
+		}
+	}
+
+	if (pathCsv != nullptr)
+	{
+		FILE* file = fopen(pathCsv, "w");
+		if (file == nullptr)
+		{
+			printf("Could not open %s\n", pathCsv);
+			return -1;
+		}
+
+		fprintf(file, "benchmark,format,size,bytes,ms,MBps\n");
+		for (const Measurement& result : results)
+		{
+			fprintf(file, "%s,%s,%u,%.0f,%.4f,%.2f\n", result.benchmark.c_str(), result.format.c_str(), result.size, result.bytes, result.ms,
+				result.bytes / (result.ms * 1000.0));
+		}
+
+		fclose(file);
+	}
+
+	return 0;
+}